@@ -1,3 +1,3 @@
-./configure --with-java-home=/usr/lib/jvm/java-1.7.0-openjdk-amd64 --prefix=/build
+./configure --with-java-home=/usr/lib/jvm/java-8-openjdk-amd64 --prefix=/build
 make
 make install
@@ -0,0 +1,90 @@
+package magick;
+
+/**
+ * A token that cancels the ImageMagick operations it is installed
+ * for, either on request or once a deadline has passed. It is checked
+ * natively each time an operation reports progress, without calling
+ * into Java, so it is cheap enough to install on every operation.
+ *
+ * @see MagickImage#setProgressMonitor
+ * @see ImageInfo#setProgressMonitor
+ */
+public class CancelToken extends Magick implements AutoCloseable {
+
+    /**
+     * Internal handle of the native token.
+     */
+    private long cancelTokenHandle = 0;
+
+    {
+	registerCleaner(NativeCleaner.CANCEL_TOKEN);
+    }
+
+    /**
+     * Constructor for a token without a deadline.
+     *
+     * @throws MagickException if memory could not be allocated
+     */
+    public CancelToken()
+	throws MagickException
+    {
+	init(0);
+    }
+
+    /**
+     * Constructor for a token that cancels once a timeout expires.
+     *
+     * @param timeoutMillis the time after which operations are
+     *        cancelled, in milliseconds from now
+     * @throws MagickException if memory could not be allocated
+     */
+    public CancelToken(long timeoutMillis)
+	throws MagickException
+    {
+	if (timeoutMillis <= 0) {
+	    throw new MagickException("Timeout must be positive");
+	}
+	init(timeoutMillis);
+    }
+
+    /**
+     * Release the native memory of the token now rather than when
+     * it is garbage-collected. The object must not be used
+     * afterwards. Calling this method more than once has no effect.
+     * A token must not be closed while it is installed on an image
+     * or ImageInfo; while installed, it is kept reachable by them.
+     */
+    public void close()
+    {
+	destroyCancelToken();
+	cleanable.clean();
+    }
+
+    /**
+     * Allocate the native token.
+     *
+     * @param timeoutMillis the timeout in milliseconds, 0 for none
+     * @throws MagickException if memory could not be allocated
+     */
+    private native void init(long timeoutMillis)
+	throws MagickException;
+
+    /**
+     * Cancel the operations the token is installed for. They stop
+     * the next time they report progress.
+     */
+    public native void cancel();
+
+    /**
+     * Return whether the token was cancelled or its deadline has
+     * passed.
+     *
+     * @return true if operations are cancelled
+     */
+    public native boolean isCancelled();
+
+    /**
+     * Deallocate the native token.
+     */
+    private native void destroyCancelToken();
+}
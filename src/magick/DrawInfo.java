@@ -9,13 +9,17 @@ package magick;
  *
  * @author Eric Yeo
  */
-public class DrawInfo extends Magick {
+public class DrawInfo extends Magick implements AutoCloseable {
 
     /**
      * DrawInfo handle.
      */
     private long drawInfoHandle = 0;
 
+    {
+	registerCleaner(NativeCleaner.DRAW_INFO);
+    }
+
     /**
      * Constructor. Create a DrawInfo structure from defaults in
      * the ImageInfo structure.
@@ -42,12 +46,14 @@ public class DrawInfo extends Magick {
 	throws MagickException;
 
     /**
-     * If the garbabe collector removes us, we had better release
-     * the memory we occupy.
+     * Release the native memory of the DrawInfo now rather than when
+     * it is garbage-collected. The object must not be used
+     * afterwards. Calling this method more than once has no effect.
      */
-    protected void finalize()
+    public void close()
     {
 	destroyDrawInfo();
+	cleanable.clean();
     }
 
 
@@ -0,0 +1,259 @@
+package magick;
+
+import java.util.Iterator;
+import java.util.NoSuchElementException;
+
+/**
+ * Decodes the frames of an animated or multi-page image one at a
+ * time, so that the memory used does not grow with the number of
+ * frames. Each frame is read on its own by setting the scene range of
+ * a copy of the ImageInfo, which reopens the file; only that frame is
+ * kept.
+ *
+ * The cost of reaching a frame depends on the coder. Formats without
+ * a frame index, such as GIF, decode every frame before the one asked
+ * for, so iterating over n frames decodes about n*n/2 frames: the
+ * iterator trades time for memory. Coders that ignore the scene range
+ * decode the whole image at once; the iterator then keeps the frames
+ * after the current one and hands them out without decoding again,
+ * so memory is no longer bounded (see isBuffered()).
+ *
+ * A frame returned by next() is owned by the iterator and is closed
+ * by the following call to next() or by close(), so its memory is
+ * freed as soon as the consumer moves on. A frame that must outlive
+ * the iteration should be cloned.
+ *
+ * When coalescing, each frame is composed over the canvas left by
+ * the previous frames according to their disposal method, as
+ * MagickImage.coalesceImages does, so every frame returned is a full
+ * canvas. Only the canvas is kept between frames.
+ *
+ * <pre>
+ * try (FrameIterator frames = MagickImage.frames(info, true)) {
+ *     for (MagickImage frame : frames) {
+ *         ...
+ *     }
+ * }
+ * </pre>
+ *
+ * @see MagickImage#frames(ImageInfo, boolean)
+ */
+public class FrameIterator
+    implements Iterator<MagickImage>, Iterable<MagickImage>, AutoCloseable {
+
+    private final ImageInfo imageInfo;
+    private final boolean coalesce;
+    private final int frameCount;
+    private int index = 0;
+
+    /**
+     * The frame last returned, closed on the next call.
+     */
+    private MagickImage current = null;
+
+    /**
+     * The canvas the next frame is composed over when coalescing.
+     */
+    private MagickImage canvas = null;
+
+    /**
+     * The frames after the current one, when the coder decoded them
+     * along with it.
+     */
+    private MagickImage buffered = null;
+    private boolean wasBuffered = false;
+
+    /**
+     * Constructor. Pings the image to count its frames.
+     *
+     * @param imageInfo specifies the image to read
+     * @param coalesce whether to return full canvases
+     * @throws MagickException if the image cannot be pinged
+     */
+    FrameIterator(ImageInfo imageInfo, boolean coalesce)
+	throws MagickException
+    {
+	this.imageInfo = imageInfo;
+	this.coalesce = coalesce;
+	this.frameCount = countFrames(imageInfo);
+    }
+
+    /**
+     * Return the number of frames of the image.
+     *
+     * @return the number of frames
+     */
+    public int getFrameCount()
+    {
+	return frameCount;
+    }
+
+    /**
+     * Return the index of the frame the next call to next() returns.
+     *
+     * @return the index of the next frame, from 0
+     */
+    public int getIndex()
+    {
+	return index;
+    }
+
+    /**
+     * Return whether the coder decoded all the frames at once, so
+     * that the remaining frames are held in memory rather than
+     * decoded one at a time.
+     *
+     * @return true if frames have been buffered
+     */
+    public boolean isBuffered()
+    {
+	return wasBuffered;
+    }
+
+    public Iterator<MagickImage> iterator()
+    {
+	return this;
+    }
+
+    public boolean hasNext()
+    {
+	return index < frameCount;
+    }
+
+    /**
+     * Same as nextFrame(), for use in a for-each loop.
+     *
+     * @return the next frame
+     * @throws NoSuchElementException if there are no more frames
+     * @throws IllegalStateException if the frame cannot be read, with
+     *         the MagickException as its cause
+     */
+    public MagickImage next()
+    {
+	if (!hasNext()) {
+	    throw new NoSuchElementException();
+	}
+	try {
+	    return nextFrame();
+	}
+	catch (MagickException e) {
+	    throw new IllegalStateException("Unable to read frame " + index, e);
+	}
+    }
+
+    /**
+     * Decode the next frame, closing the previous one.
+     *
+     * @return the next frame, valid until the next call or close()
+     * @throws MagickException if the frame cannot be read or there
+     *         are no more frames
+     */
+    public MagickImage nextFrame()
+	throws MagickException
+    {
+	if (!hasNext()) {
+	    throw new MagickException("No more frames");
+	}
+	if (current != null) {
+	    current.close();
+	    current = null;
+	}
+	MagickImage frame = buffered;
+	if (frame == null) {
+	    frame = readFrame(imageInfo, index);
+	    wasBuffered |= frame.hasFrames();
+	}
+	buffered = frame.hasFrames() ? frame.nextImage() : null;
+	if (coalesce) {
+	    MagickImage raw = frame;
+	    try {
+		if (canvas == null) {
+		    canvas = newCanvas(raw);
+		}
+		frame = composeFrame(canvas, raw, index == 0);
+		MagickImage disposed;
+		try {
+		    disposed = disposeFrame(frame, raw);
+		}
+		catch (MagickException e) {
+		    frame.close();
+		    throw e;
+		}
+		if (disposed != null) {
+		    canvas.close();
+		    canvas = disposed;
+		}
+	    }
+	    finally {
+		raw.close();
+	    }
+	}
+	index++;
+	current = frame;
+	return frame;
+    }
+
+    public void remove()
+    {
+	throw new UnsupportedOperationException();
+    }
+
+    /**
+     * Free the frame last returned, the canvas and any buffered
+     * frames. Calling this method more than once has no effect.
+     */
+    public void close()
+    {
+	if (current != null) {
+	    current.close();
+	    current = null;
+	}
+	if (buffered != null) {
+	    buffered.close();
+	    buffered = null;
+	}
+	if (canvas != null) {
+	    canvas.close();
+	    canvas = null;
+	}
+	index = frameCount;
+    }
+
+    /**
+     * Ping the image and count its frames.
+     */
+    private static native int countFrames(ImageInfo imageInfo)
+	throws MagickException;
+
+    /**
+     * Decode a single frame, followed by the frames after it if the
+     * coder decoded them too.
+     */
+    private static native MagickImage readFrame(ImageInfo imageInfo,
+						int scene)
+	throws MagickException;
+
+    /**
+     * Create the empty canvas of the first frame, of the size of its
+     * page.
+     */
+    private static native MagickImage newCanvas(MagickImage frame)
+	throws MagickException;
+
+    /**
+     * Compose a frame over a copy of the canvas.
+     */
+    private static native MagickImage composeFrame(MagickImage canvas,
+						   MagickImage frame,
+						   boolean first)
+	throws MagickException;
+
+    /**
+     * Return the canvas of the frame after a frame, composed as
+     * coalesced, according to the disposal method of the frame, or
+     * null if the current canvas is kept.
+     */
+    private static native MagickImage disposeFrame(MagickImage coalesced,
+						   MagickImage frame)
+	throws MagickException;
+}
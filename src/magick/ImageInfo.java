@@ -5,7 +5,7 @@ package magick;
  *
  * @author Eric Yeo
  */
-public class ImageInfo extends Magick {
+public class ImageInfo extends Magick implements AutoCloseable {
 
     /**
      * Internal ImageMagick ImageInfo handle.
@@ -13,6 +13,16 @@ public class ImageInfo extends Magick {
      */
     private long imageInfoHandle = 0;
 
+    /**
+     * Internal handle of the progress monitor installed on the
+     * ImageInfo.
+     */
+    private long progressMonitorHandle = 0;
+
+    {
+	registerCleaner(NativeCleaner.IMAGE_INFO);
+    }
+
     /**
      * Constructor.
      * @throws MagickException if an error occurs
@@ -37,11 +47,15 @@ public class ImageInfo extends Magick {
     }
 
     /**
-     * To release memory on cleanup.
+     * Release the native memory of the ImageInfo now rather than when
+     * it is garbage-collected. The object must not be used
+     * afterwards. Calling this method more than once has no effect.
+     * The progress monitor installed on it, if any, is released too.
      */
-    protected void finalize()
+    public void close()
     {
 	destroyImageInfo();
+	cleanable.clean();
     }
 
     /**
@@ -547,6 +561,23 @@ public class ImageInfo extends Magick {
      */
     private native void destroyImageInfo();
 
+    /**
+     * Install a progress monitor and a cancel token for reads through
+     * this ImageInfo. Reads report their progress to the monitor and
+     * stop once the token is cancelled or expires. Either argument
+     * may be null, and passing both null removes the monitor. The
+     * images read do not keep the monitor. The monitor is held until
+     * it is removed or the ImageInfo is closed; see ProgressMonitor.
+     *
+     * @param monitor receives the progress of reads, or null
+     * @param token cancels the reads, or null
+     * @see <a href="http://www.imagemagick.org/api/monitor.php#SetImageInfoProgressMonitor">The underlying ImageMagick call</a>
+     * @throws MagickException if the ImageInfo is not initialised
+     */
+    public native void setProgressMonitor(ProgressMonitor monitor,
+					  CancelToken token)
+	throws MagickException;
+
 		/**
 		 * Set the magick attribute of the handle.
 		 *
@@ -0,0 +1,144 @@
+package magick;
+
+/**
+ * The metadata of a batch of images pinged by Magick.probe. The
+ * values are held as one array per attribute, indexed like the
+ * sources given to probe. An image that could not be pinged has a
+ * width and height of 0, a null format and an error message.
+ *
+ * @see Magick#probe(String[])
+ */
+public class ImageProbe {
+
+    int[] width;
+    int[] height;
+    int[] frames;
+    int[] orientation;
+    int[] colorspace;
+    int[] depth;
+    boolean[] alpha;
+    String[] format;
+    String[] error;
+
+    /**
+     * Constructor.
+     *
+     * @param count the number of images probed
+     */
+    ImageProbe(int count)
+    {
+	width = new int[count];
+	height = new int[count];
+	frames = new int[count];
+	orientation = new int[count];
+	colorspace = new int[count];
+	depth = new int[count];
+	alpha = new boolean[count];
+	format = new String[count];
+	error = new String[count];
+    }
+
+    /**
+     * Return the number of images probed.
+     *
+     * @return the number of images probed
+     */
+    public int size()
+    {
+	return width.length;
+    }
+
+    /**
+     * Return the widths of the images.
+     *
+     * @return the widths of the images, in pixels
+     */
+    public int[] getWidths()
+    {
+	return width;
+    }
+
+    /**
+     * Return the heights of the images.
+     *
+     * @return the heights of the images, in pixels
+     */
+    public int[] getHeights()
+    {
+	return height;
+    }
+
+    /**
+     * Return the number of frames of the images.
+     *
+     * @return the number of frames of the images
+     */
+    public int[] getFrames()
+    {
+	return frames;
+    }
+
+    /**
+     * Return the orientations of the images.
+     *
+     * @return the orientations of the images, as ImageMagick
+     *         OrientationType values
+     */
+    public int[] getOrientations()
+    {
+	return orientation;
+    }
+
+    /**
+     * Return the colorspaces of the images.
+     *
+     * @return the colorspaces of the images
+     * @see ColorspaceType
+     */
+    public int[] getColorspaces()
+    {
+	return colorspace;
+    }
+
+    /**
+     * Return the depths of the images.
+     *
+     * @return the depths of the images, in bits per component
+     */
+    public int[] getDepths()
+    {
+	return depth;
+    }
+
+    /**
+     * Return whether the images have an alpha channel.
+     *
+     * @return true for each image with an alpha channel
+     */
+    public boolean[] getAlpha()
+    {
+	return alpha;
+    }
+
+    /**
+     * Return the formats of the images.
+     *
+     * @return the ImageMagick format names of the images, for
+     *         example "JPEG"
+     */
+    public String[] getFormats()
+    {
+	return format;
+    }
+
+    /**
+     * Return the error messages for the images that could not be
+     * pinged.
+     *
+     * @return the error message for each image, null on success
+     */
+    public String[] getErrors()
+    {
+	return error;
+    }
+}
@@ -2,6 +2,11 @@ package magick;
 
 
 import java.awt.Rectangle;
+import java.lang.management.ManagementFactory;
+import java.nio.ByteBuffer;
+import javax.management.JMException;
+import javax.management.MBeanServer;
+import javax.management.ObjectName;
 
 
 /**
@@ -44,11 +49,226 @@ public class Magick {
     }
 
 
+    /**
+     * Reference through which the native memory of this object is
+     * released if it is garbage-collected without being closed, or
+     * null for objects that hold no native memory.
+     */
+    NativeCleaner.Ref cleanable;
+
     /**
      * Initializes the ImageMagic system
      */
     private static native void init();
 
+    /**
+     * Start tracking this object so that its native memory is
+     * released once it is garbage-collected. Called by the
+     * instance initializers of the subclasses.
+     *
+     * @param kind the kind of native memory, from NativeCleaner
+     */
+    final void registerCleaner(int kind)
+    {
+        cleanable = NativeCleaner.register(this, kind);
+    }
+
+    /**
+     * Release native memory on behalf of the cleaner.
+     *
+     * @param kind the kind of native memory, from NativeCleaner
+     * @param handle the main handle, 0 for none
+     * @param progressHandle the progress monitor handle, 0 for none
+     * @param bytes the pixel bytes accounted for the handle
+     */
+    static native void destroyHandles(int kind, long handle,
+                                      long progressHandle, long bytes);
+
+    /**
+     * Enables or disables leak detection. When enabled, every object
+     * that is garbage-collected without having been closed is
+     * reported on standard error with the stack trace of its
+     * allocation. Recording the allocation sites is costly, so leak
+     * detection is meant for debugging; it can also be enabled with
+     * the system property jmagick.leakdetection=yes. Only objects
+     * created while it is enabled carry an allocation site.
+     *
+     * @param enabled whether to report leaked objects
+     */
+    public static void setLeakDetection(boolean enabled)
+    {
+        NativeCleaner.setLeakDetection(enabled);
+    }
+
+    /**
+     * Returns whether leak detection is enabled.
+     *
+     * @return true if leaked objects are reported
+     * @see #setLeakDetection(boolean)
+     */
+    public static boolean isLeakDetection()
+    {
+        return NativeCleaner.isLeakDetection();
+    }
+
+    /**
+     * Returns the number of objects that were garbage-collected
+     * without having been closed, whether or not leak detection is
+     * enabled. Their memory has been released by the cleaner.
+     *
+     * @return the number of leaked objects so far
+     */
+    public static long getLeakCount()
+    {
+        return NativeCleaner.getLeakCount();
+    }
+
+    /**
+     * Sets the limit of an ImageMagick resource for the whole
+     * process. When an image needs more memory than the memory and
+     * map limits allow, ImageMagick moves its pixel cache to disk;
+     * setting the disk limit to 0 prevents that, making such images
+     * fail instead. ImageMagick does not let a limit be raised above
+     * one set by its security policy.
+     *
+     * @param type the resource, one of ResourceType
+     * @param limit the limit, in the unit of the resource;
+     *        Long.MAX_VALUE for no limit
+     * @throws MagickException if the resource is unknown, not
+     *         supported by this version of ImageMagick, or the limit
+     *         was refused
+     * @see ResourceType
+     */
+    public static native void setResourceLimit(int type, long limit)
+        throws MagickException;
+
+    /**
+     * Returns the limit of an ImageMagick resource.
+     *
+     * @param type the resource, one of ResourceType
+     * @return the limit, Long.MAX_VALUE if there is none
+     * @throws MagickException if the resource is unknown or not
+     *         supported by this version of ImageMagick
+     */
+    public static native long getResourceLimit(int type)
+        throws MagickException;
+
+    /**
+     * Returns how much of an ImageMagick resource is in use.
+     *
+     * @param type the resource, one of ResourceType
+     * @return the amount in use, in the unit of the resource
+     * @throws MagickException if the resource is unknown or not
+     *         supported by this version of ImageMagick
+     */
+    public static native long getResource(int type)
+        throws MagickException;
+
+    /**
+     * Sets the limit of an ImageMagick resource until the returned
+     * override is closed, when the previous limit is restored.
+     * The limit applies to the whole process; see
+     * ResourceLimitOverride for how overrides may be combined.
+     *
+     * @param type the resource, one of ResourceType
+     * @param limit the limit, Long.MAX_VALUE for no limit
+     * @return the override to close once the limit no longer applies
+     * @throws MagickException if the limit could not be set
+     */
+    public static ResourceLimitOverride overrideResourceLimit(int type,
+                                                              long limit)
+        throws MagickException
+    {
+        return new ResourceLimitOverride(type, limit);
+    }
+
+    /**
+     * Sets the number of threads ImageMagick may use for each
+     * operation, for the whole process. ImageMagick runs operations
+     * such as resize, blur and convolve on a team of threads, by
+     * default one per processor; when several Java threads run
+     * operations at the same time, a budget of about the number of
+     * processors divided by the number of Java threads avoids
+     * oversubscribing the processors. The budget is the limit of
+     * ResourceType.ThreadResource, from which ImageMagick sizes each
+     * team; it cannot be set per Java thread.
+     *
+     * @param threads the number of threads, at least 1
+     * @throws MagickException if threads is less than 1 or the limit
+     *         was refused
+     * @see MagickExecutor#MagickExecutor(int, int, int)
+     */
+    public static void setThreadBudget(int threads)
+        throws MagickException
+    {
+        if (threads < 1) {
+            throw new MagickException("Thread budget must be positive");
+        }
+        setResourceLimit(ResourceType.ThreadResource, threads);
+    }
+
+    /**
+     * Returns the number of threads ImageMagick may use for each
+     * operation.
+     *
+     * @return the thread budget
+     * @throws MagickException if the limit cannot be read
+     * @see #setThreadBudget(int)
+     */
+    public static int getThreadBudget()
+        throws MagickException
+    {
+        return (int) Math.min(Integer.MAX_VALUE,
+                              getResourceLimit(ResourceType.ThreadResource));
+    }
+
+    /**
+     * Object name of the MBean registered by registerNativeStatsMBean.
+     */
+    public static final String NATIVE_STATS_MBEAN_NAME =
+        "magick:type=NativeStats";
+
+    /**
+     * Returns a snapshot of the native memory held by JMagick and of
+     * the ImageMagick resource counters.
+     *
+     * @return the native memory statistics
+     */
+    public static NativeStats getNativeStats()
+    {
+        return new NativeStats(nativeStats(), getLeakCount());
+    }
+
+    /**
+     * Registers an MBean exposing getNativeStats() with the platform
+     * MBean server, under NATIVE_STATS_MBEAN_NAME. Registering it
+     * again has no effect.
+     *
+     * @throws MagickException if the MBean could not be registered
+     */
+    public static synchronized void registerNativeStatsMBean()
+        throws MagickException
+    {
+        try {
+            MBeanServer server = ManagementFactory.getPlatformMBeanServer();
+            ObjectName name = new ObjectName(NATIVE_STATS_MBEAN_NAME);
+            if (!server.isRegistered(name)) {
+                server.registerMBean(new NativeStats.Live(), name);
+            }
+        }
+        catch (JMException e) {
+            throw new MagickException("Unable to register MBean: "
+                                      + e.getMessage());
+        }
+    }
+
+    /**
+     * Returns the native memory counters, indexed as in NativeStats.
+     *
+     * @return the counters
+     */
+    private static native long[] nativeStats();
+
 
     /**
      * Parses a geometry specification and returns the
@@ -74,4 +294,219 @@ public class Magick {
      * @return array of font names.
      */
     public static native String[] queryFonts(String pattern);
+
+    /**
+     * Returns the quantum depth ImageMagick was built with, the
+     * number of bits of a pixel component in memory (8, 16, 32 or 64).
+     *
+     * @return the quantum depth
+     */
+    public static native int getQuantumDepth();
+
+    /**
+     * Returns whether ImageMagick was built with HDRI, in which case
+     * pixel components are held as floating point values.
+     *
+     * @return true if ImageMagick uses HDRI
+     */
+    public static native boolean isHDRI();
+
+    /**
+     * Returns the size in bytes of a pixel component in memory,
+     * the size of the ImageMagick Quantum type.
+     *
+     * @return the size of a Quantum
+     */
+    static native int getQuantumSize();
+
+    /**
+     * Pings a batch of image files and returns their metadata.
+     * The whole batch is pinged in a single native call.
+     *
+     * @param paths the file names of the images
+     * @return the metadata of the images, indexed like paths
+     * @throws MagickException if memory could not be allocated
+     */
+    public static ImageProbe probe(String[] paths)
+        throws MagickException
+    {
+        return probe(paths, 1);
+    }
+
+    /**
+     * Pings a batch of image files and returns their metadata,
+     * splitting the batch over a number of threads.
+     *
+     * @param paths the file names of the images
+     * @param threads the number of threads to ping with
+     * @return the metadata of the images, indexed like paths
+     * @throws MagickException if memory could not be allocated
+     */
+    public static ImageProbe probe(String[] paths, int threads)
+        throws MagickException
+    {
+        return probeAll(paths, false, threads);
+    }
+
+    /**
+     * Pings a batch of in-memory images and returns their metadata.
+     * Each image is read from the position to the limit of its
+     * buffer. Direct buffers are pinged in place; the contents of
+     * heap buffers are copied.
+     *
+     * @param blobs the encoded images
+     * @return the metadata of the images, indexed like blobs
+     * @throws MagickException if memory could not be allocated
+     */
+    public static ImageProbe probe(ByteBuffer[] blobs)
+        throws MagickException
+    {
+        return probe(blobs, 1);
+    }
+
+    /**
+     * Pings a batch of in-memory images and returns their metadata,
+     * splitting the batch over a number of threads.
+     *
+     * @param blobs the encoded images
+     * @param threads the number of threads to ping with
+     * @return the metadata of the images, indexed like blobs
+     * @throws MagickException if memory could not be allocated
+     * @see #probe(ByteBuffer[])
+     */
+    public static ImageProbe probe(ByteBuffer[] blobs, int threads)
+        throws MagickException
+    {
+        ByteBuffer[] direct = new ByteBuffer[blobs.length];
+        for (int i = 0; i < blobs.length; i++) {
+            ByteBuffer blob = blobs[i];
+            if (blob == null) {
+                direct[i] = null;
+            }
+            else if (blob.isDirect()) {
+                direct[i] = blob.slice();
+            }
+            else {
+                direct[i] = ByteBuffer.allocateDirect(blob.remaining());
+                direct[i].put(blob.duplicate()).flip();
+            }
+        }
+        return probeAll(direct, true, threads);
+    }
+
+    /**
+     * Helper for probe to ping the sources, in slices on separate
+     * threads if more than one thread is asked for. An exception
+     * thrown on a worker thread is rethrown on the calling thread
+     * once all the workers have finished.
+     *
+     * @param sources file names or direct buffers
+     * @param isBlob true if sources are direct buffers
+     * @param threads the number of threads to ping with
+     * @return the metadata of the images
+     * @throws MagickException if memory could not be allocated
+     */
+    private static ImageProbe probeAll(final Object[] sources,
+                                       final boolean isBlob, int threads)
+        throws MagickException
+    {
+        final ImageProbe result = new ImageProbe(sources.length);
+        if (threads > sources.length) {
+            threads = sources.length;
+        }
+        if (threads <= 1) {
+            probeSlice(sources, isBlob, 0, sources.length, result);
+            return result;
+        }
+
+        Thread[] workers = new Thread[threads];
+        final Throwable[] failures = new Throwable[threads];
+        int slice = (sources.length + threads - 1) / threads;
+        for (int i = 0; i < threads; i++) {
+            final int index = i;
+            final int offset = i * slice;
+            final int count = Math.min(slice, sources.length - offset);
+            workers[i] = new Thread("magick-probe-" + i) {
+                public void run() {
+                    try {
+                        probeSlice(sources, isBlob, offset, count, result);
+                    }
+                    catch (Throwable t) {
+                        failures[index] = t;
+                    }
+                }
+            };
+            workers[i].start();
+        }
+        boolean interrupted = false;
+        for (int i = 0; i < threads; i++) {
+            while (true) {
+                try {
+                    workers[i].join();
+                    break;
+                }
+                catch (InterruptedException e) {
+                    interrupted = true;
+                }
+            }
+        }
+        if (interrupted) {
+            Thread.currentThread().interrupt();
+        }
+
+        Throwable failure = null;
+        for (int i = 0; i < threads; i++) {
+            if (failures[i] == null) {
+                continue;
+            }
+            if (failure == null) {
+                failure = failures[i];
+            }
+            else {
+                failure.addSuppressed(failures[i]);
+            }
+        }
+        if (failure instanceof MagickException) {
+            throw (MagickException) failure;
+        }
+        if (failure instanceof RuntimeException) {
+            throw (RuntimeException) failure;
+        }
+        if (failure instanceof Error) {
+            throw (Error) failure;
+        }
+        return result;
+    }
+
+    /**
+     * Helper for probe to ping a slice of the sources into the
+     * arrays of the result.
+     */
+    private static void probeSlice(Object[] sources, boolean isBlob,
+                                   int offset, int count,
+                                   ImageProbe result)
+        throws MagickException
+    {
+        probeImages(sources, isBlob, offset, count,
+                    result.width, result.height, result.frames,
+                    result.orientation, result.colorspace, result.depth,
+                    result.alpha, result.format, result.error);
+    }
+
+    /**
+     * Pings sources[offset] to sources[offset + count - 1] and
+     * stores their metadata at the same indices of the arrays.
+     */
+    private static native void probeImages(Object[] sources,
+                                           boolean isBlob,
+                                           int offset, int count,
+                                           int[] width, int[] height,
+                                           int[] frames,
+                                           int[] orientation,
+                                           int[] colorspace,
+                                           int[] depth,
+                                           boolean[] alpha,
+                                           String[] format,
+                                           String[] error)
+        throws MagickException;
 }
@@ -0,0 +1,100 @@
+package magick;
+
+import java.nio.ByteBuffer;
+
+/**
+ * An encoded image held in memory allocated by ImageMagick. The
+ * bytes are exposed as a direct ByteBuffer so they can be written
+ * to a channel without first being copied onto the Java heap. The
+ * memory must be given back with release() once the bytes have
+ * been consumed. Otherwise it is released by the cleaner once the
+ * buffer, and every duplicate or slice of it, is unreachable: the
+ * buffer stays valid even if the MagickBlob itself is dropped.
+ *
+ * @see MagickImage#imageToNativeBlob
+ * @see MagickImage#imagesToNativeBlob
+ */
+public class MagickBlob extends Magick implements AutoCloseable {
+
+    /**
+     * Direct buffer over the ImageMagick blob memory, or null
+     * once released.
+     */
+    private ByteBuffer buffer;
+
+    /**
+     * Constructor. Only called with buffers created by the native
+     * library over ImageMagick memory.
+     *
+     * @param buffer direct buffer over the blob memory
+     */
+    MagickBlob(ByteBuffer buffer)
+    {
+	this.buffer = buffer;
+	cleanable = NativeCleaner.register(buffer, MagickBlob.class,
+					   NativeCleaner.BLOB);
+	cleanable.handle = getBlobAddress(buffer);
+    }
+
+    /**
+     * Return the buffer over the encoded image. The buffer must not
+     * be used after release() has been called.
+     *
+     * @return a direct buffer over the encoded image
+     * @throws MagickException if the blob has been released
+     */
+    public synchronized ByteBuffer getBuffer()
+	throws MagickException
+    {
+	if (buffer == null) {
+	    throw new MagickException("Blob has been released");
+	}
+	return buffer;
+    }
+
+    /**
+     * Return the length of the encoded image.
+     *
+     * @return the number of bytes in the blob, 0 if released
+     */
+    public synchronized int getLength()
+    {
+	return buffer == null ? 0 : buffer.capacity();
+    }
+
+    /**
+     * Give the blob memory back to ImageMagick. Calling this method
+     * more than once has no effect.
+     */
+    public synchronized void release()
+    {
+	if (buffer != null) {
+	    buffer = null;
+	    cleanable.clean();
+	}
+    }
+
+    /**
+     * Same as release(), so that blobs can be used in a
+     * try-with-resources statement.
+     */
+    public void close()
+    {
+	release();
+    }
+
+    /**
+     * Return the address of the ImageMagick memory behind a buffer.
+     *
+     * @param buffer direct buffer created by the native library
+     * @return the address of the blob memory
+     */
+    private static native long getBlobAddress(ByteBuffer buffer);
+
+    /**
+     * Free the ImageMagick memory of a blob.
+     *
+     * @param address the address returned by getBlobAddress
+     */
+    static native void relinquishBlob(long address);
+}
@@ -0,0 +1,271 @@
+package magick;
+
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.Callable;
+import java.util.concurrent.CompletableFuture;
+import java.util.concurrent.RejectedExecutionException;
+import java.util.concurrent.ThreadFactory;
+import java.util.concurrent.ThreadPoolExecutor;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicInteger;
+
+/**
+ * A pool of worker threads running ImageMagick operations, so that
+ * the calling threads do not block on them. Each operation returns a
+ * CompletableFuture completed by the worker. The number of workers
+ * bounds the number of concurrent operations, and the queue of
+ * pending operations is bounded; an operation submitted to a full
+ * queue completes exceptionally with a RejectedExecutionException.
+ *
+ * The workers only call into the native library, so an image or
+ * ImageInfo must not be used by another thread while an operation
+ * on it is pending.
+ *
+ * A pool does not change the ImageMagick thread budget unless it is
+ * created with threadsPerOperation. The budget is process-wide: it
+ * also applies to operations run outside the pool, and the last
+ * value set wins.
+ *
+ * @see MagickImage#readAsync(ImageInfo)
+ */
+public class MagickExecutor {
+
+    /**
+     * The pool used by the async methods of MagickImage.
+     */
+    private static MagickExecutor defaultExecutor = null;
+
+    /**
+     * Number of pools created, to name their threads.
+     */
+    private static final AtomicInteger poolCount = new AtomicInteger();
+
+    /**
+     * The underlying Java pool.
+     */
+    private final ThreadPoolExecutor pool;
+
+    /**
+     * Constructor. The thread budget is left as it is.
+     *
+     * @param threads the number of operations run at the same time
+     * @param queueCapacity the number of operations that may wait
+     *        for a worker
+     * @throws IllegalArgumentException if threads or queueCapacity is
+     *         less than 1
+     */
+    public MagickExecutor(int threads, int queueCapacity)
+    {
+	checkPoolSize(threads, queueCapacity);
+	pool = createPool(threads, queueCapacity);
+    }
+
+    /**
+     * Constructor that also sets the process-wide thread budget, so
+     * that the workers and the thread teams of their operations share
+     * the processors rather than each worker using all of them. A
+     * budget of the number of processors divided by threads divides
+     * them evenly.
+     *
+     * @param threads the number of operations run at the same time
+     * @param queueCapacity the number of operations that may wait
+     *        for a worker
+     * @param threadsPerOperation the threads each operation may use,
+     *        set as the process-wide thread budget
+     * @throws IllegalArgumentException if an argument is less than 1
+     *         or ImageMagick refused the budget
+     * @see Magick#setThreadBudget(int)
+     */
+    public MagickExecutor(int threads, int queueCapacity,
+			  int threadsPerOperation)
+    {
+	checkPoolSize(threads, queueCapacity);
+	if (threadsPerOperation < 1) {
+	    throw new IllegalArgumentException("Invalid threads per operation "
+					       + threadsPerOperation);
+	}
+	try {
+	    Magick.setThreadBudget(threadsPerOperation);
+	}
+	catch (MagickException e) {
+	    throw new IllegalArgumentException(e.getMessage());
+	}
+	pool = createPool(threads, queueCapacity);
+    }
+
+    /**
+     * Check the size of a pool before anything is changed.
+     *
+     * @param threads the number of workers
+     * @param queueCapacity the capacity of the queue
+     */
+    private static void checkPoolSize(int threads, int queueCapacity)
+    {
+	if (threads < 1) {
+	    throw new IllegalArgumentException("Invalid number of threads "
+					       + threads);
+	}
+	if (queueCapacity < 1) {
+	    throw new IllegalArgumentException("Invalid queue capacity "
+					       + queueCapacity);
+	}
+    }
+
+    /**
+     * Create the Java pool, with daemon workers.
+     *
+     * @param threads the number of workers
+     * @param queueCapacity the capacity of the queue
+     * @return the pool
+     */
+    private static ThreadPoolExecutor createPool(int threads,
+						 int queueCapacity)
+    {
+	final String prefix = "magick-" + poolCount.incrementAndGet() + "-";
+	ThreadFactory factory = new ThreadFactory() {
+	    private final AtomicInteger count = new AtomicInteger();
+
+	    public Thread newThread(Runnable r) {
+		Thread t = new Thread(r, prefix + count.incrementAndGet());
+		t.setDaemon(true);
+		return t;
+	    }
+	};
+	return new ThreadPoolExecutor(threads, threads,
+				      0L, TimeUnit.MILLISECONDS,
+				      new ArrayBlockingQueue<Runnable>(queueCapacity),
+				      factory);
+    }
+
+    /**
+     * Return the pool used by the async methods of MagickImage. It
+     * is created on first use with one worker per processor, and
+     * leaves the thread budget as it is; call Magick.setThreadBudget,
+     * or install a pool created with threadsPerOperation, to keep its
+     * workers from oversubscribing the processors.
+     *
+     * @return the default pool
+     */
+    public static synchronized MagickExecutor getDefault()
+    {
+	if (defaultExecutor == null) {
+	    int threads = Runtime.getRuntime().availableProcessors();
+	    defaultExecutor = new MagickExecutor(threads, 1024 * threads);
+	}
+	return defaultExecutor;
+    }
+
+    /**
+     * Replace the pool used by the async methods of MagickImage. The
+     * previous pool is not shut down.
+     *
+     * @param executor the new default pool
+     */
+    public static synchronized void setDefault(MagickExecutor executor)
+    {
+	defaultExecutor = executor;
+    }
+
+    /**
+     * Run an operation on a worker.
+     *
+     * @param task the operation to run
+     * @return a future completed with the result of the operation
+     */
+    public <T> CompletableFuture<T> submit(final Callable<T> task)
+    {
+	final CompletableFuture<T> future = new CompletableFuture<T>();
+	try {
+	    pool.execute(new Runnable() {
+		public void run() {
+		    if (future.isDone()) {
+			return;
+		    }
+		    try {
+			future.complete(task.call());
+		    }
+		    catch (Throwable e) {
+			future.completeExceptionally(e);
+		    }
+		}
+	    });
+	}
+	catch (RejectedExecutionException e) {
+	    future.completeExceptionally(e);
+	}
+	return future;
+    }
+
+    /**
+     * Read an image on a worker.
+     *
+     * @param imageInfo specifies the file to read from
+     * @return a future completed with the image
+     */
+    public CompletableFuture<MagickImage> read(final ImageInfo imageInfo)
+    {
+	return submit(new Callable<MagickImage>() {
+	    public MagickImage call() throws MagickException {
+		return new MagickImage(imageInfo);
+	    }
+	});
+    }
+
+    /**
+     * Resize an image on a worker.
+     *
+     * @param image the image to resize
+     * @param cols the width of the resized image
+     * @param rows the height of the resized image
+     * @return a future completed with the resized image
+     */
+    public CompletableFuture<MagickImage> resize(final MagickImage image,
+						 final int cols,
+						 final int rows)
+    {
+	return submit(new Callable<MagickImage>() {
+	    public MagickImage call() throws MagickException {
+		return image.resizeImage(cols, rows, 1.0);
+	    }
+	});
+    }
+
+    /**
+     * Encode an image to a blob on a worker.
+     *
+     * @param image the image to encode
+     * @param imageInfo specifies the encoding parameters
+     * @return a future completed with the encoded image
+     */
+    public CompletableFuture<byte[]> toBlob(final MagickImage image,
+					    final ImageInfo imageInfo)
+    {
+	return submit(new Callable<byte[]>() {
+	    public byte[] call() throws MagickException {
+		byte[] blob = image.imageToBlob(imageInfo);
+		if (blob == null) {
+		    throw new MagickException("Unable to convert image to blob");
+		}
+		return blob;
+	    }
+	});
+    }
+
+    /**
+     * Return the number of operations waiting for a worker.
+     *
+     * @return the number of queued operations
+     */
+    public int getQueuedCount()
+    {
+	return pool.getQueue().size();
+    }
+
+    /**
+     * Stop accepting operations. Pending operations still run.
+     */
+    public void shutdown()
+    {
+	pool.shutdown();
+    }
+}
@@ -2,7 +2,23 @@ package magick;
 
 
 import java.awt.Dimension;
+import java.awt.Graphics2D;
 import java.awt.Rectangle;
+import java.awt.image.BufferedImage;
+import java.awt.image.ComponentSampleModel;
+import java.awt.image.DataBuffer;
+import java.awt.image.DataBufferByte;
+import java.awt.image.DataBufferInt;
+import java.awt.image.SinglePixelPackedSampleModel;
+import java.awt.image.WritableRaster;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.channels.SelectableChannel;
+import java.nio.channels.WritableByteChannel;
+import java.util.concurrent.CompletableFuture;
 
 
 /**
@@ -12,7 +28,7 @@ import java.awt.Rectangle;
  *
  * @author Eric Yeo
  */
-public class MagickImage extends Magick {
+public class MagickImage extends Magick implements AutoCloseable {
 
     /**
      * Internal ImageMagick Image handle.
@@ -20,6 +36,15 @@ public class MagickImage extends Magick {
      */
     private long magickImageHandle = 0;
 
+    /**
+     * Internal handle of the progress monitor installed on the image.
+     */
+    private long progressMonitorHandle = 0;
+
+    {
+	registerCleaner(NativeCleaner.IMAGE);
+    }
+
     /**
      * Constructor.
      */
@@ -42,6 +67,38 @@ public class MagickImage extends Magick {
         initMultiImage(images);
     }
 
+    /**
+     * Create an image made up of the frames of the given images
+     * without copying any pixels: the frames are moved into the new
+     * image and the given images are left without frames, as if
+     * closed. Compared to the MagickImage(MagickImage[]) constructor,
+     * which clones every frame, it halves the memory needed to
+     * assemble an animation.
+     *
+     * @param images the images whose frames to take, in order
+     * @return the new image
+     * @throws MagickException if an image is null, has no frames or
+     *         appears twice; no frames are moved in that case
+     * @see #splitFrames()
+     */
+    public static MagickImage adopt(MagickImage[] images)
+        throws MagickException
+    {
+        MagickImage image = new MagickImage();
+        image.adoptImages(images);
+        return image;
+    }
+
+    /**
+     * Move the frames of the given images into this image.
+     *
+     * @param images the images whose frames to take
+     * @throws MagickException on error
+     * @see #adopt(MagickImage[])
+     */
+    private native void adoptImages(MagickImage[] images)
+        throws MagickException;
+
     /**
      * Helper for the constcutor to create an image that
      * is made up of all the images in the specified array.
@@ -115,11 +172,32 @@ public class MagickImage extends Magick {
     }
 
     /**
-     * This method will clean up the handle.
+     * Constructor that takes the image to be read from a buffer.
+     * The bytes between the position and the limit of the buffer
+     * are decoded.
+     *
+     * @param imageInfo the ImageInfo instance for default settings, etc
+     * @param blob the image to be read in memory
+     *
+     * @throws MagickException if an error occurs
+     * @see #blobToImage(ImageInfo, ByteBuffer)
+     */
+    public MagickImage(ImageInfo imageInfo, ByteBuffer blob)
+	throws MagickException
+    {
+	blobToImage(imageInfo, blob);
+    }
+
+    /**
+     * Release the native memory of the image now rather than when
+     * it is garbage-collected. The object must not be used
+     * afterwards. Calling this method more than once has no effect.
+     * The progress monitor installed on it, if any, is released too.
      */
-    protected void finalize()
+    public void close()
     {
 	destroyImages();
+	cleanable.clean();
     }
 
     /**
@@ -139,6 +217,138 @@ public class MagickImage extends Magick {
     public native void readImage(ImageInfo imageInfo)
 	throws MagickException;
 
+    /**
+     * Read an image on a worker of the default MagickExecutor.
+     *
+     * @param imageInfo specifies the file to read from
+     * @return a future completed with the image
+     * @see MagickExecutor#read
+     */
+    public static CompletableFuture<MagickImage> readAsync(ImageInfo imageInfo)
+    {
+	return MagickExecutor.getDefault().read(imageInfo);
+    }
+
+    /**
+     * Read a thumbnail of the image specified in the ImageInfo
+     * object, fitting within maxWidth x maxHeight with the aspect
+     * ratio kept. The decoder is asked to reduce the image while
+     * decoding (the JPEG coder decodes at a reduced DCT scale), and
+     * the result is finished with an exact resize. Images smaller
+     * than the bounds are not enlarged. Only the first frame is read
+     * unless the ImageInfo selects the scenes, in which case each of
+     * the selected frames is resized on its own to fit the bounds.
+     *
+     * @param imageInfo specifies the file to read from
+     * @param maxWidth the maximum width of the thumbnail
+     * @param maxHeight the maximum height of the thumbnail
+     * @throws MagickException on error
+     */
+    public void readThumbnail(ImageInfo imageInfo, int maxWidth,
+			      int maxHeight)
+	throws MagickException
+    {
+	if (maxWidth <= 0 || maxHeight <= 0) {
+	    throw new MagickException("Thumbnail size must be positive");
+	}
+	decodeThumbnail(imageInfo, maxWidth, maxHeight);
+    }
+
+    /**
+     * Helper for readThumbnail to decode and resize the image.
+     *
+     * @param imageInfo specifies the file to read from
+     * @param maxWidth the maximum width of the thumbnail
+     * @param maxHeight the maximum height of the thumbnail
+     * @throws MagickException on error
+     * @see #readThumbnail
+     */
+    private native void decodeThumbnail(ImageInfo imageInfo, int maxWidth,
+					int maxHeight)
+	throws MagickException;
+
+    /**
+     * Read an image from a stream. The bytes are pulled from the
+     * stream in chunks as the decoder asks for them, so the encoded
+     * image is never held in full on the Java heap. Unless the file
+     * name of the ImageInfo has a format prefix (for example
+     * "JPEG:"), the format is detected from the first bytes of the
+     * stream. Decoders that need to seek make ImageMagick spool the
+     * stream to a temporary file. The stream is not closed.
+     *
+     * @param imageInfo the ImageInfo for the decoding parameters
+     * @param in the stream to read the image from
+     * @throws MagickException if the image cannot be decoded
+     * @throws IOException if reading from the stream fails
+     */
+    public void readImage(ImageInfo imageInfo, InputStream in)
+	throws MagickException, IOException
+    {
+	if (in == null) {
+	    throw new MagickException("Stream is null");
+	}
+	streamToImage(imageInfo, in);
+    }
+
+    /**
+     * Helper for readImage to decode an image from a stream.
+     *
+     * @param imageInfo the ImageInfo for the decoding parameters
+     * @param in the stream to read the image from
+     * @throws MagickException if the image cannot be decoded
+     * @throws IOException if reading from the stream fails
+     * @see #readImage(ImageInfo, InputStream)
+     */
+    private native void streamToImage(ImageInfo imageInfo, InputStream in)
+	throws MagickException, IOException;
+
+    /**
+     * Decode the image specified in the ImageInfo object in stream
+     * mode. No pixel cache is built: the rows are converted as the
+     * decoder produces them and handed to the handler in bands of at
+     * most bandRows rows, so memory use does not depend on the size
+     * of the image. The map gives the components of each pixel, one
+     * byte each, from R, G, B, A and I (intensity), for example
+     * "RGB" or "I". The coder must deliver whole rows in order, as
+     * most formats do. A progress monitor and cancel token installed
+     * on the ImageInfo apply to the decode; once cancelled, no more
+     * bands are delivered and a MagickException is thrown.
+     *
+     * @param imageInfo specifies the file to read from
+     * @param map the components of a pixel
+     * @param bandRows the maximum number of rows per band
+     * @param handler receives the bands of rows
+     * @see <a href="http://www.imagemagick.org/api/stream.php#ReadStream">The underlying ImageMagick call</a>
+     * @throws MagickException on error
+     */
+    public static void streamImage(ImageInfo imageInfo, String map,
+				   int bandRows, PixelStreamHandler handler)
+	throws MagickException
+    {
+	if (map == null || handler == null) {
+	    throw new MagickException("Map or handler is null");
+	}
+	if (bandRows <= 0) {
+	    throw new MagickException("Band rows must be positive");
+	}
+	readStream(imageInfo, map, bandRows, handler);
+    }
+
+    /**
+     * Helper for streamImage to decode an image in stream mode.
+     *
+     * @param imageInfo specifies the file to read from
+     * @param map the components of a pixel
+     * @param bandRows the maximum number of rows per band
+     * @param handler receives the bands of rows
+     * @throws MagickException on error
+     * @see #streamImage
+     */
+    private static native void readStream(ImageInfo imageInfo, String map,
+					  int bandRows,
+					  PixelStreamHandler handler)
+	throws MagickException;
+
     /**
      * Write the image specified in the ImageInfo object.
      *
@@ -150,6 +360,69 @@ public class MagickImage extends Magick {
     public native boolean writeImage(ImageInfo imageInfo)
 	throws MagickException;
 
+    /**
+     * Write the image to a stream. As with writeImage(ImageInfo), all
+     * the frames are written if the format supports several. The
+     * encoder output is pushed to the stream in chunks as it is
+     * produced, so the encoded image is never held in full in memory.
+     * The output format is determined as for imagesToBlob. The stream
+     * is neither flushed nor closed.
+     *
+     * @param imageInfo specifies the writing parameters
+     * @param out the stream to write the image to
+     * @throws MagickException if the image cannot be encoded
+     * @throws IOException if writing to the stream fails
+     */
+    public void writeImage(ImageInfo imageInfo, OutputStream out)
+	throws MagickException, IOException
+    {
+	if (out == null) {
+	    throw new MagickException("Stream is null");
+	}
+	imageToStream(imageInfo, out, false);
+    }
+
+    /**
+     * Write the image, with all its frames, to a channel. The encoder
+     * output is handed to the channel through direct buffers over the
+     * encoder memory as it is produced. The channel must be in
+     * blocking mode. It is not closed.
+     *
+     * @param imageInfo specifies the writing parameters
+     * @param channel the channel to write the image to
+     * @throws MagickException if the image cannot be encoded or the
+     *         channel is in non-blocking mode
+     * @throws IOException if writing to the channel fails, or it
+     *         accepts no bytes
+     * @see #writeImage(ImageInfo, OutputStream)
+     */
+    public void writeImage(ImageInfo imageInfo, WritableByteChannel channel)
+	throws MagickException, IOException
+    {
+	if (channel == null) {
+	    throw new MagickException("Channel is null");
+	}
+	if (channel instanceof SelectableChannel
+	    && !((SelectableChannel) channel).isBlocking()) {
+	    throw new MagickException("Channel is in non-blocking mode");
+	}
+	imageToStream(imageInfo, channel, true);
+    }
+
+    /**
+     * Helper for writeImage to encode the image to a stream or
+     * channel.
+     *
+     * @param imageInfo specifies the writing parameters
+     * @param sink an OutputStream or a WritableByteChannel
+     * @param isChannel true if sink is a WritableByteChannel
+     * @throws MagickException if the image cannot be encoded
+     * @throws IOException if writing to the sink fails
+     */
+    private native void imageToStream(ImageInfo imageInfo, Object sink,
+				      boolean isChannel)
+	throws MagickException, IOException;
+
     /**
      * Return the image file name of the image.
      *
@@ -375,6 +648,107 @@ public class MagickImage extends Magick {
     public native boolean raiseImage(Rectangle raiseInfo, boolean raise)
 	throws MagickException;
 
+    /**
+     * Set the whole image from 8-bit components. If the image is a
+     * single sRGB frame of the given dimensions, with an alpha
+     * channel exactly when the map has one, the pixels are imported
+     * into it in place, keeping its pixel cache and attributes;
+     * otherwise a new image is created as by constituteImage. Maps
+     * with gray or CMYK components always create a new image. This
+     * avoids reallocating the image when a sequence of images of the
+     * same size, such as video frames, is fed through one MagickImage.
+     *
+     * @param width the width of the image
+     * @param height the height of the image
+     * @param map the components of a pixel
+     * @param pixels the raw image in an array of pixels
+     * @see <a href="http://www.imagemagick.org/api/pixel.php#ImportImagePixels">The underlying ImageMagick call</a>
+     * @throws MagickException on error
+     */
+    public void importPixels(int width, int height, String map,
+			     byte[] pixels)
+	throws MagickException
+    {
+	constitutePixels(width, height, map, StorageType.CharPixel,
+			 pixels, 0, pixels.length, true);
+    }
+
+    /**
+     * Set the whole image from 16-bit components, in place if the
+     * image is a single frame that fits the map.
+     *
+     * @param width the width of the image
+     * @param height the height of the image
+     * @param map the components of a pixel
+     * @param pixels the raw image in an array of pixels
+     * @see #importPixels(int, int, String, byte[])
+     * @throws MagickException on error
+     */
+    public void importPixels(int width, int height, String map,
+			     short[] pixels)
+	throws MagickException
+    {
+	constitutePixels(width, height, map, StorageType.ShortPixel,
+			 pixels, 0, pixels.length * 2, true);
+    }
+
+    /**
+     * Set the whole image from 32-bit components, in place if the
+     * image is a single frame that fits the map.
+     *
+     * @param width the width of the image
+     * @param height the height of the image
+     * @param map the components of a pixel
+     * @param pixels the raw image in an array of pixels
+     * @see #importPixels(int, int, String, byte[])
+     * @throws MagickException on error
+     */
+    public void importPixels(int width, int height, String map,
+			     int[] pixels)
+	throws MagickException
+    {
+	constitutePixels(width, height, map, StorageType.LongPixel,
+			 pixels, 0, pixels.length * 4, true);
+    }
+
+    /**
+     * Set the whole image from float components, in place if the
+     * image is a single frame that fits the map.
+     *
+     * @param width the width of the image
+     * @param height the height of the image
+     * @param map the components of a pixel
+     * @param pixels the raw image in an array of pixels
+     * @see #importPixels(int, int, String, byte[])
+     * @throws MagickException on error
+     */
+    public void importPixels(int width, int height, String map,
+			     float[] pixels)
+	throws MagickException
+    {
+	constitutePixels(width, height, map, StorageType.FloatPixel,
+			 pixels, 0, pixels.length * 4, true);
+    }
+
+    /**
+     * Set the whole image from double components, in place if the
+     * image is a single frame that fits the map.
+     *
+     * @param width the width of the image
+     * @param height the height of the image
+     * @param map the components of a pixel
+     * @param pixels the raw image in an array of pixels
+     * @see #importPixels(int, int, String, byte[])
+     * @throws MagickException on error
+     */
+    public void importPixels(int width, int height, String map,
+			     double[] pixels)
+	throws MagickException
+    {
+	constitutePixels(width, height, map, StorageType.DoublePixel,
+			 pixels, 0, pixels.length * 8, true);
+    }
+
     /**
      * Creates a new image that is a subregion of the original.
      *
@@ -526,6 +900,65 @@ public class MagickImage extends Magick {
 				       String map, float[] pixels)
 	throws MagickException;
 
+    /**
+     * Create a new image of 16-bit component of the specified dimensions.
+     *
+     * @param width the width of the new image
+     * @param height the height of the new image
+     * @param map the components of a pixel
+     * @param pixels the raw image in an array of pixels
+     * @see <a href="http://www.imagemagick.org/api/constitute.php#ConstituteImage">The underlying ImageMagick call</a>
+     * @throws MagickException on error
+     */
+    public void constituteImage(int width, int height,
+				String map, short[] pixels)
+	throws MagickException
+    {
+	constitutePixels(width, height, map, StorageType.ShortPixel,
+			 pixels, 0, pixels.length * 2, false);
+    }
+
+    /**
+     * Create a new image of double component of the specified dimensions.
+     *
+     * @param width the width of the new image
+     * @param height the height of the new image
+     * @param map the components of a pixel
+     * @param pixels the raw image in an array of pixels
+     * @see <a href="http://www.imagemagick.org/api/constitute.php#ConstituteImage">The underlying ImageMagick call</a>
+     * @throws MagickException on error
+     */
+    public void constituteImage(int width, int height,
+				String map, double[] pixels)
+	throws MagickException
+    {
+	constitutePixels(width, height, map, StorageType.DoublePixel,
+			 pixels, 0, pixels.length * 8, false);
+    }
+
+    /**
+     * Create a new image of the specified dimensions from components
+     * in the in-memory format of ImageMagick, so they are used without
+     * conversion. The array must match Magick.getQuantumDepth() and
+     * Magick.isHDRI(): byte[], short[], int[] or long[] for 8, 16, 32
+     * or 64-bit components, or float[] or double[] with HDRI.
+     *
+     * @param width the width of the new image
+     * @param height the height of the new image
+     * @param map the components of a pixel
+     * @param pixels the raw image in an array of quantum components
+     * @see <a href="http://www.imagemagick.org/api/constitute.php#ConstituteImage">The underlying ImageMagick call</a>
+     * @throws MagickException on error or if the array type does not
+     *         match the quantum
+     */
+    public void constituteQuantumImage(int width, int height,
+				       String map, Object pixels)
+	throws MagickException
+    {
+	constitutePixels(width, height, map, StorageType.QuantumPixel,
+			 pixels, 0, getQuantumArrayLength(pixels), false);
+    }
+
     /**
      * Creates a new image that is a subregion of the original.
      *
@@ -544,10 +977,32 @@ public class MagickImage extends Magick {
 	throws MagickException;
 
     /**
-     * Called by finalize to deallocate the image handle.
+     * Deallocate the image handle.
+     *
+     * @see #close()
      */
     public native void destroyImages();
 
+    /**
+     * Install a progress monitor and a cancel token on the image.
+     * Operations on the image report their progress to the monitor
+     * and stop once the token is cancelled or expires. A cancelled
+     * operation fails as any other: methods returning an image throw
+     * a MagickException, and methods returning a boolean return false.
+     * Either argument may be null, and passing both null removes the
+     * monitor. Images created by operations on this image do not
+     * inherit the monitor. The monitor is held until it is removed or
+     * the image is closed; see ProgressMonitor.
+     *
+     * @param monitor receives the progress of operations, or null
+     * @param token cancels the operations, or null
+     * @see <a href="http://www.imagemagick.org/api/monitor.php#SetImageProgressMonitor">The underlying ImageMagick call</a>
+     * @throws MagickException if there is no image
+     */
+    public native void setProgressMonitor(ProgressMonitor monitor,
+					  CancelToken token)
+	throws MagickException;
+
     /**
      * Draws a primitive (line, rectangle, ellipse) on the image.
      * @return a boolean value to indicate success
@@ -923,6 +1378,19 @@ public class MagickImage extends Magick {
     public native MagickImage resizeImage(int cols, int rows, double blur)
     throws MagickException;
 
+    /**
+     * Resize the image on a worker of the default MagickExecutor.
+     *
+     * @param cols the width of the resized image
+     * @param rows the height of the resized image
+     * @return a future completed with the resized image
+     * @see MagickExecutor#resize
+     */
+    public CompletableFuture<MagickImage> resizeAsync(int cols, int rows)
+    {
+	return MagickExecutor.getDefault().resize(this, cols, rows);
+    }
+
     /**
      * Return a new image that is a extended version of the original.
      *
@@ -1264,51 +1732,451 @@ public class MagickImage extends Magick {
 					String map, float[] pixels)
 	throws MagickException;
 
-
     /**
-     * Return the image format (i.e., Gif, Jpeg,...)
+     * Get the pixels as 16-bit components from the image.
      *
-     * @return the string representing the image format
+     * @param x x coordinate of the origin of the subimage
+     * @param y y coordinate of the origin of the subimage
+     * @param width width of the subimage
+     * @param height height of the subimage
+     * @param map component order of the pixels
+     * @param pixels pixels of the subimage
+     * @return a boolean value indicating success
      * @throws MagickException on error
-     * @author Abdulbaset Gaddah &lt;agaddah@yahoo.com&gt;
      */
-    public native String getMagick()
-	throws MagickException;
-    public String getImageFormat()
-        throws MagickException
+    public boolean dispatchImage(int x, int y, int width, int height,
+				 String map, short[] pixels)
+	throws MagickException
     {
-        return getMagick();
+	return transferPixels(x, y, width, height, map,
+			      StorageType.ShortPixel, pixels, 0,
+			      pixels.length * 2, false, false);
     }
 
-    /*
-     * Set the image format (i.e., Gif, Jpeg,...).
+    /**
+     * Get the pixels as double components from the image.
      *
-     * @param imageFormat new image format
+     * @param x x coordinate of the origin of the subimage
+     * @param y y coordinate of the origin of the subimage
+     * @param width width of the subimage
+     * @param height height of the subimage
+     * @param map component order of the pixels
+     * @param pixels pixels of the subimage
+     * @return a boolean value indicating success
      * @throws MagickException on error
-     * @author Abdulbaset Gaddah &lt;agaddah@yahoo.com&gt;
      */
-    public native void setMagick(String imageFormat)
-	throws MagickException;
-    public void setImageFormat(String imageFormat)
-        throws MagickException
+    public boolean dispatchImage(int x, int y, int width, int height,
+				 String map, double[] pixels)
+	throws MagickException
     {
-        setMagick(imageFormat);
+	return transferPixels(x, y, width, height, map,
+			      StorageType.DoublePixel, pixels, 0,
+			      pixels.length * 8, false, false);
     }
 
     /**
-     * Return the number of unique colors in an image.
-     * @return the number of unique colors
-     * @throws MagickException on error
-     * @author Abdulbaset Gaddah &lt;agaddah@yahoo.com&gt;
+     * Get the pixels from the image in the in-memory format of
+     * ImageMagick, without conversion. The array must match the
+     * quantum as for constituteQuantumImage.
+     *
+     * @param x x coordinate of the origin of the subimage
+     * @param y y coordinate of the origin of the subimage
+     * @param width width of the subimage
+     * @param height height of the subimage
+     * @param map component order of the pixels
+     * @param pixels pixels of the subimage
+     * @return a boolean value indicating success
+     * @throws MagickException on error or if the array type does not
+     *         match the quantum
+     * @see #constituteQuantumImage
      */
-    public native int getNumberColors()
-	throws MagickException;
+    public boolean dispatchQuantumImage(int x, int y, int width, int height,
+					String map, Object pixels)
+	throws MagickException
+    {
+	return transferPixels(x, y, width, height, map,
+			      StorageType.QuantumPixel, pixels, 0,
+			      getQuantumArrayLength(pixels), false, false);
+    }
 
-    /*
-     * Set the number of unigue colors in an image.
+    /**
+     * Check that an array can hold ImageMagick quantum components.
      *
-     * @param numberColors new number of unigue colors in an image
-     * @throws MagickException on error
+     * @param pixels the array
+     * @return the length of the array in bytes
+     * @throws MagickException if the array type does not match the
+     *         quantum
+     */
+    private static int getQuantumArrayLength(Object pixels)
+	throws MagickException
+    {
+	int size = Magick.getQuantumSize();
+	boolean hdri = Magick.isHDRI();
+	if (hdri && size == 4 && pixels instanceof float[]) {
+	    return ((float[]) pixels).length * 4;
+	}
+	if (hdri && size == 8 && pixels instanceof double[]) {
+	    return ((double[]) pixels).length * 8;
+	}
+	if (!hdri && size == 1 && pixels instanceof byte[]) {
+	    return ((byte[]) pixels).length;
+	}
+	if (!hdri && size == 2 && pixels instanceof short[]) {
+	    return ((short[]) pixels).length * 2;
+	}
+	if (!hdri && size == 4 && pixels instanceof int[]) {
+	    return ((int[]) pixels).length * 4;
+	}
+	if (!hdri && size == 8 && pixels instanceof long[]) {
+	    return ((long[]) pixels).length * 8;
+	}
+	throw new MagickException("Array type does not match the quantum");
+    }
+
+    /**
+     * Get the pixels of a region of the image into a buffer, from its
+     * position on. A direct buffer is written in place by ImageMagick;
+     * the array of a heap buffer is pinned for the transfer rather
+     * than copied. Components wider than a byte are written in native
+     * byte order. The position of the buffer is not changed.
+     *
+     * @param x x coordinate of the origin of the region
+     * @param y y coordinate of the origin of the region
+     * @param width width of the region
+     * @param height height of the region
+     * @param map component order of the pixels, for example "RGBA"
+     * @param storageType the type of a component, from StorageType
+     * @param pixels the buffer to write the pixels to
+     * @return a boolean value indicating success
+     * @see <a href="http://www.imagemagick.org/api/pixel.php#ExportImagePixels">The underlying ImageMagick call</a>
+     * @throws MagickException on error
+     */
+    public boolean exportPixels(int x, int y, int width, int height,
+				String map, int storageType,
+				ByteBuffer pixels)
+	throws MagickException
+    {
+	if (pixels.isReadOnly()) {
+	    throw new MagickException("Buffer is read-only");
+	}
+	return transferBuffer(x, y, width, height, map, storageType,
+			      pixels, false);
+    }
+
+    /**
+     * Set the pixels of a region of the image from a buffer, from its
+     * position on. A direct buffer is read in place by ImageMagick;
+     * the array of a heap buffer is pinned for the transfer rather
+     * than copied. Components wider than a byte are read in native
+     * byte order. The position of the buffer is not changed.
+     *
+     * @param x x coordinate of the origin of the region
+     * @param y y coordinate of the origin of the region
+     * @param width width of the region
+     * @param height height of the region
+     * @param map component order of the pixels, for example "RGBA"
+     * @param storageType the type of a component, from StorageType
+     * @param pixels the buffer to read the pixels from
+     * @return a boolean value indicating success
+     * @see <a href="http://www.imagemagick.org/api/pixel.php#ImportImagePixels">The underlying ImageMagick call</a>
+     * @throws MagickException on error
+     */
+    public boolean importPixels(int x, int y, int width, int height,
+				String map, int storageType,
+				ByteBuffer pixels)
+	throws MagickException
+    {
+	return transferBuffer(x, y, width, height, map, storageType,
+			      pixels, true);
+    }
+
+    /**
+     * Convert the image to a BufferedImage. Gray images without alpha
+     * become TYPE_BYTE_GRAY, images with alpha TYPE_INT_ARGB and all
+     * others TYPE_3BYTE_BGR.
+     *
+     * @return a new BufferedImage with the pixels of the image
+     * @throws MagickException on error
+     * @see #toBufferedImage(int)
+     */
+    public BufferedImage toBufferedImage()
+	throws MagickException
+    {
+	int type;
+	if (getMatte()) {
+	    type = BufferedImage.TYPE_INT_ARGB;
+	}
+	else if (isGrayImage()) {
+	    type = BufferedImage.TYPE_BYTE_GRAY;
+	}
+	else {
+	    type = BufferedImage.TYPE_3BYTE_BGR;
+	}
+	return toBufferedImage(type);
+    }
+
+    /**
+     * Convert the image to a BufferedImage of the given type. The
+     * pixels are exported by ImageMagick straight into the data
+     * buffer of the new image, in its channel order.
+     *
+     * @param type one of BufferedImage.TYPE_INT_ARGB, TYPE_INT_RGB,
+     *        TYPE_INT_BGR, TYPE_4BYTE_ABGR, TYPE_3BYTE_BGR or
+     *        TYPE_BYTE_GRAY
+     * @return a new BufferedImage with the pixels of the image
+     * @throws MagickException on error or for an unsupported type
+     */
+    public BufferedImage toBufferedImage(int type)
+	throws MagickException
+    {
+	String map = getBufferedImageMap(type);
+	if (map == null) {
+	    throw new MagickException("Unsupported BufferedImage type");
+	}
+	Dimension dim = getDimension();
+	BufferedImage bi = new BufferedImage(dim.width, dim.height, type);
+	DataBuffer buffer = bi.getRaster().getDataBuffer();
+	Object data;
+	int length;
+	if (buffer instanceof DataBufferInt) {
+	    data = ((DataBufferInt) buffer).getData();
+	    length = ((int[]) data).length * 4;
+	}
+	else {
+	    data = ((DataBufferByte) buffer).getData();
+	    length = ((byte[]) data).length;
+	}
+	transferPixels(0, 0, dim.width, dim.height, map,
+		       StorageType.CharPixel, data, 0, length, false, false);
+	return bi;
+    }
+
+    /**
+     * Replace the image with the pixels of a BufferedImage. Images of
+     * the types supported by toBufferedImage(int) are imported by
+     * ImageMagick straight from their data buffer; other images are
+     * first drawn into a TYPE_INT_ARGB image.
+     *
+     * @param bi the image to import
+     * @throws MagickException on error
+     */
+    public void fromBufferedImage(BufferedImage bi)
+	throws MagickException
+    {
+	int type = bi.getType();
+	String map = getBufferedImageMap(type);
+	if (map == null || !isPlainRaster(bi.getRaster())) {
+	    BufferedImage argb = new BufferedImage(bi.getWidth(),
+						   bi.getHeight(),
+						   BufferedImage.TYPE_INT_ARGB);
+	    Graphics2D g = argb.createGraphics();
+	    g.drawImage(bi, 0, 0, null);
+	    g.dispose();
+	    bi = argb;
+	    type = BufferedImage.TYPE_INT_ARGB;
+	    map = getBufferedImageMap(type);
+	}
+	DataBuffer buffer = bi.getRaster().getDataBuffer();
+	Object data;
+	int length;
+	if (buffer instanceof DataBufferInt) {
+	    data = ((DataBufferInt) buffer).getData();
+	    length = ((int[]) data).length * 4;
+	}
+	else {
+	    data = ((DataBufferByte) buffer).getData();
+	    length = ((byte[]) data).length;
+	}
+	constitutePixels(bi.getWidth(), bi.getHeight(), map,
+			 StorageType.CharPixel, data, 0, length, false);
+    }
+
+    /**
+     * Get the pixels of a region of the image as packed ARGB ints,
+     * the layout of ColorModel.getRGBdefault(). The array is pinned
+     * for the transfer rather than copied.
+     *
+     * @param x x coordinate of the origin of the region
+     * @param y y coordinate of the origin of the region
+     * @param width width of the region
+     * @param height height of the region
+     * @param pixels the array to write the pixels to
+     * @return a boolean value indicating success
+     * @throws MagickException on error
+     */
+    boolean exportArgb(int x, int y, int width, int height, int[] pixels)
+	throws MagickException
+    {
+	return transferPixels(x, y, width, height,
+			      getBufferedImageMap(BufferedImage.TYPE_INT_ARGB),
+			      StorageType.CharPixel, pixels, 0,
+			      pixels.length * 4, false, false);
+    }
+
+    /**
+     * Return the ImageMagick map of the bytes of a pixel of a
+     * BufferedImage type, in memory order. Packed int pixels are
+     * laid out according to the native byte order.
+     *
+     * @param type the BufferedImage type
+     * @return the map, or null if the type is not supported
+     */
+    private static String getBufferedImageMap(int type)
+    {
+	boolean little = ByteOrder.nativeOrder() == ByteOrder.LITTLE_ENDIAN;
+	switch (type) {
+	case BufferedImage.TYPE_INT_ARGB:
+	    return little ? "BGRA" : "ARGB";
+	case BufferedImage.TYPE_INT_RGB:
+	    return little ? "BGRP" : "PRGB";
+	case BufferedImage.TYPE_INT_BGR:
+	    return little ? "RGBP" : "PBGR";
+	case BufferedImage.TYPE_4BYTE_ABGR:
+	    return "ABGR";
+	case BufferedImage.TYPE_3BYTE_BGR:
+	    return "BGR";
+	case BufferedImage.TYPE_BYTE_GRAY:
+	    return "I";
+	default:
+	    return null;
+	}
+    }
+
+    /**
+     * Return whether a raster holds its pixels from the start of a
+     * single bank without padding, as a BufferedImage it created
+     * itself does.
+     *
+     * @param raster the raster of the BufferedImage
+     * @return true if the pixels can be imported directly
+     */
+    private static boolean isPlainRaster(WritableRaster raster)
+    {
+	if (raster.getParent() != null
+	    || raster.getDataBuffer().getNumBanks() != 1
+	    || raster.getDataBuffer().getOffset() != 0) {
+	    return false;
+	}
+	if (raster.getSampleModel() instanceof SinglePixelPackedSampleModel) {
+	    SinglePixelPackedSampleModel sm =
+		(SinglePixelPackedSampleModel) raster.getSampleModel();
+	    return sm.getScanlineStride() == raster.getWidth();
+	}
+	if (raster.getSampleModel() instanceof ComponentSampleModel) {
+	    ComponentSampleModel sm =
+		(ComponentSampleModel) raster.getSampleModel();
+	    return sm.getScanlineStride()
+		== raster.getWidth() * sm.getPixelStride();
+	}
+	return false;
+    }
+
+    /**
+     * Helper for exportPixels and importPixels to pass the memory of
+     * a buffer to the native transfer.
+     */
+    private boolean transferBuffer(int x, int y, int width, int height,
+				   String map, int storageType,
+				   ByteBuffer pixels, boolean isImport)
+	throws MagickException
+    {
+	if (pixels.isDirect()) {
+	    return transferPixels(x, y, width, height, map, storageType,
+				  pixels, pixels.position(),
+				  pixels.remaining(), true, isImport);
+	}
+	if (!pixels.hasArray()) {
+	    throw new MagickException("Buffer has no accessible array");
+	}
+	return transferPixels(x, y, width, height, map, storageType,
+			      pixels.array(),
+			      pixels.arrayOffset() + pixels.position(),
+			      pixels.remaining(), false, isImport);
+    }
+
+    /**
+     * Export or import the pixels of a region of the image through
+     * the memory of a direct buffer or of a primitive array.
+     *
+     * @param pixels a direct ByteBuffer or a primitive array
+     * @param offset the offset of the pixels in bytes
+     * @param length the number of bytes available from offset
+     * @param isDirect true if pixels is a direct buffer
+     * @param isImport true to import, false to export
+     */
+    private native boolean transferPixels(int x, int y, int width,
+					  int height, String map,
+					  int storageType, Object pixels,
+					  int offset, int length,
+					  boolean isDirect, boolean isImport)
+	throws MagickException;
+
+    /**
+     * Create a new image from the pixels in a primitive array, which
+     * is pinned rather than copied.
+     *
+     * @param width the width of the new image
+     * @param height the height of the new image
+     * @param map the components of a pixel
+     * @param storageType the type of a component, from StorageType
+     * @param pixels a primitive array
+     * @param offset the offset of the pixels in bytes
+     * @param length the number of bytes available from offset
+     * @param reuse true to import into the current image if it is a
+     *        single frame of the same size
+     * @throws MagickException on error
+     */
+    private native void constitutePixels(int width, int height, String map,
+					 int storageType, Object pixels,
+					 int offset, int length,
+					 boolean reuse)
+	throws MagickException;
+
+
+    /**
+     * Return the image format (i.e., Gif, Jpeg,...)
+     *
+     * @return the string representing the image format
+     * @throws MagickException on error
+     * @author Abdulbaset Gaddah &lt;agaddah@yahoo.com&gt;
+     */
+    public native String getMagick()
+	throws MagickException;
+    public String getImageFormat()
+        throws MagickException
+    {
+        return getMagick();
+    }
+
+    /*
+     * Set the image format (i.e., Gif, Jpeg,...).
+     *
+     * @param imageFormat new image format
+     * @throws MagickException on error
+     * @author Abdulbaset Gaddah &lt;agaddah@yahoo.com&gt;
+     */
+    public native void setMagick(String imageFormat)
+	throws MagickException;
+    public void setImageFormat(String imageFormat)
+        throws MagickException
+    {
+        setMagick(imageFormat);
+    }
+
+    /**
+     * Return the number of unique colors in an image.
+     * @return the number of unique colors
+     * @throws MagickException on error
+     * @author Abdulbaset Gaddah &lt;agaddah@yahoo.com&gt;
+     */
+    public native int getNumberColors()
+	throws MagickException;
+
+    /*
+     * Set the number of unigue colors in an image.
+     *
+     * @param numberColors new number of unigue colors in an image
+     * @throws MagickException on error
      * @author Abdulbaset Gaddah &lt;agaddah@yahoo.com&gt;
      */
     public native void setNumberColors(int numberColors)
@@ -1479,6 +2347,82 @@ public class MagickImage extends Magick {
     public native void blobToImage(ImageInfo imageInfo, byte[] blob)
 	throws MagickException;
 
+    /**
+     * Takes from a buffer an image in a known format and read it into
+     * itself. The bytes between the position and the limit of the
+     * buffer are decoded; the position of the buffer is not changed.
+     * A direct buffer is handed to ImageMagick without being copied
+     * onto the Java heap.
+     *
+     * @param imageInfo a ImageInfo instance
+     * @param blob buffer containing an image in a known format
+     * @throws MagickException on error
+     */
+    public void blobToImage(ImageInfo imageInfo, ByteBuffer blob)
+	throws MagickException
+    {
+	if (blob == null) {
+	    throw new MagickException("Blob is null");
+	}
+	blobToImage(imageInfo, blob, blob.position(), blob.remaining());
+    }
+
+    /**
+     * Takes from a buffer an image in a known format and read it into
+     * itself. Only the <code>length</code> bytes starting at the
+     * absolute index <code>offset</code> are decoded; the position and
+     * limit of the buffer are ignored and not changed. A direct buffer
+     * is handed to ImageMagick without being copied onto the Java heap.
+     *
+     * @param imageInfo a ImageInfo instance
+     * @param blob buffer containing an image in a known format
+     * @param offset index of the first byte of the image in the buffer
+     * @param length number of bytes of the image
+     * @throws MagickException on error
+     */
+    public void blobToImage(ImageInfo imageInfo, ByteBuffer blob,
+			    int offset, int length)
+	throws MagickException
+    {
+	if (blob == null) {
+	    throw new MagickException("Blob is null");
+	}
+	if (offset < 0 || length < 0 || offset > blob.capacity() - length) {
+	    throw new MagickException("Blob offset or length out of range");
+	}
+	if (blob.isDirect()) {
+	    directBlobToImage(imageInfo, blob, offset, length);
+	}
+	else if (blob.hasArray() && blob.arrayOffset() + offset == 0
+		 && length == blob.array().length) {
+	    blobToImage(imageInfo, blob.array());
+	}
+	else {
+	    byte[] copy = new byte[length];
+	    ByteBuffer dup = blob.duplicate();
+	    dup.clear();
+	    dup.position(offset);
+	    dup.get(copy);
+	    blobToImage(imageInfo, copy);
+	}
+    }
+
+    /**
+     * Helper for blobToImage to read an image from the memory
+     * of a direct buffer.
+     *
+     * @param imageInfo a ImageInfo instance
+     * @param blob direct buffer containing an image in a known format
+     * @param offset index of the first byte of the image in the buffer
+     * @param length number of bytes of the image
+     * @throws MagickException on error
+     * @see #blobToImage(ImageInfo, ByteBuffer, int, int)
+     */
+    private native void directBlobToImage(ImageInfo imageInfo,
+					  ByteBuffer blob,
+					  int offset, int length)
+	throws MagickException;
+
     /**
      * Returns an array that contents the image format.
      *
@@ -1488,6 +2432,19 @@ public class MagickImage extends Magick {
      */
     public native byte[] imageToBlob(ImageInfo imageInfo);
 
+    /**
+     * Encode the image to a blob on a worker of the default
+     * MagickExecutor.
+     *
+     * @param imageInfo the ImageInfo for the encoding parameters
+     * @return a future completed with the encoded image
+     * @see MagickExecutor#toBlob
+     */
+    public CompletableFuture<byte[]> toBlobAsync(ImageInfo imageInfo)
+    {
+	return MagickExecutor.getDefault().toBlob(this, imageInfo);
+    }
+
     /**
      * Returns the image sequence as a blob and its length.
      *
@@ -1497,6 +2454,152 @@ public class MagickImage extends Magick {
      */
     public native byte[] imagesToBlob(ImageInfo imageInfo);
 
+    /**
+     * Encodes the image into a caller supplied buffer. If the encoded
+     * image fits into the bytes remaining in the buffer it is written
+     * at the current position and the position is advanced. Otherwise
+     * nothing is written and the negated size of the encoded image is
+     * returned, so the caller can retry with a large enough buffer.
+     *
+     * @param imageInfo the magick member of this object determines
+     *                  output format
+     * @param buffer the buffer to receive the encoded image. A direct
+     *               buffer avoids the copy through the Java heap.
+     * @return the number of bytes written, or the negated required size
+     *         if the buffer is too small
+     * @throws MagickException on error
+     */
+    public int imageToBlob(ImageInfo imageInfo, ByteBuffer buffer)
+	throws MagickException
+    {
+	return toBuffer(imageInfo, buffer, false);
+    }
+
+    /**
+     * Encodes the image sequence into a caller supplied buffer.
+     *
+     * @param imageInfo the magick member of this object determines
+     *                  output format
+     * @param buffer the buffer to receive the encoded images
+     * @return the number of bytes written, or the negated required size
+     *         if the buffer is too small
+     * @throws MagickException on error
+     * @see #imageToBlob(ImageInfo, ByteBuffer)
+     */
+    public int imagesToBlob(ImageInfo imageInfo, ByteBuffer buffer)
+	throws MagickException
+    {
+	return toBuffer(imageInfo, buffer, true);
+    }
+
+    /**
+     * Helper for imageToBlob and imagesToBlob with a buffer.
+     *
+     * @param imageInfo the magick member of this object determines
+     *                  output format
+     * @param buffer the buffer to receive the encoded image
+     * @param allImages true to encode the whole image sequence
+     * @return the number of bytes written, or the negated required size
+     * @throws MagickException on error
+     */
+    private int toBuffer(ImageInfo imageInfo, ByteBuffer buffer,
+			 boolean allImages)
+	throws MagickException
+    {
+	int written;
+
+	if (buffer == null) {
+	    throw new MagickException("Buffer is null");
+	}
+	if (buffer.isReadOnly()) {
+	    throw new MagickException("Buffer is read-only");
+	}
+	if (buffer.isDirect()) {
+	    written = directImageToBlob(imageInfo, buffer, buffer.position(),
+					buffer.remaining(), allImages);
+	}
+	else {
+	    byte[] blob = allImages ? imagesToBlob(imageInfo)
+				    : imageToBlob(imageInfo);
+	    if (blob == null) {
+		throw new MagickException("Unable to convert image to blob");
+	    }
+	    if (blob.length > buffer.remaining()) {
+		return -blob.length;
+	    }
+	    buffer.duplicate().put(blob);
+	    written = blob.length;
+	}
+	if (written > 0) {
+	    buffer.position(buffer.position() + written);
+	}
+	return written;
+    }
+
+    /**
+     * Helper for imageToBlob to encode into the memory of a
+     * direct buffer.
+     *
+     * @param imageInfo the magick member of this object determines
+     *                  output format
+     * @param buffer direct buffer to receive the encoded image
+     * @param offset index in the buffer of the first byte to write
+     * @param length number of bytes available from offset
+     * @param allImages true to encode the whole image sequence
+     * @return the number of bytes written, or the negated required size
+     * @throws MagickException on error
+     */
+    private native int directImageToBlob(ImageInfo imageInfo,
+					 ByteBuffer buffer,
+					 int offset, int length,
+					 boolean allImages)
+	throws MagickException;
+
+    /**
+     * Encodes the image into memory owned by ImageMagick, without
+     * copying it onto the Java heap. The returned blob must be
+     * released once its bytes have been consumed.
+     *
+     * @param imageInfo the magick member of this object determines
+     *                  output format
+     * @return the encoded image
+     * @throws MagickException on error
+     * @see MagickBlob#release
+     */
+    public MagickBlob imageToNativeBlob(ImageInfo imageInfo)
+	throws MagickException
+    {
+	return new MagickBlob(nativeImageToBlob(imageInfo, false));
+    }
+
+    /**
+     * Encodes the image sequence into memory owned by ImageMagick.
+     *
+     * @param imageInfo the magick member of this object determines
+     *                  output format
+     * @return the encoded images
+     * @throws MagickException on error
+     * @see #imageToNativeBlob
+     */
+    public MagickBlob imagesToNativeBlob(ImageInfo imageInfo)
+	throws MagickException
+    {
+	return new MagickBlob(nativeImageToBlob(imageInfo, true));
+    }
+
+    /**
+     * Helper for imageToNativeBlob and imagesToNativeBlob.
+     *
+     * @param imageInfo the magick member of this object determines
+     *                  output format
+     * @param allImages true to encode the whole image sequence
+     * @return a direct buffer over the ImageMagick blob memory
+     * @throws MagickException on error
+     */
+    private native ByteBuffer nativeImageToBlob(ImageInfo imageInfo,
+						boolean allImages)
+	throws MagickException;
+
     /**
      * Set the units attribute of the image.
      *
@@ -1582,6 +2685,127 @@ public class MagickImage extends Magick {
     public native int getNumFrames()
         throws MagickException;
 
+    /**
+     * Return a copy of a frame of the image as a single-frame image.
+     * The copy shares the pixels of the frame until either is
+     * modified, so it is cheap to make. The image is not changed.
+     *
+     * @param index the index of the frame, from 0
+     * @return a copy of the frame
+     * @throws MagickException if there is no such frame
+     */
+    public native MagickImage getFrame(int index)
+        throws MagickException;
+
+    /**
+     * Clone the image with all its frames. Each frame shares the
+     * pixel cache of the original until either is written.
+     *
+     * @return the clone
+     * @throws MagickException on error
+     */
+    native MagickImage cloneImageList()
+        throws MagickException;
+
+    /**
+     * Iterate over the frames of an image file, decoding one frame at
+     * a time rather than the whole animation.
+     *
+     * @param imageInfo specifies the file to read
+     * @return the frames, to be closed once done
+     * @throws MagickException if the file cannot be pinged
+     * @see FrameIterator
+     */
+    public static FrameIterator frames(ImageInfo imageInfo)
+        throws MagickException
+    {
+        return new FrameIterator(imageInfo, false);
+    }
+
+    /**
+     * Iterate over the frames of an image file, decoding one frame at
+     * a time, optionally coalescing each over the canvas left by the
+     * previous ones so that every frame is a full canvas.
+     *
+     * @param imageInfo specifies the file to read
+     * @param coalesce whether to coalesce the frames
+     * @return the frames, to be closed once done
+     * @throws MagickException if the file cannot be pinged
+     * @see FrameIterator
+     */
+    public static FrameIterator frames(ImageInfo imageInfo, boolean coalesce)
+        throws MagickException
+    {
+        return new FrameIterator(imageInfo, coalesce);
+    }
+
+    /**
+     * Destructively split the image into its frames, in a single
+     * native call. This image keeps the first frame and is the first
+     * element of the array; each other frame is moved, not copied,
+     * into a new image.
+     *
+     * @return the frames, this image first
+     * @throws MagickException if the image has no frames or the
+     *         images could not be created
+     * @see #adopt(MagickImage[])
+     */
+    public native MagickImage[] splitFrames()
+        throws MagickException;
+
+    /**
+     * Encode the image at several sizes in a single native call. The
+     * renditions are made in a cascade, largest first, each resized
+     * from the previous one rather than from this image, and are then
+     * encoded in parallel on native threads where available, no more
+     * than the ImageMagick limit on ResourceType.ThreadResource.
+     * The encoding is not reported to the progress monitor. Each
+     * rendition fits inside a square of its size and is never larger
+     * than this image, whose first frame is used and left unchanged.
+     *
+     * @param sizes the maximum width and height of each rendition
+     * @param imageInfo the magick member determines the output format
+     * @return the encoded renditions, in the order of sizes
+     * @throws MagickException if a size is not positive or a rendition
+     *         could not be made
+     * @see Thumbnailer
+     */
+    public byte[][] renditions(int[] sizes, ImageInfo imageInfo)
+        throws MagickException
+    {
+        return renditions(sizes, FilterType.UndefinedFilter, imageInfo);
+    }
+
+    /**
+     * Encode the image at several sizes in a single native call.
+     *
+     * @param sizes the maximum width and height of each rendition
+     * @param filter the resize filter, one of FilterType, or
+     *        FilterType.UndefinedFilter for the filter of the image
+     * @param imageInfo the magick member determines the output format
+     * @return the encoded renditions, in the order of sizes
+     * @throws MagickException if a size is not positive or a rendition
+     *         could not be made
+     * @see #renditions(int[], ImageInfo)
+     */
+    public byte[][] renditions(int[] sizes, int filter, ImageInfo imageInfo)
+        throws MagickException
+    {
+        for (int size : sizes) {
+            if (size <= 0) {
+                throw new MagickException("Invalid rendition size " + size);
+            }
+        }
+        return createRenditions(sizes, filter, imageInfo);
+    }
+
+    /**
+     * Helper for renditions to make and encode all the renditions.
+     */
+    private native byte[][] createRenditions(int[] sizes, int filter,
+                                             ImageInfo imageInfo)
+        throws MagickException;
+
     /**
      * Destructively create array of image frames. Contains this image
      * as the first object and frames in sequence.
@@ -2157,4 +3381,275 @@ public class MagickImage extends Magick {
      */
     public native boolean setImageProperty(String property, String value)
       throws MagickException;
+
+    /**
+     * Replace the frames of this image with those of another image,
+     * which is left without frames, and free the previous frames at
+     * once rather than when this image is closed or collected. It
+     * turns any transform into an in-place one:
+     *
+     * <pre>
+     * image.replaceImage(image.charcoalImage(1.0, 0.5));
+     * </pre>
+     *
+     * The progress monitor of this image, if any, is installed on
+     * the new frames. The other image keeps its own monitor and may
+     * be reused. All the frames of this image are replaced, while most
+     * transforms return only the first frame: the *InPlace methods
+     * therefore refuse multi-frame images.
+     *
+     * @param result the image whose frames to take
+     * @throws MagickException if result has no frames or is this image
+     */
+    public native void replaceImage(MagickImage result)
+	throws MagickException;
+
+    /**
+     * Throw if the image has several frames. The transforms return the
+     * first frame only, so replacing all the frames with the result
+     * would silently drop the others.
+     *
+     * @throws MagickException if the image has several frames
+     */
+    private void checkSingleFrame()
+	throws MagickException
+    {
+	if (hasFrames()) {
+	    throw new MagickException("In-place transforms do not support"
+				      + " multi-frame images");
+	}
+    }
+
+    /**
+     * Same as blurImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @param radius the radius of the Gaussian, in pixels
+     * @param sigma the standard deviation of the Gaussian, in pixels
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #blurImage(double, double)
+     */
+    public void blurImageInPlace(double radius, double sigma)
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(blurImage(radius, sigma));
+    }
+
+    /**
+     * Same as gaussianBlurImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @param radius the radius of the Gaussian, in pixels
+     * @param sigma the standard deviation of the Gaussian, in pixels
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #gaussianBlurImage(double, double)
+     */
+    public void gaussianBlurImageInPlace(double radius, double sigma)
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(gaussianBlurImage(radius, sigma));
+    }
+
+    /**
+     * Same as sharpenImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @param radius the radius of the Gaussian, in pixels
+     * @param sigma the standard deviation of the Laplacian, in pixels
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #sharpenImage(double, double)
+     */
+    public void sharpenImageInPlace(double radius, double sigma)
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(sharpenImage(radius, sigma));
+    }
+
+    /**
+     * Same as unsharpMaskImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @param radius the radius of the Gaussian, in pixels
+     * @param sigma the standard deviation of the Gaussian, in pixels
+     * @param amount the fraction of the difference added back
+     * @param threshold the threshold, as a fraction of QuantumRange
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #unsharpMaskImage(double, double, double, double)
+     */
+    public void unsharpMaskImageInPlace(double radius, double sigma, double amount, double threshold)
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(unsharpMaskImage(radius, sigma, amount, threshold));
+    }
+
+    /**
+     * Same as resizeImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @param cols the width of the resized image
+     * @param rows the height of the resized image
+     * @param blur the blur factor, typically 1.0
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #resizeImage(int, int, double)
+     */
+    public void resizeImageInPlace(int cols, int rows, double blur)
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(resizeImage(cols, rows, blur));
+    }
+
+    /**
+     * Same as resizeImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @param cols the width of the resized image
+     * @param rows the height of the resized image
+     * @param filter the filter, one of FilterType
+     * @param blur the blur factor, typically 1.0
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #resizeImage(int, int, int, double)
+     */
+    public void resizeImageInPlace(int cols, int rows, int filter, double blur)
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(resizeImage(cols, rows, filter, blur));
+    }
+
+    /**
+     * Same as scaleImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @param cols the width of the scaled image
+     * @param rows the height of the scaled image
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #scaleImage(int, int)
+     */
+    public void scaleImageInPlace(int cols, int rows)
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(scaleImage(cols, rows));
+    }
+
+    /**
+     * Same as sampleImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @param cols the width of the sampled image
+     * @param rows the height of the sampled image
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #sampleImage(int, int)
+     */
+    public void sampleImageInPlace(int cols, int rows)
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(sampleImage(cols, rows));
+    }
+
+    /**
+     * Same as cropImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @param chopInfo the region to keep
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #cropImage(Rectangle)
+     */
+    public void cropImageInPlace(Rectangle chopInfo)
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(cropImage(chopInfo));
+    }
+
+    /**
+     * Same as trimImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #trimImage()
+     */
+    public void trimImageInPlace()
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(trimImage());
+    }
+
+    /**
+     * Same as rotateImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @param degrees the angle of rotation, clockwise
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #rotateImage(double)
+     */
+    public void rotateImageInPlace(double degrees)
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(rotateImage(degrees));
+    }
+
+    /**
+     * Same as flipImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #flipImage()
+     */
+    public void flipImageInPlace()
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(flipImage());
+    }
+
+    /**
+     * Same as flopImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #flopImage()
+     */
+    public void flopImageInPlace()
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(flopImage());
+    }
+
+    /**
+     * Same as autoOrientImage, but the result replaces the frames of this
+     * image, which are freed at once.
+     *
+     * @throws MagickException if the image has several frames, or
+     *         on error
+     * @see #autoOrientImage()
+     */
+    public void autoOrientImageInPlace()
+	throws MagickException
+    {
+	checkSingleFrame();
+	replaceImage(autoOrientImage());
+    }
 }
@@ -5,7 +5,7 @@ package magick;
  *
  * @author Susan Dorr
  */
-public class MagickInfo extends Magick {
+public class MagickInfo extends Magick implements AutoCloseable {
 
     // Internal handle. Used as pointer to MagickInfo
     // structure in memory. We use long (64-bits) for
@@ -25,12 +25,13 @@ public class MagickInfo extends Magick {
     }
 
     /**
-     * Automated destructor.
+     * Release the structure. The MagickInfo points into the format
+     * registry of ImageMagick, which owns its memory, so nothing is
+     * left to release when the object is garbage-collected.
      */
-
-    public void finalize()
+    public void close()
     {
-	destroyMagickInfo(); 
+	destroyMagickInfo();
     }
 
     /**
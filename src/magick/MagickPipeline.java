@@ -0,0 +1,340 @@
+package magick;
+
+import java.awt.Rectangle;
+
+/**
+ * A sequence of image operations run in a single native call.
+ * The steps are recorded by the builder methods and applied by
+ * run() or runToBlob() to the first frame of an image, which is left
+ * unchanged. Each intermediate image is freed as soon as the next
+ * step has produced its successor, and only the final image or blob
+ * is returned to Java:
+ *
+ * <pre>
+ * byte[] thumbnail = new MagickPipeline()
+ *     .autoOrient()
+ *     .crop(new Rectangle(0, 0, 800, 800))
+ *     .resize(200, 200)
+ *     .unsharpMask(0.0, 1.0, 1.0, 0.05)
+ *     .strip()
+ *     .runToBlob(image, info);
+ * </pre>
+ *
+ * A pipeline may be run any number of times, but must not be modified
+ * while it is being run.
+ */
+public class MagickPipeline {
+
+    /**
+     * Operation codes, as interpreted by magick_MagickPipeline.c.
+     */
+    private static final int AUTO_ORIENT = 1;
+    private static final int CROP = 2;
+    private static final int RESIZE = 3;
+    private static final int SCALE = 4;
+    private static final int SAMPLE = 5;
+    private static final int THUMBNAIL = 6;
+    private static final int FIT = 7;
+    private static final int UNSHARP_MASK = 8;
+    private static final int SHARPEN = 9;
+    private static final int BLUR = 10;
+    private static final int GAUSSIAN_BLUR = 11;
+    private static final int ROTATE = 12;
+    private static final int FLIP = 13;
+    private static final int FLOP = 14;
+    private static final int STRIP = 15;
+
+    /**
+     * The operation codes of the steps.
+     */
+    private int[] ops = new int[8];
+    private int opCount = 0;
+
+    /**
+     * The arguments of the steps, in order; each operation takes a
+     * fixed number of them.
+     */
+    private double[] args = new double[32];
+    private int argCount = 0;
+
+    /**
+     * Record a step.
+     */
+    private MagickPipeline add(int op, double... opArgs)
+    {
+	if (opCount == ops.length) {
+	    int[] grown = new int[2 * ops.length];
+	    System.arraycopy(ops, 0, grown, 0, opCount);
+	    ops = grown;
+	}
+	ops[opCount++] = op;
+	if (argCount + opArgs.length > args.length) {
+	    double[] grown = new double[2 * (argCount + opArgs.length)];
+	    System.arraycopy(args, 0, grown, 0, argCount);
+	    args = grown;
+	}
+	System.arraycopy(opArgs, 0, args, argCount, opArgs.length);
+	argCount += opArgs.length;
+	return this;
+    }
+
+    /**
+     * Rotate or flip the image so that it is shown upright according
+     * to its orientation.
+     *
+     * @return this pipeline
+     * @see MagickImage#autoOrientImage()
+     */
+    public MagickPipeline autoOrient()
+    {
+	return add(AUTO_ORIENT);
+    }
+
+    /**
+     * Crop the image.
+     *
+     * @param rect the region to keep
+     * @return this pipeline
+     * @see MagickImage#cropImage(Rectangle)
+     */
+    public MagickPipeline crop(Rectangle rect)
+    {
+	return add(CROP, rect.x, rect.y, rect.width, rect.height);
+    }
+
+    /**
+     * Resize the image with the filter of the image.
+     *
+     * @param cols the width of the resized image
+     * @param rows the height of the resized image
+     * @return this pipeline
+     * @see MagickImage#resizeImage(int, int, double)
+     */
+    public MagickPipeline resize(int cols, int rows)
+    {
+	return add(RESIZE, cols, rows, -1, 1.0);
+    }
+
+    /**
+     * Resize the image.
+     *
+     * @param cols the width of the resized image
+     * @param rows the height of the resized image
+     * @param filter the filter, one of FilterType
+     * @param blur the blur factor, ignored by ImageMagick 7
+     * @return this pipeline
+     * @see MagickImage#resizeImage(int, int, int, double)
+     */
+    public MagickPipeline resize(int cols, int rows, int filter, double blur)
+    {
+	return add(RESIZE, cols, rows, filter, blur);
+    }
+
+    /**
+     * Resize the image to fit within a box, keeping its aspect ratio.
+     * Images that already fit are left as they are.
+     *
+     * @param maxCols the width of the box
+     * @param maxRows the height of the box
+     * @return this pipeline
+     */
+    public MagickPipeline fit(int maxCols, int maxRows)
+    {
+	return add(FIT, maxCols, maxRows);
+    }
+
+    /**
+     * Scale the image.
+     *
+     * @param cols the width of the scaled image
+     * @param rows the height of the scaled image
+     * @return this pipeline
+     * @see MagickImage#scaleImage(int, int)
+     */
+    public MagickPipeline scale(int cols, int rows)
+    {
+	return add(SCALE, cols, rows);
+    }
+
+    /**
+     * Resize the image by pixel sampling.
+     *
+     * @param cols the width of the sampled image
+     * @param rows the height of the sampled image
+     * @return this pipeline
+     * @see MagickImage#sampleImage(int, int)
+     */
+    public MagickPipeline sample(int cols, int rows)
+    {
+	return add(SAMPLE, cols, rows);
+    }
+
+    /**
+     * Resize the image into a thumbnail, dropping its profiles.
+     *
+     * @param cols the width of the thumbnail
+     * @param rows the height of the thumbnail
+     * @return this pipeline
+     */
+    public MagickPipeline thumbnail(int cols, int rows)
+    {
+	return add(THUMBNAIL, cols, rows);
+    }
+
+    /**
+     * Sharpen the image with an unsharp mask.
+     *
+     * @param radius the radius of the Gaussian, 0 to pick one
+     * @param sigma the standard deviation of the Gaussian
+     * @param amount the fraction of the difference added back
+     * @param threshold the threshold, as a fraction of QuantumRange
+     * @return this pipeline
+     * @see MagickImage#unsharpMaskImage(double, double, double, double)
+     */
+    public MagickPipeline unsharpMask(double radius, double sigma,
+				      double amount, double threshold)
+    {
+	return add(UNSHARP_MASK, radius, sigma, amount, threshold);
+    }
+
+    /**
+     * Sharpen the image.
+     *
+     * @param radius the radius of the Gaussian, 0 to pick one
+     * @param sigma the standard deviation of the Laplacian
+     * @return this pipeline
+     * @see MagickImage#sharpenImage(double, double)
+     */
+    public MagickPipeline sharpen(double radius, double sigma)
+    {
+	return add(SHARPEN, radius, sigma);
+    }
+
+    /**
+     * Blur the image.
+     *
+     * @param radius the radius of the Gaussian, 0 to pick one
+     * @param sigma the standard deviation of the Gaussian
+     * @return this pipeline
+     * @see MagickImage#blurImage(double, double)
+     */
+    public MagickPipeline blur(double radius, double sigma)
+    {
+	return add(BLUR, radius, sigma);
+    }
+
+    /**
+     * Blur the image with a Gaussian operator.
+     *
+     * @param radius the radius of the Gaussian, 0 to pick one
+     * @param sigma the standard deviation of the Gaussian
+     * @return this pipeline
+     * @see MagickImage#gaussianBlurImage(double, double)
+     */
+    public MagickPipeline gaussianBlur(double radius, double sigma)
+    {
+	return add(GAUSSIAN_BLUR, radius, sigma);
+    }
+
+    /**
+     * Rotate the image.
+     *
+     * @param degrees the angle of rotation, clockwise
+     * @return this pipeline
+     * @see MagickImage#rotateImage(double)
+     */
+    public MagickPipeline rotate(double degrees)
+    {
+	return add(ROTATE, degrees);
+    }
+
+    /**
+     * Mirror the image vertically.
+     *
+     * @return this pipeline
+     * @see MagickImage#flipImage()
+     */
+    public MagickPipeline flip()
+    {
+	return add(FLIP);
+    }
+
+    /**
+     * Mirror the image horizontally.
+     *
+     * @return this pipeline
+     * @see MagickImage#flopImage()
+     */
+    public MagickPipeline flop()
+    {
+	return add(FLOP);
+    }
+
+    /**
+     * Remove the profiles and comments of the image.
+     *
+     * @return this pipeline
+     * @see MagickImage#strip()
+     */
+    public MagickPipeline strip()
+    {
+	return add(STRIP);
+    }
+
+    /**
+     * Return the number of steps recorded.
+     *
+     * @return the number of steps
+     */
+    public int size()
+    {
+	return opCount;
+    }
+
+    /**
+     * Apply the steps to the first frame of an image.
+     *
+     * @param image the image to start from, left unchanged
+     * @return the final image
+     * @throws MagickException if a step fails
+     */
+    public MagickImage run(MagickImage image)
+	throws MagickException
+    {
+	return (MagickImage) execute(image, ops, opCount, args, null);
+    }
+
+    /**
+     * Apply the steps to the first frame of an image and encode the
+     * result. The final image is freed without being returned.
+     *
+     * @param image the image to start from, left unchanged
+     * @param imageInfo specifies the encoding parameters
+     * @return the encoded final image
+     * @throws MagickException if a step or the encoding fails
+     */
+    public byte[] runToBlob(MagickImage image, ImageInfo imageInfo)
+	throws MagickException
+    {
+	if (imageInfo == null) {
+	    throw new MagickException("ImageInfo is required to encode");
+	}
+	return (byte[]) execute(image, ops, opCount, args, imageInfo);
+    }
+
+    /**
+     * Run the steps natively.
+     *
+     * @param image the image to start from
+     * @param ops the operation codes
+     * @param opCount the number of steps
+     * @param args the arguments of the steps
+     * @param imageInfo if not null, encode the final image with it
+     * @return the final MagickImage, or its encoding as a byte[]
+     * @throws MagickException if a step fails
+     */
+    private static native Object execute(MagickImage image, int[] ops,
+					 int opCount, double[] args,
+					 ImageInfo imageInfo)
+	throws MagickException;
+}
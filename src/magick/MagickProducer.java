@@ -2,7 +2,7 @@ package magick;
 
 import java.awt.image.ImageProducer;
 import java.awt.image.ImageConsumer;
-import java.awt.image.DirectColorModel;
+import java.awt.image.ColorModel;
 import java.awt.Dimension;
 import java.util.Vector;
 import magick.MagickImage;
@@ -13,6 +13,12 @@ import magick.MagickException;
  * This class implements the ImageProducer class.
  * It reads the pixels off a MagickImage and sends
  * the pixels to the specified ImageConsumer.
+ * The pixels are sent in bands of complete scanlines,
+ * top down, through a buffer reused from band to band,
+ * so only a band of the image is held on the Java heap.
+ * Each frame of a multi-frame image is sent in turn; frames whose
+ * size differs from the first one are skipped, so an animation made
+ * of partial frames should be coalesced first.
  *
  * @author Eric Yeo
  */
@@ -27,14 +33,36 @@ public class MagickProducer
 
     private Vector<ImageConsumer> consumers = null;
 
+    /**
+     * Number of scanlines sent to the consumers at a time.
+     */
+    private int bandRows;
+
+    /**
+     * Default number of scanlines per band.
+     */
+    public static final int DEFAULT_BAND_ROWS = 64;
+
     /**
      * Constructor.
      *
      * @param image the MagickImage to produce an Image from
      */
     public MagickProducer(MagickImage image)
+    {
+	this(image, DEFAULT_BAND_ROWS);
+    }
+
+    /**
+     * Constructor.
+     *
+     * @param image the MagickImage to produce an Image from
+     * @param bandRows the number of scanlines sent at a time
+     */
+    public MagickProducer(MagickImage image, int bandRows)
     {
 	this.image = image;
+	this.bandRows = bandRows > 0 ? bandRows : DEFAULT_BAND_ROWS;
 	consumers = new Vector<ImageConsumer>();
     }
 
@@ -89,55 +117,99 @@ public class MagickProducer
     public void startProduction(ImageConsumer consumer)
     {
 	addConsumer(consumer);
+	ImageConsumer[] targets = new ImageConsumer[consumers.size()];
+	consumers.copyInto(targets);
 
-	// Get the pixels from the image
-	Dimension dim;
-	int size;
-	byte[] pixels;
+	ColorModel cmodel = ColorModel.getRGBdefault();
 	try {
-	    dim = image.getDimension();
-	    size = dim.width * dim.height;
-	    pixels = new byte[size*4];
-	    image.dispatchImage(0, 0, dim.width, dim.height, "RGBA", pixels);
+	    int frames = image.getNumFrames();
+	    int hints = ImageConsumer.TOPDOWNLEFTRIGHT|
+		ImageConsumer.COMPLETESCANLINES|
+		ImageConsumer.SINGLEPASS|
+		(frames > 1 ? ImageConsumer.MULTIPLEFRAMES :
+		 ImageConsumer.SINGLEFRAME);
+	    Dimension dim = image.getDimension();
+	    int[] band = new int[dim.width
+				 * Math.max(1, Math.min(bandRows, dim.height))];
+	    for (int i = 0; i < targets.length; i++) {
+		targets[i].setDimensions(dim.width, dim.height);
+		targets[i].setColorModel(cmodel);
+		targets[i].setHints(hints);
+	    }
+
+	    MagickImage rest = null;
+	    try {
+		for (int f = 0; f < frames; f++) {
+		    MagickImage frame = image;
+		    if (f > 0) {
+			// Walk a clone of the list, which shares its pixels
+			if (rest == null) {
+			    MagickImage first = image.cloneImageList();
+			    rest = first.nextImage();
+			    first.close();
+			}
+			frame = rest;
+			rest = frame.nextImage();
+		    }
+		    try {
+			sendFrame(targets, frame, dim, band, cmodel,
+				  f == frames - 1);
+		    }
+		    finally {
+			if (frame != image) {
+			    frame.close();
+			}
+		    }
+		}
+	    }
+	    finally {
+		if (rest != null) {
+		    rest.close();
+		}
+	    }
 	}
 	catch(MagickException ex) {
-	    for (int i = 0; i < consumers.size(); i++) {
-		ImageConsumer aConsumer =
-		    (ImageConsumer) consumers.elementAt(i);
-		aConsumer.imageComplete(ImageConsumer.IMAGEERROR);
+	    for (int i = 0; i < targets.length; i++) {
+		targets[i].imageComplete(ImageConsumer.IMAGEERROR);
 	    }
-	    return;
 	}
+    }
 
-	// Set the pixels in the consumers
-	int[] img = new int[size];
-	DirectColorModel cmodel =
-	    new DirectColorModel(32,
-				 255 << 24,
-				 255 << 16,
-				 255 << 8,
-				 255);
-	for (int i = 0; i < size; i++) {
-	    img[i] =
-		((pixels[i*4] & 255) << 24) |
-		((pixels[i*4+1] & 255) << 16) |
-		((pixels[i*4+2] & 255) << 8) |
-                (pixels[i*4+3] & 255);
+    /**
+     * Send a frame band by band. A frame whose size differs from the
+     * dimensions given to the consumers is skipped, apart from its
+     * completion status.
+     *
+     * @param targets the consumers
+     * @param frame the frame to send
+     * @param dim the dimensions given to the consumers
+     * @param band the buffer of a band
+     * @param cmodel the color model of the pixels
+     * @param last whether this is the last frame
+     * @throws MagickException if the pixels cannot be read
+     */
+    private void sendFrame(ImageConsumer[] targets, MagickImage frame,
+			   Dimension dim, int[] band, ColorModel cmodel,
+			   boolean last)
+	throws MagickException
+    {
+	if (dim.equals(frame.getDimension())) {
+	    int rows = Math.max(1, Math.min(bandRows, dim.height));
+	    for (int y = 0; y < dim.height; y += rows) {
+		int n = Math.min(rows, dim.height - y);
+		frame.exportArgb(0, y, dim.width, n, band);
+		for (int i = 0; i < targets.length; i++) {
+		    targets[i].setPixels(0, y, dim.width, n,
+					 cmodel, band, 0, dim.width);
+		}
+	    }
 	}
-	for (int i = 0; i < consumers.size(); i++) {
-	    ImageConsumer aConsumer =
-		consumers.elementAt(i);
-	    aConsumer.setHints(ImageConsumer.TOPDOWNLEFTRIGHT|
-			      ImageConsumer.COMPLETESCANLINES|
-			      ImageConsumer.SINGLEPASS|
-			      ImageConsumer.SINGLEFRAME);
-	    aConsumer.setDimensions(dim.width, dim.height);
-	    aConsumer.setPixels(0, 0, dim.width, dim.height,
-				cmodel,
-				img,
-				0,
-				dim.width);
-	    aConsumer.imageComplete(ImageConsumer.STATICIMAGEDONE);
+
+	int status = last ?
+	    ImageConsumer.STATICIMAGEDONE :
+	    ImageConsumer.SINGLEFRAMEDONE;
+	for (int i = 0; i < targets.length; i++) {
+	    targets[i].imageComplete(status);
 	}
     }
 
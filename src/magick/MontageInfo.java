@@ -4,7 +4,7 @@ package magick;
  * Encapsulation of the MontageInfo structure.
  * @author Eric Yeo
  */
-public class MontageInfo {
+public class MontageInfo extends Magick implements AutoCloseable {
 
     /**
      * Internal ImageMagick MontageInfo handle.
@@ -12,6 +12,10 @@ public class MontageInfo {
      */
     private long montageInfoHandle = 0;
 
+    {
+	registerCleaner(NativeCleaner.MONTAGE_INFO);
+    }
+
 
     /**
      * Constructor.
@@ -26,11 +30,14 @@ public class MontageInfo {
 
 
     /**
-     * To release memory on cleanup.
+     * Release the native memory of the MontageInfo now rather than when
+     * it is garbage-collected. The object must not be used
+     * afterwards. Calling this method more than once has no effect.
      */
-    protected void finalize()
+    public void close()
     {
 	destroyMontageInfo();
+	cleanable.clean();
     }
 
     /**
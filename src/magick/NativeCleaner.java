@@ -0,0 +1,217 @@
+package magick;
+
+import java.lang.ref.PhantomReference;
+import java.lang.ref.ReferenceQueue;
+import java.util.Collections;
+import java.util.Set;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.atomic.AtomicBoolean;
+import java.util.concurrent.atomic.AtomicLong;
+
+/**
+ * Releases the native memory of JMagick objects that are
+ * garbage-collected without having been closed. It works like
+ * java.lang.ref.Cleaner, on which JMagick does not depend so that
+ * it still runs on Java 8: each object is tracked by a phantom
+ * reference, and a daemon thread releases the memory once the
+ * object is unreachable.
+ *
+ * The native library mirrors every handle it stores in an object
+ * into the object's reference, so the memory can be released
+ * without the object itself. The memory of a MagickBlob is tracked
+ * through its buffer instead, which may outlive the blob.
+ */
+final class NativeCleaner {
+
+    /**
+     * Kinds of native memory, as released by Magick.destroyHandles.
+     * They must match the JMAGICK_HANDLE_* constants in jmagick.h.
+     */
+    static final int IMAGE = 1;
+    static final int IMAGE_INFO = 2;
+    static final int DRAW_INFO = 3;
+    static final int MONTAGE_INFO = 4;
+    static final int QUANTIZE_INFO = 5;
+    static final int CANCEL_TOKEN = 6;
+    static final int BLOB = 7;
+
+    private static final ReferenceQueue<Object> queue =
+	new ReferenceQueue<Object>();
+
+    /**
+     * The live references, which must stay reachable until they are
+     * enqueued.
+     */
+    private static final Set<Ref> refs =
+	Collections.newSetFromMap(new ConcurrentHashMap<Ref, Boolean>());
+
+    private static volatile boolean leakDetection =
+	"yes".equalsIgnoreCase(System.getProperty("jmagick.leakdetection"));
+
+    private static final AtomicLong leakCount = new AtomicLong();
+
+    static {
+	Thread thread = new Thread("jmagick-cleaner") {
+	    public void run() {
+		while (true) {
+		    try {
+			((Ref) queue.remove()).collected();
+		    }
+		    catch (InterruptedException e) {
+			// Keep cleaning
+		    }
+		    catch (Throwable e) {
+			e.printStackTrace();
+		    }
+		}
+	    }
+	};
+	thread.setDaemon(true);
+	thread.start();
+    }
+
+    private NativeCleaner()
+    {
+    }
+
+    /**
+     * The reference tracking an object, holding a copy of its
+     * handles.
+     */
+    static final class Ref extends PhantomReference<Object> {
+
+	private final int kind;
+	private final String className;
+	private final Throwable allocationSite;
+	private final AtomicBoolean done = new AtomicBoolean();
+
+	/**
+	 * Copy of the main handle of the object, written by the
+	 * native library.
+	 */
+	volatile long handle = 0;
+
+	/**
+	 * Copy of the progress monitor handle of the object, written
+	 * by the native library.
+	 */
+	volatile long progressHandle = 0;
+
+	/**
+	 * Pixel bytes accounted for the handle, written by the native
+	 * library.
+	 */
+	volatile long bytes = 0;
+
+	Ref(Object referent, Class<?> ownerClass, int kind)
+	{
+	    super(referent, queue);
+	    this.kind = kind;
+	    this.className = ownerClass.getName();
+	    this.allocationSite =
+		leakDetection ? new Throwable("Allocated here") : null;
+	}
+
+	/**
+	 * Release the memory now and stop tracking the object.
+	 * Calling this method more than once has no effect.
+	 */
+	void clean()
+	{
+	    if (done.compareAndSet(false, true)) {
+		refs.remove(this);
+		clear();
+		release();
+	    }
+	}
+
+	/**
+	 * Called once the object has been garbage-collected.
+	 */
+	private void collected()
+	{
+	    if (done.compareAndSet(false, true)) {
+		refs.remove(this);
+		if (handle != 0 || progressHandle != 0) {
+		    leaked(this);
+		}
+		release();
+	    }
+	}
+
+	private void release()
+	{
+	    if (kind == BLOB) {
+		if (handle != 0) {
+		    MagickBlob.relinquishBlob(handle);
+		    handle = 0;
+		}
+	    }
+	    else if (handle != 0 || progressHandle != 0) {
+		Magick.destroyHandles(kind, handle, progressHandle, bytes);
+		handle = 0;
+		progressHandle = 0;
+		bytes = 0;
+	    }
+	}
+    }
+
+    /**
+     * Start tracking an object.
+     *
+     * @param owner the object
+     * @param kind the kind of native memory it holds
+     * @return the reference to store in the object
+     */
+    static Ref register(Object owner, int kind)
+    {
+	return register(owner, owner.getClass(), kind);
+    }
+
+    /**
+     * Start tracking an object on behalf of its owner, whose memory
+     * is released once the tracked object is unreachable.
+     *
+     * @param referent the tracked object
+     * @param ownerClass the class of the owner, for leak reports
+     * @param kind the kind of native memory the owner holds
+     * @return the reference to store in the owner
+     */
+    static Ref register(Object referent, Class<?> ownerClass, int kind)
+    {
+	Ref ref = new Ref(referent, ownerClass, kind);
+	refs.add(ref);
+	return ref;
+    }
+
+    /**
+     * Count, and report if enabled, an object that was collected
+     * while still holding native memory.
+     */
+    private static void leaked(Ref ref)
+    {
+	leakCount.incrementAndGet();
+	if (leakDetection) {
+	    System.err.println("JMagick: " + ref.className
+			       + " was garbage-collected without being closed");
+	    if (ref.allocationSite != null) {
+		ref.allocationSite.printStackTrace();
+	    }
+	}
+    }
+
+    static void setLeakDetection(boolean enabled)
+    {
+	leakDetection = enabled;
+    }
+
+    static boolean isLeakDetection()
+    {
+	return leakDetection;
+    }
+
+    static long getLeakCount()
+    {
+	return leakCount.get();
+    }
+}
@@ -0,0 +1,217 @@
+package magick;
+
+/**
+ * A snapshot of the native memory held by JMagick: the handles of
+ * the live wrapper objects and the pixel cache bytes of the live
+ * images, as accounted by the native library, followed by the
+ * resource counters of ImageMagick itself.
+ *
+ * The pixel bytes are computed when an image handle is stored in a
+ * MagickImage, from the size of its frames, so they do not include
+ * the memory of images ImageMagick holds internally. Operations
+ * that change the storage of an image in place without replacing its
+ * handle, such as quantizeImage or rgbTransformImage, leave its count
+ * stale until the handle is next replaced or released. The *InPlace
+ * transforms replace the handle and are accounted for.
+ *
+ * @see Magick#getNativeStats()
+ */
+public class NativeStats implements NativeStatsMXBean {
+
+    /**
+     * Indexes of the counters returned by Magick.nativeStats. They
+     * must match the JMAGICK_STAT_* constants in jmagick.h; the
+     * handle counts come first, indexed by NativeCleaner kind - 1.
+     */
+    private static final int PIXEL_BYTES = 6;
+    private static final int PEAK_PIXEL_BYTES = 7;
+    private static final int MEMORY = 8;
+    private static final int MAP = 9;
+    private static final int DISK = 10;
+    private static final int AREA = 11;
+    private static final int THREADS = 12;
+    private static final int FILES = 13;
+
+    private final long[] stats;
+    private final long leakCount;
+
+    /**
+     * Constructor.
+     *
+     * @param stats the counters returned by Magick.nativeStats
+     * @param leakCount the number of leaked objects
+     */
+    NativeStats(long[] stats, long leakCount)
+    {
+	this.stats = stats;
+	this.leakCount = leakCount;
+    }
+
+    public long getImageCount()
+    {
+	return stats[NativeCleaner.IMAGE - 1];
+    }
+
+    public long getImageInfoCount()
+    {
+	return stats[NativeCleaner.IMAGE_INFO - 1];
+    }
+
+    public long getDrawInfoCount()
+    {
+	return stats[NativeCleaner.DRAW_INFO - 1];
+    }
+
+    public long getMontageInfoCount()
+    {
+	return stats[NativeCleaner.MONTAGE_INFO - 1];
+    }
+
+    public long getQuantizeInfoCount()
+    {
+	return stats[NativeCleaner.QUANTIZE_INFO - 1];
+    }
+
+    public long getCancelTokenCount()
+    {
+	return stats[NativeCleaner.CANCEL_TOKEN - 1];
+    }
+
+    public long getPixelBytes()
+    {
+	return stats[PIXEL_BYTES];
+    }
+
+    public long getPeakPixelBytes()
+    {
+	return stats[PEAK_PIXEL_BYTES];
+    }
+
+    public long getMemoryResource()
+    {
+	return stats[MEMORY];
+    }
+
+    public long getMapResource()
+    {
+	return stats[MAP];
+    }
+
+    public long getDiskResource()
+    {
+	return stats[DISK];
+    }
+
+    public long getAreaResource()
+    {
+	return stats[AREA];
+    }
+
+    public long getThreadResource()
+    {
+	return stats[THREADS];
+    }
+
+    public long getFileResource()
+    {
+	return stats[FILES];
+    }
+
+    public long getLeakCount()
+    {
+	return leakCount;
+    }
+
+    public String toString()
+    {
+	return "NativeStats[images=" + getImageCount()
+	    + ", pixelBytes=" + getPixelBytes()
+	    + ", peakPixelBytes=" + getPeakPixelBytes()
+	    + ", memory=" + getMemoryResource()
+	    + ", map=" + getMapResource()
+	    + ", disk=" + getDiskResource()
+	    + ", leaks=" + getLeakCount() + "]";
+    }
+
+    /**
+     * The MBean registered by Magick.registerNativeStatsMBean,
+     * which takes a new snapshot for every attribute read.
+     */
+    static class Live implements NativeStatsMXBean {
+
+	public long getImageCount()
+	{
+	    return Magick.getNativeStats().getImageCount();
+	}
+
+	public long getImageInfoCount()
+	{
+	    return Magick.getNativeStats().getImageInfoCount();
+	}
+
+	public long getDrawInfoCount()
+	{
+	    return Magick.getNativeStats().getDrawInfoCount();
+	}
+
+	public long getMontageInfoCount()
+	{
+	    return Magick.getNativeStats().getMontageInfoCount();
+	}
+
+	public long getQuantizeInfoCount()
+	{
+	    return Magick.getNativeStats().getQuantizeInfoCount();
+	}
+
+	public long getCancelTokenCount()
+	{
+	    return Magick.getNativeStats().getCancelTokenCount();
+	}
+
+	public long getPixelBytes()
+	{
+	    return Magick.getNativeStats().getPixelBytes();
+	}
+
+	public long getPeakPixelBytes()
+	{
+	    return Magick.getNativeStats().getPeakPixelBytes();
+	}
+
+	public long getMemoryResource()
+	{
+	    return Magick.getNativeStats().getMemoryResource();
+	}
+
+	public long getMapResource()
+	{
+	    return Magick.getNativeStats().getMapResource();
+	}
+
+	public long getDiskResource()
+	{
+	    return Magick.getNativeStats().getDiskResource();
+	}
+
+	public long getAreaResource()
+	{
+	    return Magick.getNativeStats().getAreaResource();
+	}
+
+	public long getThreadResource()
+	{
+	    return Magick.getNativeStats().getThreadResource();
+	}
+
+	public long getFileResource()
+	{
+	    return Magick.getNativeStats().getFileResource();
+	}
+
+	public long getLeakCount()
+	{
+	    return Magick.getLeakCount();
+	}
+    }
+}
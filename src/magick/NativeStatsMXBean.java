@@ -0,0 +1,85 @@
+package magick;
+
+/**
+ * Management interface of the native memory held by JMagick, as
+ * registered by Magick.registerNativeStatsMBean.
+ *
+ * @see NativeStats
+ */
+public interface NativeStatsMXBean {
+
+    /**
+     * @return the number of live MagickImage handles
+     */
+    long getImageCount();
+
+    /**
+     * @return the number of live ImageInfo handles
+     */
+    long getImageInfoCount();
+
+    /**
+     * @return the number of live DrawInfo handles
+     */
+    long getDrawInfoCount();
+
+    /**
+     * @return the number of live MontageInfo handles
+     */
+    long getMontageInfoCount();
+
+    /**
+     * @return the number of live QuantizeInfo handles
+     */
+    long getQuantizeInfoCount();
+
+    /**
+     * @return the number of live CancelToken handles
+     */
+    long getCancelTokenCount();
+
+    /**
+     * @return the pixel cache bytes of the live images
+     */
+    long getPixelBytes();
+
+    /**
+     * @return the highest value getPixelBytes has reached
+     */
+    long getPeakPixelBytes();
+
+    /**
+     * @return the ImageMagick memory resource in use, in bytes
+     */
+    long getMemoryResource();
+
+    /**
+     * @return the ImageMagick memory-mapped resource in use, in bytes
+     */
+    long getMapResource();
+
+    /**
+     * @return the ImageMagick disk resource in use, in bytes
+     */
+    long getDiskResource();
+
+    /**
+     * @return the ImageMagick pixel area resource in use, in pixels
+     */
+    long getAreaResource();
+
+    /**
+     * @return the ImageMagick thread resource
+     */
+    long getThreadResource();
+
+    /**
+     * @return the number of files opened by ImageMagick
+     */
+    long getFileResource();
+
+    /**
+     * @return the number of objects collected without being closed
+     */
+    long getLeakCount();
+}
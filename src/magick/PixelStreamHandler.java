@@ -0,0 +1,30 @@
+package magick;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Receives the pixels of an image decoded in stream mode by
+ * MagickImage.streamImage. The rows are delivered in bands as the
+ * decoder produces them, so the whole image is never held in memory.
+ *
+ * @see MagickImage#streamImage
+ */
+public interface PixelStreamHandler {
+
+    /**
+     * Called for each band of decoded rows.
+     *
+     * @param frame the index of the frame the rows belong to
+     * @param width the width of the frame in pixels
+     * @param height the height of the frame in pixels
+     * @param y the index of the first row in the band
+     * @param rows the number of rows in the band
+     * @param pixels the pixels of the band, one byte per map
+     *        component, row after row. The buffer is only valid
+     *        during the call.
+     * @return true to continue decoding, false to stop
+     */
+    public boolean pixelRows(int frame, int width, int height,
+			     int y, int rows, ByteBuffer pixels);
+
+}
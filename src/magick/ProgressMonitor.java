@@ -0,0 +1,34 @@
+package magick;
+
+/**
+ * Receives the progress of ImageMagick operations on an image, or of
+ * reads through an ImageInfo.
+ *
+ * The monitor is only called on the Java thread running the
+ * operation, never concurrently for one operation. Progress that
+ * ImageMagick reports on its own worker threads is not forwarded,
+ * so the monitor may see only some of the steps. An exception thrown
+ * by it cancels the operation.
+ *
+ * The image or ImageInfo holds the monitor until it is closed or the
+ * monitor is removed. A monitor that refers to its own image keeps
+ * that image from being garbage-collected, so such an image must be
+ * closed.
+ *
+ * @see MagickImage#setProgressMonitor
+ * @see ImageInfo#setProgressMonitor
+ */
+public interface ProgressMonitor {
+
+    /**
+     * Called as an operation progresses.
+     *
+     * @param tag the ImageMagick tag of the operation, for example
+     *        "Resize/Image"
+     * @param offset the amount of work done
+     * @param extent the total amount of work
+     * @return true to continue, false to cancel the operation
+     */
+    public boolean progress(String tag, long offset, long extent);
+
+}
@@ -6,13 +6,17 @@ package magick;
  * @author Eric Yeo
  *
  */
-public class QuantizeInfo extends Magick {
+public class QuantizeInfo extends Magick implements AutoCloseable {
 
     // Internal handle. Used as pointer to QuantizedInfo
     // structure in memory. We use long (64-bits) for
     // portibility.
     private long quantizeInfoHandle = 0;
 
+    {
+	registerCleaner(NativeCleaner.QUANTIZE_INFO);
+    }
+
     /**
      * Constructor.
      *
@@ -25,11 +29,14 @@ public class QuantizeInfo extends Magick {
     }
 
     /**
-     * Automated destructor.
+     * Release the native memory of the QuantizeInfo now rather than when
+     * it is garbage-collected. The object must not be used
+     * afterwards. Calling this method more than once has no effect.
      */
-    protected void finalize()
+    public void close()
     {
 	destroyQuantizeInfo();
+	cleanable.clean();
     }
 
     /**
@@ -0,0 +1,66 @@
+package magick;
+
+/**
+ * A resource limit set for the duration of a block of code, restored
+ * to its previous value by close():
+ *
+ * <pre>
+ * try (ResourceLimitOverride o =
+ *          Magick.overrideResourceLimit(ResourceType.DiskResource, 0)) {
+ *     ...
+ * }
+ * </pre>
+ *
+ * ImageMagick keeps a single set of limits for the whole process, so
+ * the override applies to every thread while it is in effect, and
+ * overrides of the same resource on different threads must not
+ * overlap. Overrides on one thread nest as expected.
+ *
+ * @see Magick#overrideResourceLimit(int, long)
+ */
+public class ResourceLimitOverride implements AutoCloseable {
+
+    private final int type;
+    private final long previousLimit;
+    private boolean closed = false;
+
+    /**
+     * Constructor. Sets the new limit.
+     *
+     * @param type the resource, one of ResourceType
+     * @param limit the limit in effect until close() is called
+     * @throws MagickException if the limit could not be set
+     */
+    ResourceLimitOverride(int type, long limit)
+	throws MagickException
+    {
+	this.type = type;
+	this.previousLimit = Magick.getResourceLimit(type);
+	Magick.setResourceLimit(type, limit);
+    }
+
+    /**
+     * Return the limit that close() restores.
+     *
+     * @return the limit in effect before the override
+     */
+    public long getPreviousLimit()
+    {
+	return previousLimit;
+    }
+
+    /**
+     * Restore the previous limit. Calling this method more than once
+     * has no effect.
+     *
+     * @throws MagickException if the limit could not be restored
+     */
+    public synchronized void close()
+	throws MagickException
+    {
+	if (!closed) {
+	    closed = true;
+	    Magick.setResourceLimit(type, previousLimit);
+	}
+    }
+}
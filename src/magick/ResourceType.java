@@ -0,0 +1,27 @@
+package magick;
+
+/**
+ * The resources whose use ImageMagick limits, for
+ * Magick.setResourceLimit and Magick.getResourceLimit.
+ *
+ * The values are JMagick's own: ImageMagick numbers its resources
+ * differently from one version to the next, so they are mapped
+ * natively.
+ *
+ * @see Magick#setResourceLimit(int, long)
+ */
+public interface ResourceType {
+
+    public final static int UndefinedResource = 0;
+    public final static int AreaResource = 1;	/* pixels of a single image held in memory */
+    public final static int DiskResource = 2;	/* bytes of disk-backed pixel caches */
+    public final static int FileResource = 3;	/* open pixel cache files */
+    public final static int MapResource = 4;	/* bytes of memory-mapped pixel caches */
+    public final static int MemoryResource = 5;	/* bytes of heap pixel caches */
+    public final static int ThreadResource = 6;	/* worker threads per operation */
+    public final static int TimeResource = 7;	/* seconds an operation may run */
+    public final static int ThrottleResource = 8;	/* milliseconds to sleep between operations */
+    public final static int WidthResource = 9;	/* maximum image width */
+    public final static int HeightResource = 10;	/* maximum image height */
+
+}
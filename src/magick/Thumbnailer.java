@@ -0,0 +1,187 @@
+package magick;
+
+/**
+ * Makes thumbnails in a single native call. The source is decoded with
+ * a size hint, so that the JPEG coder only decodes what the thumbnail
+ * needs, and then oriented upright, resized to fit inside the box
+ * (never enlarged), optionally sharpened, stripped of its profiles and
+ * comments, optionally flattened onto a background color and encoded.
+ * Each intermediate image is freed as soon as the next one exists, and
+ * no MagickImage is created:
+ *
+ * <pre>
+ * Thumbnailer thumbnailer = new Thumbnailer(320, 240)
+ *     .setQuality(85)
+ *     .setFormat("JPEG")
+ *     .setSharpen(0.5, 0.8, 0.05)
+ *     .setBackground("white");
+ * byte[] thumbnail = thumbnailer.thumbnail(upload);
+ * </pre>
+ *
+ * Only the first frame of a multi-frame source is used. A thumbnailer
+ * may be shared by several threads, but must not be reconfigured while
+ * it is in use.
+ */
+public class Thumbnailer {
+
+    private int width;
+    private int height;
+    private int filter = FilterType.UndefinedFilter;
+    private int quality = 0;
+    private String format = null;
+    private double sharpenSigma = 0.0;
+    private double sharpenAmount = 1.0;
+    private double sharpenThreshold = 0.05;
+    private String background = null;
+
+    /**
+     * Constructor.
+     *
+     * @param width the maximum width of a thumbnail
+     * @param height the maximum height of a thumbnail
+     */
+    public Thumbnailer(int width, int height)
+    {
+	setSize(width, height);
+    }
+
+    /**
+     * Set the box the thumbnails are fit into.
+     *
+     * @param width the maximum width of a thumbnail
+     * @param height the maximum height of a thumbnail
+     * @return this thumbnailer
+     */
+    public Thumbnailer setSize(int width, int height)
+    {
+	if (width <= 0 || height <= 0) {
+	    throw new IllegalArgumentException("Invalid thumbnail size "
+					       + width + "x" + height);
+	}
+	this.width = width;
+	this.height = height;
+	return this;
+    }
+
+    /**
+     * Set the resize filter.
+     *
+     * @param filter the filter, one of FilterType, or
+     *        FilterType.UndefinedFilter for the filter of the image
+     * @return this thumbnailer
+     */
+    public Thumbnailer setFilter(int filter)
+    {
+	this.filter = filter;
+	return this;
+    }
+
+    /**
+     * Set the compression quality of the thumbnails.
+     *
+     * @param quality the quality, 1 to 100, or 0 for the default
+     *        of the output format
+     * @return this thumbnailer
+     */
+    public Thumbnailer setQuality(int quality)
+    {
+	this.quality = quality;
+	return this;
+    }
+
+    /**
+     * Set the format of the thumbnails.
+     *
+     * @param format a format name such as "JPEG", or null to keep the
+     *        format of the source
+     * @return this thumbnailer
+     */
+    public Thumbnailer setFormat(String format)
+    {
+	this.format = format;
+	return this;
+    }
+
+    /**
+     * Sharpen the thumbnails with an unsharp mask after resizing.
+     *
+     * @param sigma the standard deviation of the Gaussian, or 0 to
+     *        not sharpen
+     * @param amount the fraction of the difference added back
+     * @param threshold the threshold, as a fraction of the maximum
+     *        intensity, below which differences are ignored
+     * @return this thumbnailer
+     * @see MagickImage#unsharpMaskImage(double, double, double, double)
+     */
+    public Thumbnailer setSharpen(double sigma, double amount,
+				  double threshold)
+    {
+	this.sharpenSigma = sigma;
+	this.sharpenAmount = amount;
+	this.sharpenThreshold = threshold;
+	return this;
+    }
+
+    /**
+     * Flatten transparent thumbnails onto a background color.
+     *
+     * @param color a color name such as "white" or "#ffffff", or null
+     *        to keep the transparency
+     * @return this thumbnailer
+     */
+    public Thumbnailer setBackground(String color)
+    {
+	this.background = color;
+	return this;
+    }
+
+    /**
+     * Make a thumbnail of an encoded image.
+     *
+     * @param blob the encoded image
+     * @return the encoded thumbnail
+     * @exception MagickException on errors
+     */
+    public byte[] thumbnail(byte[] blob)
+	throws MagickException
+    {
+	if (blob == null) {
+	    throw new MagickException("Blob is null");
+	}
+	return createThumbnail(blob, null, width, height, filter, quality,
+			       format, sharpenSigma, sharpenAmount,
+			       sharpenThreshold, background);
+    }
+
+    /**
+     * Make a thumbnail of an image file.
+     *
+     * @param fileName the name of the image file
+     * @return the encoded thumbnail
+     * @exception MagickException on errors
+     */
+    public byte[] thumbnail(String fileName)
+	throws MagickException
+    {
+	if (fileName == null) {
+	    throw new MagickException("File name is null");
+	}
+	return createThumbnail(null, fileName, width, height, filter, quality,
+			       format, sharpenSigma, sharpenAmount,
+			       sharpenThreshold, background);
+    }
+
+    /**
+     * Read, orient, resize, sharpen, strip, flatten and encode an image
+     * read from either a blob or a file.
+     */
+    private static native byte[] createThumbnail(byte[] blob,
+						 String fileName,
+						 int width, int height,
+						 int filter, int quality,
+						 String format,
+						 double sigma, double amount,
+						 double threshold,
+						 String background)
+	throws MagickException;
+}
@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include <time.h>
 #include <sys/types.h>
+#if defined(_WIN32)
+#    include <windows.h>
+#endif
 #if defined (IMAGEMAGICK_HEADER_STYLE_7)
 #    include <MagickCore/MagickCore.h>
 #else
@@ -11,6 +14,578 @@
 #endif
 #include "jmagick.h"
 
+/*
+ * Class, method and field IDs resolved in JNI_OnLoad.
+ */
+JMagickCache jmagickCache;
+
+
+
+/*
+ * Look up a class and pin it with a global reference.
+ *
+ * Input:
+ *   env        Java VM environment
+ *   className  fully qualified class name, e.g. "magick/MagickImage"
+ *
+ * Return:
+ *   A global reference to the class, or 0 if it cannot be found.
+ */
+static jclass findGlobalClass(JNIEnv *env, const char *className)
+{
+    jclass localClass, globalClass;
+
+    localClass = (*env)->FindClass(env, className);
+    if (localClass == 0) {
+#ifdef DIAGNOSTIC
+	fprintf(stderr, "JNI_OnLoad: Cannot find class %s\n", className);
+#endif
+	return 0;
+    }
+    globalClass = (jclass) (*env)->NewGlobalRef(env, localClass);
+    (*env)->DeleteLocalRef(env, localClass);
+    return globalClass;
+}
+
+
+
+/*
+ * Resolve every class, constructor and field ID the native library
+ * uses and keep them for the lifetime of the library.
+ */
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved)
+{
+    JNIEnv *env;
+    JMagickCache *c = &jmagickCache;
+    jclass cls;
+    jobject lock;
+
+    if ((*vm)->GetEnv(vm, (void **) &env, JNI_VERSION_1_4) != JNI_OK) {
+	return JNI_ERR;
+    }
+
+    memset(c, 0, sizeof(JMagickCache));
+    c->vm = vm;
+
+    /* Exceptions */
+    c->magickExceptionClass =
+	findGlobalClass(env, "magick/MagickException");
+    c->magickApiExceptionClass =
+	findGlobalClass(env, "magick/MagickApiException");
+    if (c->magickExceptionClass == 0 || c->magickApiExceptionClass == 0) {
+	return JNI_ERR;
+    }
+    c->magickApiExceptionCons =
+	(*env)->GetMethodID(env, c->magickApiExceptionClass, "<init>",
+			    "(ILjava/lang/String;Ljava/lang/String;)V");
+
+    /* MagickImage */
+    c->magickImageClass = findGlobalClass(env, "magick/MagickImage");
+    if (c->magickImageClass == 0) {
+	return JNI_ERR;
+    }
+    c->magickImageCons =
+	(*env)->GetMethodID(env, c->magickImageClass, "<init>", "()V");
+    c->magickImageHandle =
+	(*env)->GetFieldID(env, c->magickImageClass, "magickImageHandle", "J");
+    c->magickImageProgress =
+	(*env)->GetFieldID(env, c->magickImageClass,
+			   "progressMonitorHandle", "J");
+
+    /* Handles of the other wrapper classes. */
+    if ((cls = (*env)->FindClass(env, "magick/ImageInfo")) == 0) {
+	return JNI_ERR;
+    }
+    c->imageInfoHandle = (*env)->GetFieldID(env, cls, "imageInfoHandle", "J");
+    c->imageInfoProgress =
+	(*env)->GetFieldID(env, cls, "progressMonitorHandle", "J");
+    (*env)->DeleteLocalRef(env, cls);
+
+    if ((cls = (*env)->FindClass(env, "magick/DrawInfo")) == 0) {
+	return JNI_ERR;
+    }
+    c->drawInfoHandle = (*env)->GetFieldID(env, cls, "drawInfoHandle", "J");
+    (*env)->DeleteLocalRef(env, cls);
+
+    if ((cls = (*env)->FindClass(env, "magick/MontageInfo")) == 0) {
+	return JNI_ERR;
+    }
+    c->montageInfoHandle =
+	(*env)->GetFieldID(env, cls, "montageInfoHandle", "J");
+    (*env)->DeleteLocalRef(env, cls);
+
+    if ((cls = (*env)->FindClass(env, "magick/QuantizeInfo")) == 0) {
+	return JNI_ERR;
+    }
+    c->quantizeInfoHandle =
+	(*env)->GetFieldID(env, cls, "quantizeInfoHandle", "J");
+    (*env)->DeleteLocalRef(env, cls);
+
+    if ((cls = (*env)->FindClass(env, "magick/MagickInfo")) == 0) {
+	return JNI_ERR;
+    }
+    c->magickInfoHandle =
+	(*env)->GetFieldID(env, cls, "magickInfoHandle", "J");
+    (*env)->DeleteLocalRef(env, cls);
+
+    if ((cls = (*env)->FindClass(env, "magick/CancelToken")) == 0) {
+	return JNI_ERR;
+    }
+    c->cancelTokenHandle =
+	(*env)->GetFieldID(env, cls, "cancelTokenHandle", "J");
+    (*env)->DeleteLocalRef(env, cls);
+
+    /* Copies of the handles kept for the cleaner */
+    if ((cls = (*env)->FindClass(env, "magick/Magick")) == 0) {
+	return JNI_ERR;
+    }
+    c->magickCleanable =
+	(*env)->GetFieldID(env, cls, "cleanable",
+			   "Lmagick/NativeCleaner$Ref;");
+    (*env)->DeleteLocalRef(env, cls);
+
+    if ((cls = (*env)->FindClass(env, "magick/NativeCleaner$Ref")) == 0) {
+	return JNI_ERR;
+    }
+    c->cleanerRefHandle = (*env)->GetFieldID(env, cls, "handle", "J");
+    c->cleanerRefProgress =
+	(*env)->GetFieldID(env, cls, "progressHandle", "J");
+    c->cleanerRefBytes = (*env)->GetFieldID(env, cls, "bytes", "J");
+    (*env)->DeleteLocalRef(env, cls);
+
+    /* Lock of the native memory counters */
+    if ((cls = (*env)->FindClass(env, "java/lang/Object")) == 0) {
+	return JNI_ERR;
+    }
+    lock = (*env)->AllocObject(env, cls);
+    (*env)->DeleteLocalRef(env, cls);
+    if (lock == 0) {
+	return JNI_ERR;
+    }
+    c->statsLock = (*env)->NewGlobalRef(env, lock);
+    (*env)->DeleteLocalRef(env, lock);
+
+    /* PixelPacket */
+    c->pixelPacketClass = findGlobalClass(env, "magick/PixelPacket");
+    if (c->pixelPacketClass == 0) {
+	return JNI_ERR;
+    }
+    c->pixelPacketCons =
+	(*env)->GetMethodID(env, c->pixelPacketClass, "<init>", "(IIII)V");
+    c->pixelPacketRed =
+	(*env)->GetFieldID(env, c->pixelPacketClass, "red", "I");
+    c->pixelPacketGreen =
+	(*env)->GetFieldID(env, c->pixelPacketClass, "green", "I");
+    c->pixelPacketBlue =
+	(*env)->GetFieldID(env, c->pixelPacketClass, "blue", "I");
+    c->pixelPacketOpacity =
+	(*env)->GetFieldID(env, c->pixelPacketClass, "opacity", "I");
+
+    /* ProfileInfo */
+    c->profileInfoClass = findGlobalClass(env, "magick/ProfileInfo");
+    if (c->profileInfoClass == 0) {
+	return JNI_ERR;
+    }
+    c->profileInfoCons =
+	(*env)->GetMethodID(env, c->profileInfoClass, "<init>",
+			    "(Ljava/lang/String;[B)V");
+    c->profileInfoName =
+	(*env)->GetFieldID(env, c->profileInfoClass, "name",
+			   "Ljava/lang/String;");
+    c->profileInfoInfo =
+	(*env)->GetFieldID(env, c->profileInfoClass, "info", "[B");
+
+    /* TypeMetric */
+    c->typeMetricClass = findGlobalClass(env, "magick/TypeMetric");
+    if (c->typeMetricClass == 0) {
+	return JNI_ERR;
+    }
+    c->typeMetricCons =
+	(*env)->GetMethodID(env, c->typeMetricClass, "<init>",
+			    "(DD" "DDDDDDD" "DDDD" "DD)V");
+
+    /* java.awt.Dimension */
+    c->dimensionClass = findGlobalClass(env, "java/awt/Dimension");
+    if (c->dimensionClass == 0) {
+	return JNI_ERR;
+    }
+    c->dimensionCons =
+	(*env)->GetMethodID(env, c->dimensionClass, "<init>", "(II)V");
+
+    /* java.awt.Rectangle */
+    c->rectangleClass = findGlobalClass(env, "java/awt/Rectangle");
+    if (c->rectangleClass == 0) {
+	return JNI_ERR;
+    }
+    c->rectangleCons =
+	(*env)->GetMethodID(env, c->rectangleClass, "<init>", "(IIII)V");
+    c->rectangleX = (*env)->GetFieldID(env, c->rectangleClass, "x", "I");
+    c->rectangleY = (*env)->GetFieldID(env, c->rectangleClass, "y", "I");
+    c->rectangleWidth =
+	(*env)->GetFieldID(env, c->rectangleClass, "width", "I");
+    c->rectangleHeight =
+	(*env)->GetFieldID(env, c->rectangleClass, "height", "I");
+
+    /* java.lang.String */
+    c->stringClass = findGlobalClass(env, "java/lang/String");
+    if (c->stringClass == 0) {
+	return JNI_ERR;
+    }
+
+    /* java.io.InputStream */
+    if ((cls = (*env)->FindClass(env, "java/io/InputStream")) == 0) {
+	return JNI_ERR;
+    }
+    c->inputStreamRead = (*env)->GetMethodID(env, cls, "read", "([BII)I");
+    (*env)->DeleteLocalRef(env, cls);
+
+    /* java.io.OutputStream */
+    if ((cls = (*env)->FindClass(env, "java/io/OutputStream")) == 0) {
+	return JNI_ERR;
+    }
+    c->outputStreamWrite = (*env)->GetMethodID(env, cls, "write", "([BII)V");
+    (*env)->DeleteLocalRef(env, cls);
+
+    /* java.nio.channels.WritableByteChannel */
+    cls = (*env)->FindClass(env, "java/nio/channels/WritableByteChannel");
+    if (cls == 0) {
+	return JNI_ERR;
+    }
+    c->byteChannelWrite =
+	(*env)->GetMethodID(env, cls, "write", "(Ljava/nio/ByteBuffer;)I");
+    (*env)->DeleteLocalRef(env, cls);
+
+    /* magick.PixelStreamHandler */
+    if ((cls = (*env)->FindClass(env, "magick/PixelStreamHandler")) == 0) {
+	return JNI_ERR;
+    }
+    c->pixelStreamHandlerRows =
+	(*env)->GetMethodID(env, cls, "pixelRows",
+			    "(IIIIILjava/nio/ByteBuffer;)Z");
+    (*env)->DeleteLocalRef(env, cls);
+
+    /* magick.ProgressMonitor */
+    if ((cls = (*env)->FindClass(env, "magick/ProgressMonitor")) == 0) {
+	return JNI_ERR;
+    }
+    c->progressMonitorProgress =
+	(*env)->GetMethodID(env, cls, "progress", "(Ljava/lang/String;JJ)Z");
+    (*env)->DeleteLocalRef(env, cls);
+
+    /* Any failed method or field lookup leaves an exception pending. */
+    if ((*env)->ExceptionCheck(env)) {
+	return JNI_ERR;
+    }
+
+    return JNI_VERSION_1_4;
+}
+
+
+
+/*
+ * Release the global references taken in JNI_OnLoad.
+ */
+JNIEXPORT void JNICALL JNI_OnUnload(JavaVM *vm, void *reserved)
+{
+    JNIEnv *env;
+    JMagickCache *c = &jmagickCache;
+
+    if ((*vm)->GetEnv(vm, (void **) &env, JNI_VERSION_1_4) != JNI_OK) {
+	return;
+    }
+
+    if (c->magickExceptionClass != 0)
+	(*env)->DeleteGlobalRef(env, c->magickExceptionClass);
+    if (c->magickApiExceptionClass != 0)
+	(*env)->DeleteGlobalRef(env, c->magickApiExceptionClass);
+    if (c->magickImageClass != 0)
+	(*env)->DeleteGlobalRef(env, c->magickImageClass);
+    if (c->pixelPacketClass != 0)
+	(*env)->DeleteGlobalRef(env, c->pixelPacketClass);
+    if (c->profileInfoClass != 0)
+	(*env)->DeleteGlobalRef(env, c->profileInfoClass);
+    if (c->typeMetricClass != 0)
+	(*env)->DeleteGlobalRef(env, c->typeMetricClass);
+    if (c->dimensionClass != 0)
+	(*env)->DeleteGlobalRef(env, c->dimensionClass);
+    if (c->rectangleClass != 0)
+	(*env)->DeleteGlobalRef(env, c->rectangleClass);
+    if (c->stringClass != 0)
+	(*env)->DeleteGlobalRef(env, c->stringClass);
+
+    memset(c, 0, sizeof(JMagickCache));
+    c->vm = vm;
+}
+
+
+
+/*
+ * Map the name of a handle field to the field ID resolved in JNI_OnLoad.
+ *
+ * Input:
+ *   handleName  name of the handle field, e.g. "magickImageHandle"
+ *
+ * Return:
+ *   The cached field ID, or 0 if the handle is not known.
+ */
+static jfieldID getCachedHandleFieldID(const char *handleName)
+{
+    switch (handleName[0]) {
+    case 'm':
+	if (strcmp(handleName, "magickImageHandle") == 0)
+	    return jmagickCache.magickImageHandle;
+	if (strcmp(handleName, "montageInfoHandle") == 0)
+	    return jmagickCache.montageInfoHandle;
+	if (strcmp(handleName, "magickInfoHandle") == 0)
+	    return jmagickCache.magickInfoHandle;
+	break;
+    case 'i':
+	if (strcmp(handleName, "imageInfoHandle") == 0)
+	    return jmagickCache.imageInfoHandle;
+	break;
+    case 'd':
+	if (strcmp(handleName, "drawInfoHandle") == 0)
+	    return jmagickCache.drawInfoHandle;
+	break;
+    case 'q':
+	if (strcmp(handleName, "quantizeInfoHandle") == 0)
+	    return jmagickCache.quantizeInfoHandle;
+	break;
+    case 'c':
+	if (strcmp(handleName, "cancelTokenHandle") == 0)
+	    return jmagickCache.cancelTokenHandle;
+	break;
+    }
+    return 0;
+}
+
+
+
+/*
+ * Native memory held through the handles of live objects, guarded by
+ * jmagickCache.statsLock. Indexed by JMAGICK_HANDLE_* for the counts.
+ */
+static jlong liveHandles[JMAGICK_HANDLE_CANCEL_TOKEN + 1];
+static jlong livePixelBytes = 0;
+static jlong peakPixelBytes = 0;
+
+
+
+/*
+ * Return the JMAGICK_HANDLE_* kind of a handle field, or 0 for
+ * handles that are not accounted.
+ */
+static int getHandleKind(jfieldID handleFid)
+{
+    JMagickCache *c = &jmagickCache;
+
+    if (handleFid == c->magickImageHandle)
+	return JMAGICK_HANDLE_IMAGE;
+    if (handleFid == c->imageInfoHandle)
+	return JMAGICK_HANDLE_IMAGE_INFO;
+    if (handleFid == c->drawInfoHandle)
+	return JMAGICK_HANDLE_DRAW_INFO;
+    if (handleFid == c->montageInfoHandle)
+	return JMAGICK_HANDLE_MONTAGE_INFO;
+    if (handleFid == c->quantizeInfoHandle)
+	return JMAGICK_HANDLE_QUANTIZE_INFO;
+    if (handleFid == c->cancelTokenHandle)
+	return JMAGICK_HANDLE_CANCEL_TOKEN;
+    return 0;
+}
+
+
+
+/*
+ * Rotate or flip an image upright according to its orientation.
+ * Returns NULL, without an exception, if it already is.
+ */
+Image *getOrientedImage(Image *image, ExceptionInfo *exception)
+{
+    Image *oriented;
+
+    switch (image->orientation) {
+    case TopRightOrientation:
+	oriented = FlopImage(image, exception);
+	break;
+    case BottomRightOrientation:
+	oriented = RotateImage(image, 180.0, exception);
+	break;
+    case BottomLeftOrientation:
+	oriented = FlipImage(image, exception);
+	break;
+    case LeftTopOrientation:
+	oriented = TransposeImage(image, exception);
+	break;
+    case RightTopOrientation:
+	oriented = RotateImage(image, 90.0, exception);
+	break;
+    case RightBottomOrientation:
+	oriented = TransverseImage(image, exception);
+	break;
+    case LeftBottomOrientation:
+	oriented = RotateImage(image, 270.0, exception);
+	break;
+    default:
+	return NULL;
+    }
+    if (oriented != NULL) {
+	oriented->orientation = TopLeftOrientation;
+    }
+    return oriented;
+}
+
+
+
+/*
+ * Approximate size in bytes of the pixel caches of an image list.
+ */
+jlong getImagePixelBytes(Image *image)
+{
+    jlong bytes = 0;
+    jlong pixelSize;
+
+    for (; image != NULL; image = GetNextImageInList(image)) {
+#if MagickLibVersion < 0x700
+	pixelSize = sizeof(PixelPacket);
+	if (image->storage_class == PseudoClass
+	    || image->colorspace == CMYKColorspace) {
+	    pixelSize += sizeof(IndexPacket);
+	}
+#else
+	pixelSize = image->number_channels * sizeof(Quantum);
+#endif
+	bytes += (jlong) image->columns * image->rows * pixelSize;
+    }
+    return bytes;
+}
+
+
+
+/*
+ * Update the native memory counters for a handle replacing another.
+ * Either may be absent.
+ */
+static void accountHandle(JNIEnv *env,
+			  int kind,
+			  int released,
+			  jlong releasedBytes,
+			  int added,
+			  jlong addedBytes)
+{
+    (*env)->MonitorEnter(env, jmagickCache.statsLock);
+    if (released) {
+	liveHandles[kind]--;
+	livePixelBytes -= releasedBytes;
+    }
+    if (added) {
+	liveHandles[kind]++;
+	livePixelBytes += addedBytes;
+	if (livePixelBytes > peakPixelBytes) {
+	    peakPixelBytes = livePixelBytes;
+	}
+    }
+    (*env)->MonitorExit(env, jmagickCache.statsLock);
+}
+
+
+
+/*
+ * Remove from the native memory counters a handle released by the
+ * cleaner rather than through setHandle.
+ */
+void releaseAccountedHandle(JNIEnv *env, int kind, jlong bytes)
+{
+    accountHandle(env, kind, 1, bytes, 0, 0);
+}
+
+
+
+/*
+ * Copy the live handle counts and pixel bytes into stats.
+ */
+void getAccountedHandles(JNIEnv *env, jlong *stats)
+{
+    int kind;
+
+    (*env)->MonitorEnter(env, jmagickCache.statsLock);
+    for (kind = JMAGICK_HANDLE_IMAGE;
+	 kind <= JMAGICK_HANDLE_CANCEL_TOKEN;
+	 kind++) {
+	stats[kind - 1] = liveHandles[kind];
+    }
+    stats[JMAGICK_STAT_PIXEL_BYTES] = livePixelBytes;
+    stats[JMAGICK_STAT_PEAK_PIXEL_BYTES] = peakPixelBytes;
+    (*env)->MonitorExit(env, jmagickCache.statsLock);
+}
+
+
+
+/*
+ * Copy a handle just stored in an object into the object's cleaner
+ * reference, so that the cleaner can release the memory once the
+ * object has been collected, and account for the memory it holds.
+ * Handles the cleaner does not release are left alone.
+ *
+ * Input:
+ *   env        Java VM environment
+ *   obj        the object the handle was stored in
+ *   handleFid  field ID of the handle
+ *   handle     the new value of the handle
+ */
+static void mirrorHandle(JNIEnv *env,
+			 jobject obj,
+			 jfieldID handleFid,
+			 void *handle)
+{
+    JMagickCache *c = &jmagickCache;
+    jthrowable pending;
+    jobject ref;
+    jlong oldHandle, oldBytes, newBytes = 0;
+    int kind;
+
+    kind = getHandleKind(handleFid);
+    if (kind == 0
+	&& handleFid != c->magickImageProgress
+	&& handleFid != c->imageInfoProgress) {
+	return;
+    }
+
+    /* Handles are often stored while an exception is being thrown */
+    pending = (*env)->ExceptionOccurred(env);
+    if (pending != NULL) {
+	(*env)->ExceptionClear(env);
+    }
+
+    ref = (*env)->GetObjectField(env, obj, c->magickCleanable);
+    if (ref != NULL) {
+	if (kind == 0) {
+	    (*env)->SetLongField(env, ref, c->cleanerRefProgress,
+				 (jlong) handle);
+	}
+	else {
+	    oldHandle = (*env)->GetLongField(env, ref, c->cleanerRefHandle);
+	    oldBytes = (*env)->GetLongField(env, ref, c->cleanerRefBytes);
+	    if (handle != NULL && kind == JMAGICK_HANDLE_IMAGE) {
+		newBytes = getImagePixelBytes((Image *) handle);
+	    }
+	    accountHandle(env, kind, oldHandle != 0, oldBytes,
+			  handle != NULL, newBytes);
+	    (*env)->SetLongField(env, ref, c->cleanerRefHandle,
+				 (jlong) handle);
+	    (*env)->SetLongField(env, ref, c->cleanerRefBytes, newBytes);
+	}
+	(*env)->DeleteLocalRef(env, ref);
+    }
+
+    if (pending != NULL) {
+	(*env)->Throw(env, pending);
+	(*env)->DeleteLocalRef(env, pending);
+    }
+}
+
+
+
 #if MagickLibVersion >= 0x700
 MagickBooleanType LevelImageShim(Image *image,const char *levels)
 {
@@ -72,14 +647,7 @@ MagickBooleanType LevelImageShim(Image *image,const char *levels)
  */
 void throwMagickException(JNIEnv *env, const char *mesg)
 {
-    jclass magickExceptionClass;
-
-    magickExceptionClass = (*env)->FindClass(env, "magick/MagickException");
-    if (magickExceptionClass == 0) {
-	fprintf(stderr, "Cannot find MagickException class\n");
-	return;
-    }
-    (*env)->ThrowNew(env, magickExceptionClass, mesg);
+    (*env)->ThrowNew(env, jmagickCache.magickExceptionClass, mesg);
 }
 
 
@@ -95,8 +663,6 @@ void throwMagickApiException(JNIEnv *env,
 			     const char *mesg,
 			     const ExceptionInfo *exception)
 {
-    jclass magickApiExceptionClass;
-    jmethodID consMethodID = 0;
     jobject newObj;
     jstring jreason, jdescription;
     int result;
@@ -105,23 +671,6 @@ void throwMagickApiException(JNIEnv *env,
 	fprintf(stderr, "throwMagickApiException reason: %s - desc: %s \n", exception->reason, exception->description);
 #endif
 
-    /* Find the class ID */
-    magickApiExceptionClass =
-	(*env)->FindClass(env, "magick/MagickApiException");
-    if (magickApiExceptionClass == 0) {
-	fprintf(stderr, "Cannot find MagickApiException class\n");
-	return;
-    }
-
-    /* Find the constructor ID */
-    consMethodID =
-	(*env)->GetMethodID(env, magickApiExceptionClass,
-			    "<init>",
-			    "(ILjava/lang/String;Ljava/lang/String;)V");
-    if (consMethodID == 0) {
-	return;
-    }
-
     /* Obtain the string objects */
     jreason = (*env)->NewStringUTF(env, exception->reason != NULL ? exception->reason : "");
     if (jreason == NULL) {
@@ -144,7 +693,8 @@ void throwMagickApiException(JNIEnv *env,
     }
 
     /* Create the MagickApiException object */
-    newObj = (*env)->NewObject(env, magickApiExceptionClass, consMethodID,
+    newObj = (*env)->NewObject(env, jmagickCache.magickApiExceptionClass,
+                               jmagickCache.magickApiExceptionCons,
 			       exception->severity,
                                jreason, jdescription);
     if (newObj == NULL) {
@@ -190,23 +740,24 @@ void *getHandle(JNIEnv *env,
     jfieldID handleFid;
 
     /* Retrieve the field ID of the handle */
-    if (fieldId == NULL) {
-	objClass = (*env)->GetObjectClass(env, obj);
-	if (objClass == 0) {
-	    return NULL;
-	}
-	handleFid = (*env)->GetFieldID(env, objClass, handleName, "J");
-    }
-    else if (*fieldId == 0) {
-	objClass = (*env)->GetObjectClass(env, obj);
-	if (objClass == 0) {
-	    return NULL;
-	}
-	handleFid = *fieldId =
-	    (*env)->GetFieldID(env, objClass, handleName, "J");
+    if (fieldId != NULL && *fieldId != 0) {
+	handleFid = *fieldId;
     }
     else {
-	handleFid = *fieldId;
+	handleFid = getCachedHandleFieldID(handleName);
+	if (handleFid == 0) {
+	    objClass = (*env)->GetObjectClass(env, obj);
+	    if (objClass == 0) {
+		return NULL;
+	    }
+	    handleFid = (*env)->GetFieldID(env, objClass, handleName, "J");
+	    if (handleFid == 0) {
+		return NULL;
+	    }
+	}
+	if (fieldId != NULL) {
+	    *fieldId = handleFid;
+	}
     }
 
     return (void*) (*env)->GetLongField(env, obj, handleFid);
@@ -241,29 +792,31 @@ int setHandle(JNIEnv *env,
     jfieldID handleFid;
 
     /* Retrieve the field ID of the handle */
-    if (fieldId == NULL) {
-	objClass = (*env)->GetObjectClass(env, obj);
-	if (objClass == 0) {
-	    return 0;
-	}
-	handleFid = (*env)->GetFieldID(env, objClass, handleName, "J");
-    }
-    else if (fieldId == 0) {
-	objClass = (*env)->GetObjectClass(env, obj);
-	if (objClass == 0) {
-	    return 0;
-	}
-	handleFid = *fieldId =
-	    (*env)->GetFieldID(env, objClass, handleName, "J");
-    }
-    else {
+    if (fieldId != NULL && *fieldId != 0) {
 	handleFid = *fieldId;
     }
-    if (handleFid == 0) {
-	return 0;
+    else {
+	handleFid = getCachedHandleFieldID(handleName);
+	if (handleFid == 0) {
+	    objClass = (*env)->GetObjectClass(env, obj);
+	    if (objClass == 0) {
+		return 0;
+	    }
+	    handleFid = (*env)->GetFieldID(env, objClass, handleName, "J");
+	    if (handleFid == 0) {
+		return 0;
+	    }
+	}
+	if (fieldId != NULL) {
+	    *fieldId = handleFid;
+	}
     }
 
     (*env)->SetLongField(env, obj, handleFid, (jlong) handle);
+    mirrorHandle(env, obj, handleFid, handle);
+    if (handle != NULL && handleFid == jmagickCache.magickImageHandle) {
+	dropInheritedProgressMonitors(env, obj, (Image *) handle);
+    }
 
     return 1;
 }
@@ -647,19 +1200,15 @@ unsigned char* getByteArrayFieldValue(JNIEnv *env,
  */
 int getRectangle(JNIEnv *env, jobject jRect, RectangleInfo *iRect)
 {
-	jint width, height, x, y;
-    int retVal =
-		getIntFieldValue(env, jRect, "width", NULL, (jint *) &width) &&
-		getIntFieldValue(env, jRect, "height", NULL, (jint *) &height) &&
-		getIntFieldValue(env, jRect, "x", NULL, (jint *) &x) &&
-		getIntFieldValue(env, jRect, "y", NULL, (jint *) &y);
-	if (retVal) {
-		iRect->width = width;
-		iRect->height = height;
-		iRect->x = x;
-		iRect->y = y;
-	}
-	return retVal;
+    if (jRect == NULL) {
+	return 0;
+    }
+    iRect->width = (*env)->GetIntField(env, jRect, jmagickCache.rectangleWidth);
+    iRect->height =
+	(*env)->GetIntField(env, jRect, jmagickCache.rectangleHeight);
+    iRect->x = (*env)->GetIntField(env, jRect, jmagickCache.rectangleX);
+    iRect->y = (*env)->GetIntField(env, jRect, jmagickCache.rectangleY);
+    return 1;
 }
 
 
@@ -689,18 +1238,14 @@ int getPixelPacket(JNIEnv *env,
 {
   jint red, green, blue, transparency;
 
-  int successful =
-	getIntFieldValue(env, jPixel, "red", NULL,
-                         &red) &&
-	getIntFieldValue(env, jPixel, "green", NULL,
-                         &green) &&
-        getIntFieldValue(env, jPixel, "blue", NULL,
-                         &blue) &&
-	getIntFieldValue(env, jPixel, "opacity", NULL,
-                         &transparency);
-  if (!successful) {
-      return successful;
+  if (jPixel == NULL) {
+      return 0;
   }
+  red = (*env)->GetIntField(env, jPixel, jmagickCache.pixelPacketRed);
+  green = (*env)->GetIntField(env, jPixel, jmagickCache.pixelPacketGreen);
+  blue = (*env)->GetIntField(env, jPixel, jmagickCache.pixelPacketBlue);
+  transparency =
+      (*env)->GetIntField(env, jPixel, jmagickCache.pixelPacketOpacity);
   iPixel->red = (Quantum) red;
   iPixel->green = (Quantum) green;
   iPixel->blue = (Quantum) blue;
@@ -710,7 +1255,7 @@ int getPixelPacket(JNIEnv *env,
   iPixel->alpha =
 #endif
     (Quantum) transparency;
-  return successful;
+  return 1;
 }
 
 
@@ -733,34 +1278,56 @@ int getPixelPacket(JNIEnv *env,
  */
 jobject newImageObject(JNIEnv *env, Image* image)
 {
-    jclass magickImageClass = 0;
-    jmethodID consMethodID = 0;
     jobject newObj;
 
-    magickImageClass = (*env)->FindClass(env, "magick/MagickImage");
-    if (magickImageClass == 0) {
+    newObj = (*env)->NewObject(env, jmagickCache.magickImageClass,
+                               jmagickCache.magickImageCons);
+    if (newObj == NULL) {
 	return NULL;
     }
 
-    consMethodID = (*env)->GetMethodID(env, magickImageClass,
-				       "<init>", "()V");
-    if (consMethodID == 0) {
-	return NULL;
-    }
+    setHandle(env, newObj, "magickImageHandle", (void *) image,
+	      &jmagickCache.magickImageHandle);
 
-    newObj = (*env)->NewObject(env, magickImageClass, consMethodID);
-    if (newObj == NULL) {
-	return NULL;
-    }
+    return newObj;
+}
 
-    if (!setHandle(env, newObj, "magickImageHandle", (void*) image, NULL)) {
-#ifdef DIAGNOSTIC
-	fprintf(stderr, "newImageObject: Unable to set handle\n");
+
+
+
+/*
+ * Size in bytes of one component of the given storage type, as
+ * read and written by ImportImagePixels and ExportImagePixels.
+ *
+ * Return:
+ *   the size, or 0 if the storage type is not known
+ */
+size_t getStorageTypeSize(int storageType)
+{
+    switch ((StorageType) storageType) {
+    case CharPixel:
+	return sizeof(unsigned char);
+    case ShortPixel:
+	return sizeof(unsigned short);
+#if MagickLibVersion < 0x700
+    case IntegerPixel:
+    case LongPixel:
+	return sizeof(unsigned int);
+#else
+    case LongPixel:
+	return sizeof(unsigned int);
+    case LongLongPixel:
+	return sizeof(MagickSizeType);
 #endif
-	return NULL;
+    case FloatPixel:
+	return sizeof(float);
+    case DoublePixel:
+	return sizeof(double);
+    case QuantumPixel:
+	return sizeof(Quantum);
+    default:
+	return 0;
     }
-
-    return newObj;
 }
 
 
@@ -813,8 +1380,10 @@ void setProfileInfo(JNIEnv *env, ProfileInfo *profileInfo, jobject profileObj)
         return;
     }
 
-    name = getStringFieldValue(env, profileObj, "name", NULL);
-    info = getByteArrayFieldValue(env, profileObj, "info", NULL, &infoSize);
+    name = getStringFieldValue(env, profileObj, "name",
+                               &jmagickCache.profileInfoName);
+    info = getByteArrayFieldValue(env, profileObj, "info",
+                                  &jmagickCache.profileInfoInfo, &infoSize);
     if (profileInfo->name != NULL) {
         RelinquishMagickMemory(profileInfo->name);
     }
@@ -839,30 +1408,11 @@ void setProfileInfo(JNIEnv *env, ProfileInfo *profileInfo, jobject profileObj)
  */
 jobject getProfileInfo(JNIEnv *env, ProfileInfo *profileInfo)
 {
-    jclass profileInfoClass;
-    jmethodID consMethodID;
     jobject profileObject;
     jstring name;
     jbyteArray byteArray;
     unsigned char *byteElements;
 
-    /* Get the ProfileInfo class ID */
-    profileInfoClass = (*env)->FindClass(env, "magick/ProfileInfo");
-    if (profileInfoClass == 0) {
-        throwMagickException(env, "Unable to locate class "
-                                   "magick.ProfileInfo");
-        return NULL;
-    }
-
-    /* Get the constructor method ID */
-    consMethodID = (*env)->GetMethodID(env, profileInfoClass,
-                                       "<init>", "(Ljava/lang/String;[B)V");
-    if (consMethodID == 0) {
-        throwMagickException(env, "Unable to locate constructor "
-                                  "ProfileInfo(String, byte[])");
-        return NULL;
-    }
-
     /* Construct the name */
     if (profileInfo->name != NULL) {
         name = (*env)->NewStringUTF(env, profileInfo->name);
@@ -901,7 +1451,8 @@ jobject getProfileInfo(JNIEnv *env, ProfileInfo *profileInfo)
     }
 
     /* Construct the ProfileInfo object */
-    profileObject = (*env)->NewObject(env, profileInfoClass, consMethodID,
+    profileObject = (*env)->NewObject(env, jmagickCache.profileInfoClass,
+                                      jmagickCache.profileInfoCons,
                                       name, byteArray);
     if (profileObject == NULL) {
         throwMagickException(env, "Unable to construct ProfileInfo object");
@@ -910,3 +1461,171 @@ jobject getProfileInfo(JNIEnv *env, ProfileInfo *profileInfo)
 
     return profileObject;
 }
+
+
+
+/*
+ * Milliseconds of a monotonic clock, for cancel token deadlines.
+ */
+jlong currentTimeMillis(void)
+{
+#if defined(_WIN32)
+    return (jlong) GetTickCount64();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (jlong) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+}
+
+
+
+/*
+ * Return non-zero if the cancel token was cancelled or its deadline
+ * has passed.
+ */
+int isCancelTokenSet(JMagickCancelToken *cancel)
+{
+    if (cancel->cancelled) {
+	return 1;
+    }
+    if (cancel->deadline != 0 && currentTimeMillis() >= cancel->deadline) {
+	cancel->cancelled = 1;
+	return 1;
+    }
+    return 0;
+}
+
+
+
+/*
+ * Create the client data of a progress monitor.
+ *
+ * Input:
+ *   env       Java VM environment
+ *   monitor   a magick.ProgressMonitor, or null
+ *   token     a magick.CancelToken, or null
+ *
+ * Return:
+ *   the client data, or NULL if both monitor and token are null or
+ *   memory could not be allocated
+ */
+JMagickProgress *newProgressMonitor(JNIEnv *env,
+				    jobject monitor,
+				    jobject token)
+{
+    JMagickProgress *progress;
+
+    if (monitor == NULL && token == NULL) {
+	return NULL;
+    }
+    progress = (JMagickProgress *) AcquireMagickMemory(sizeof(*progress));
+    if (progress == NULL) {
+	return NULL;
+    }
+    progress->monitor = NULL;
+    progress->token = NULL;
+    progress->cancel = NULL;
+    if (monitor != NULL) {
+	progress->monitor = (*env)->NewGlobalRef(env, monitor);
+    }
+    if (token != NULL) {
+	/* The global reference keeps the token, and its handle, alive. */
+	progress->token = (*env)->NewGlobalRef(env, token);
+	progress->cancel = (JMagickCancelToken *)
+	    getHandle(env, token, "cancelTokenHandle", NULL);
+    }
+    return progress;
+}
+
+
+
+/*
+ * Release the client data of a progress monitor.
+ */
+void destroyProgressMonitor(JNIEnv *env, JMagickProgress *progress)
+{
+    if (progress == NULL) {
+	return;
+    }
+    if (progress->monitor != NULL) {
+	(*env)->DeleteGlobalRef(env, progress->monitor);
+    }
+    if (progress->token != NULL) {
+	(*env)->DeleteGlobalRef(env, progress->token);
+    }
+    RelinquishMagickMemory(progress);
+}
+
+
+
+/*
+ * The ImageMagick progress monitor installed by JMagick. It stops the
+ * operation once the cancel token is set, and otherwise forwards the
+ * progress to the Java monitor. ImageMagick also calls it from its
+ * worker threads; those are not attached to the Java VM, which would
+ * keep a java.lang.Thread alive for each pool thread, so only the
+ * progress reported on a Java thread reaches the Java monitor.
+ */
+MagickBooleanType monitorProgress(const char *tag,
+				  const MagickOffsetType offset,
+				  const MagickSizeType extent,
+				  void *clientData)
+{
+    JMagickProgress *progress = (JMagickProgress *) clientData;
+    JavaVM *vm = jmagickCache.vm;
+    JNIEnv *env;
+    jstring jtag;
+    jboolean proceed;
+
+    if (progress->cancel != NULL && isCancelTokenSet(progress->cancel)) {
+	return MagickFalse;
+    }
+    if (progress->monitor == NULL) {
+	return MagickTrue;
+    }
+
+    if ((*vm)->GetEnv(vm, (void **) &env, JNI_VERSION_1_4) != JNI_OK) {
+	return MagickTrue;
+    }
+    if ((*env)->ExceptionCheck(env)) {
+	return MagickFalse;
+    }
+
+    jtag = (*env)->NewStringUTF(env, tag);
+    proceed = (*env)->CallBooleanMethod(env, progress->monitor,
+					jmagickCache.progressMonitorProgress,
+					jtag, (jlong) offset, (jlong) extent);
+    (*env)->DeleteLocalRef(env, jtag);
+
+    /*
+     * An exception cannot propagate through ImageMagick; it cancels
+     * the operation instead.
+     */
+    if ((*env)->ExceptionCheck(env)) {
+	(*env)->ExceptionClear(env);
+	return MagickFalse;
+    }
+    return proceed ? MagickTrue : MagickFalse;
+}
+
+
+
+/*
+ * Remove the progress monitors an image list inherited from the image
+ * or ImageInfo it was created from, except the one owned by obj.
+ */
+void dropInheritedProgressMonitors(JNIEnv *env, jobject obj, Image *image)
+{
+    void *own;
+
+    own = (void *) (*env)->GetLongField(env, obj,
+					jmagickCache.magickImageProgress);
+    for (; image != NULL; image = GetNextImageInList(image)) {
+	if (image->progress_monitor == monitorProgress &&
+	    image->client_data != own) {
+	    SetImageProgressMonitor(image, (MagickProgressMonitor) NULL, NULL);
+	}
+    }
+}
@@ -29,6 +29,240 @@ struct _ProfileInfo
 #endif
 
 
+/*
+ * Class, method and field IDs used by the native library. These are
+ * resolved once in JNI_OnLoad and pinned with global references, so
+ * the helpers below do not have to call FindClass, GetMethodID or
+ * GetFieldID for every call.
+ */
+typedef struct {
+    /* magick.MagickException and magick.MagickApiException */
+    jclass magickExceptionClass;
+    jclass magickApiExceptionClass;
+    jmethodID magickApiExceptionCons;
+
+    /* magick.MagickImage */
+    jclass magickImageClass;
+    jmethodID magickImageCons;
+
+    /* Native handles of the wrapper objects */
+    jfieldID magickImageHandle;
+    jfieldID imageInfoHandle;
+    jfieldID drawInfoHandle;
+    jfieldID montageInfoHandle;
+    jfieldID quantizeInfoHandle;
+    jfieldID magickInfoHandle;
+    jfieldID cancelTokenHandle;
+
+    /* magick.PixelPacket */
+    jclass pixelPacketClass;
+    jmethodID pixelPacketCons;
+    jfieldID pixelPacketRed;
+    jfieldID pixelPacketGreen;
+    jfieldID pixelPacketBlue;
+    jfieldID pixelPacketOpacity;
+
+    /* magick.ProfileInfo */
+    jclass profileInfoClass;
+    jmethodID profileInfoCons;
+    jfieldID profileInfoName;
+    jfieldID profileInfoInfo;
+
+    /* magick.TypeMetric */
+    jclass typeMetricClass;
+    jmethodID typeMetricCons;
+
+    /* java.awt.Dimension */
+    jclass dimensionClass;
+    jmethodID dimensionCons;
+
+    /* java.awt.Rectangle */
+    jclass rectangleClass;
+    jmethodID rectangleCons;
+    jfieldID rectangleX;
+    jfieldID rectangleY;
+    jfieldID rectangleWidth;
+    jfieldID rectangleHeight;
+
+    /* java.lang.String */
+    jclass stringClass;
+
+    /* java.io.InputStream.read(byte[], int, int) */
+    jmethodID inputStreamRead;
+
+    /* java.io.OutputStream.write(byte[], int, int) */
+    jmethodID outputStreamWrite;
+
+    /* java.nio.channels.WritableByteChannel.write(ByteBuffer) */
+    jmethodID byteChannelWrite;
+
+    /* magick.PixelStreamHandler.pixelRows(...) */
+    jmethodID pixelStreamHandlerRows;
+
+    /* The Java VM, to attach ImageMagick worker threads */
+    JavaVM *vm;
+
+    /* Progress monitor handles of magick.MagickImage and magick.ImageInfo */
+    jfieldID magickImageProgress;
+    jfieldID imageInfoProgress;
+
+    /* magick.ProgressMonitor.progress(String, long, long) */
+    jmethodID progressMonitorProgress;
+
+    /* magick.Magick.cleanable and the handle copies of its reference */
+    jfieldID magickCleanable;
+    jfieldID cleanerRefHandle;
+    jfieldID cleanerRefProgress;
+    jfieldID cleanerRefBytes;
+
+    /* Lock of the native memory counters */
+    jobject statsLock;
+} JMagickCache;
+
+/*
+ * Kinds of native memory released by magick.Magick.destroyHandles,
+ * as numbered in magick.NativeCleaner.
+ */
+#define JMAGICK_HANDLE_IMAGE          1
+#define JMAGICK_HANDLE_IMAGE_INFO     2
+#define JMAGICK_HANDLE_DRAW_INFO      3
+#define JMAGICK_HANDLE_MONTAGE_INFO   4
+#define JMAGICK_HANDLE_QUANTIZE_INFO  5
+#define JMAGICK_HANDLE_CANCEL_TOKEN   6
+
+/*
+ * Indexes of the counters returned by magick.Magick.nativeStats, as
+ * numbered in magick.NativeStats.
+ */
+#define JMAGICK_STAT_PIXEL_BYTES       6
+#define JMAGICK_STAT_PEAK_PIXEL_BYTES  7
+#define JMAGICK_STAT_MEMORY            8
+#define JMAGICK_STAT_MAP               9
+#define JMAGICK_STAT_DISK             10
+#define JMAGICK_STAT_AREA             11
+#define JMAGICK_STAT_THREADS          12
+#define JMAGICK_STAT_FILES            13
+#define JMAGICK_STAT_COUNT            14
+
+/*
+ * The IDs resolved in JNI_OnLoad. Read-only after the library is loaded.
+ */
+extern JMagickCache jmagickCache;
+
+
+/*
+ * Native state of a magick.CancelToken. The deadline is in
+ * milliseconds of a monotonic clock, 0 for none.
+ */
+typedef struct {
+    volatile int cancelled;
+    jlong deadline;
+} JMagickCancelToken;
+
+/*
+ * Client data of the progress monitor installed on an image or
+ * ImageInfo: a global reference to the Java monitor and to the
+ * cancel token, either of which may be null.
+ */
+typedef struct {
+    jobject monitor;
+    jobject token;
+    JMagickCancelToken *cancel;
+} JMagickProgress;
+
+/*
+ * Milliseconds of a monotonic clock, for cancel token deadlines.
+ */
+jlong currentTimeMillis(void);
+
+/*
+ * Return non-zero if the cancel token was cancelled or its deadline
+ * has passed.
+ */
+int isCancelTokenSet(JMagickCancelToken *cancel);
+
+/*
+ * Create the client data of a progress monitor.
+ *
+ * Input:
+ *   env       Java VM environment
+ *   monitor   a magick.ProgressMonitor, or null
+ *   token     a magick.CancelToken, or null
+ *
+ * Return:
+ *   the client data, or NULL if both monitor and token are null or
+ *   memory could not be allocated
+ */
+JMagickProgress *newProgressMonitor(JNIEnv *env,
+				    jobject monitor,
+				    jobject token);
+
+/*
+ * Release the client data of a progress monitor.
+ */
+void destroyProgressMonitor(JNIEnv *env, JMagickProgress *progress);
+
+/*
+ * The ImageMagick progress monitor installed by JMagick. It stops the
+ * operation once the cancel token is set, and otherwise forwards the
+ * progress to the Java monitor. On ImageMagick worker threads, which
+ * are not attached to the Java VM, only the cancel token is checked.
+ */
+MagickBooleanType monitorProgress(const char *tag,
+				  const MagickOffsetType offset,
+				  const MagickSizeType extent,
+				  void *clientData);
+
+/*
+ * Remove the progress monitors an image list inherited from the image
+ * or ImageInfo it was created from, except the one owned by obj.
+ * Their client data belongs to another Java object and may be
+ * released before this image.
+ *
+ * Input:
+ *   env     Java VM environment
+ *   obj     the magick.MagickImage the image list is stored in
+ *   image   the image list
+ */
+void dropInheritedProgressMonitors(JNIEnv *env, jobject obj, Image *image);
+
+
+/*
+ * Rotate or flip an image upright according to its orientation.
+ *
+ * Return:
+ *   the upright image, or NULL if the image already is upright or the
+ *   operation failed, as reported in exception
+ */
+Image *getOrientedImage(Image *image, ExceptionInfo *exception);
+
+/*
+ * Approximate size in bytes of the pixel caches of an image list.
+ */
+jlong getImagePixelBytes(Image *image);
+
+/*
+ * Remove from the native memory counters a handle released by the
+ * cleaner rather than through setHandle.
+ *
+ * Input:
+ *   env     Java VM environment
+ *   kind    the kind of handle, one of JMAGICK_HANDLE_*
+ *   bytes   the pixel bytes accounted for the handle
+ */
+void releaseAccountedHandle(JNIEnv *env, int kind, jlong bytes);
+
+/*
+ * Copy the native memory counters, the live handles of each kind
+ * followed by the current and peak pixel bytes, into stats.
+ *
+ * Input:
+ *   env     Java VM environment
+ *   stats   at least JMAGICK_STAT_MEMORY elements
+ */
+void getAccountedHandles(JNIEnv *env, jlong *stats);
+
+
 /*
  * Convenience function to help throw an MagickException.
  */
@@ -213,6 +447,16 @@ int getPixelPacket(JNIEnv *env,
 jobject newImageObject(JNIEnv *env, Image* image);
 
 
+/*
+ * Size in bytes of one component of the given storage type, as
+ * read and written by ImportImagePixels and ExportImagePixels.
+ *
+ * Return:
+ *   the size, or 0 if the storage type is not known
+ */
+size_t getStorageTypeSize(int storageType);
+
+
 
 /*
  * Set a attribute in a generic handle to string.
@@ -528,8 +772,6 @@ JNIEXPORT jobject JNICALL funcName                                            \
 {                                                                             \
     handleType *info = NULL;                                                  \
     jobject jPixelPacket = NULL;                                              \
-    jclass pixelPacketClass;                                                  \
-    jmethodID consMethodID;                                                   \
                                                                               \
     info = (handleType *) getHandle(env, self, handleName, NULL);             \
     if (info == NULL) {                                                       \
@@ -537,21 +779,8 @@ JNIEXPORT jobject JNICALL funcName                                            \
 	return NULL;                                                          \
     }                                                                         \
                                                                               \
-    pixelPacketClass = (*env)->FindClass(env, "magick/PixelPacket");          \
-    if (pixelPacketClass == 0) {                                              \
-	throwMagickException(env,                                             \
-			     "Unable to locate class magick.PixelPacket");    \
-	return NULL;                                                          \
-    }                                                                         \
-                                                                              \
-    consMethodID = (*env)->GetMethodID(env, pixelPacketClass,                 \
-				       "<init>", "(IIII)V");                  \
-    if (consMethodID == 0) {                                                  \
-	throwMagickException(env, "Unable to construct magick.PixelPacket");  \
-	return NULL;                                                          \
-    }                                                                         \
-                                                                              \
-    jPixelPacket = (*env)->NewObject(env, pixelPacketClass, consMethodID,     \
+    jPixelPacket = (*env)->NewObject(env, jmagickCache.pixelPacketClass,      \
+                                     jmagickCache.pixelPacketCons,            \
 		                     (jint) info->fieldName.red,              \
 		                     (jint) info->fieldName.green,            \
 		                     (jint) info->fieldName.blue,             \
@@ -570,8 +799,6 @@ JNIEXPORT jobject JNICALL funcName                                            \
 {                                                                             \
     handleType *info = NULL;                                                  \
     jobject jPixelPacket = NULL;                                              \
-    jclass pixelPacketClass;                                                  \
-    jmethodID consMethodID;                                                   \
                                                                               \
     info = (handleType *) getHandle(env, self, handleName, NULL);             \
     if (info == NULL) {                                                       \
@@ -579,21 +806,8 @@ JNIEXPORT jobject JNICALL funcName                                            \
 	return NULL;                                                          \
     }                                                                         \
                                                                               \
-    pixelPacketClass = (*env)->FindClass(env, "magick/PixelPacket");          \
-    if (pixelPacketClass == 0) {                                              \
-	throwMagickException(env,                                             \
-			     "Unable to locate class magick.PixelPacket");    \
-	return NULL;                                                          \
-    }                                                                         \
-                                                                              \
-    consMethodID = (*env)->GetMethodID(env, pixelPacketClass,                 \
-				       "<init>", "(IIII)V");                  \
-    if (consMethodID == 0) {                                                  \
-	throwMagickException(env, "Unable to construct magick.PixelPacket");  \
-	return NULL;                                                          \
-    }                                                                         \
-                                                                              \
-    jPixelPacket = (*env)->NewObject(env, pixelPacketClass, consMethodID,     \
+    jPixelPacket = (*env)->NewObject(env, jmagickCache.pixelPacketClass,      \
+                                     jmagickCache.pixelPacketCons,            \
 		                     (jint) info->fieldName.red,              \
 		                     (jint) info->fieldName.green,            \
 		                     (jint) info->fieldName.blue,             \
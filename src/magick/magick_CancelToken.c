@@ -0,0 +1,88 @@
+#include <jni.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+#if defined (IMAGEMAGICK_HEADER_STYLE_7)
+#    include <MagickCore/MagickCore.h>
+#else
+#    include <magick/api.h>
+#endif
+#include "magick_CancelToken.h"
+#include "jmagick.h"
+
+/*
+ * Class:     magick_CancelToken
+ * Method:    init
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_magick_CancelToken_init
+  (JNIEnv *env, jobject self, jlong timeoutMillis)
+{
+    JMagickCancelToken *cancel;
+
+    cancel = (JMagickCancelToken *) AcquireMagickMemory(sizeof(*cancel));
+    if (cancel == NULL) {
+        throwMagickException(env, "Unable to allocate memory");
+        return;
+    }
+    cancel->cancelled = 0;
+    cancel->deadline =
+        timeoutMillis > 0 ? currentTimeMillis() + timeoutMillis : 0;
+    setHandle(env, self, "cancelTokenHandle", (void *) cancel, NULL);
+}
+
+/*
+ * Class:     magick_CancelToken
+ * Method:    cancel
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_magick_CancelToken_cancel
+  (JNIEnv *env, jobject self)
+{
+    JMagickCancelToken *cancel;
+
+    cancel = (JMagickCancelToken *)
+        getHandle(env, self, "cancelTokenHandle", NULL);
+    if (cancel != NULL) {
+        cancel->cancelled = 1;
+    }
+}
+
+/*
+ * Class:     magick_CancelToken
+ * Method:    isCancelled
+ * Signature: ()Z
+ */
+JNIEXPORT jboolean JNICALL Java_magick_CancelToken_isCancelled
+  (JNIEnv *env, jobject self)
+{
+    JMagickCancelToken *cancel;
+
+    cancel = (JMagickCancelToken *)
+        getHandle(env, self, "cancelTokenHandle", NULL);
+    if (cancel == NULL) {
+        return JNI_FALSE;
+    }
+    return isCancelTokenSet(cancel) ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * Class:     magick_CancelToken
+ * Method:    destroyCancelToken
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_magick_CancelToken_destroyCancelToken
+  (JNIEnv *env, jobject self)
+{
+    JMagickCancelToken *cancel;
+    jfieldID handleFid = 0;
+
+    cancel = (JMagickCancelToken *)
+        getHandle(env, self, "cancelTokenHandle", &handleFid);
+    if (cancel != NULL) {
+        setHandle(env, self, "cancelTokenHandle", NULL, &handleFid);
+        RelinquishMagickMemory(cancel);
+    }
+}
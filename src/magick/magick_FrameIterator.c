@@ -0,0 +1,366 @@
+#include <jni.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+#if defined (IMAGEMAGICK_HEADER_STYLE_7)
+#    include <MagickCore/MagickCore.h>
+#else
+#    include <magick/api.h>
+#endif
+#include "magick_FrameIterator.h"
+#include "jmagick.h"
+
+
+
+/*
+ * Wrap an image list in a new magick.MagickImage, destroying it if
+ * that fails.
+ */
+static jobject wrapFrame(JNIEnv *env, Image *image)
+{
+    jobject newObj;
+
+    newObj = newImageObject(env, image);
+    if (newObj == NULL) {
+	DestroyImageList(image);
+	throwMagickException(env, "Unable to construct magick.MagickImage");
+    }
+    return newObj;
+}
+
+/*
+ * Return the image of a magick.MagickImage, throwing if it has none.
+ */
+static Image *getFrameHandle(JNIEnv *env, jobject obj)
+{
+    Image *image = NULL;
+
+    if (obj != NULL) {
+	image = (Image *) getHandle(env, obj, "magickImageHandle",
+				    &jmagickCache.magickImageHandle);
+    }
+    if (image == NULL) {
+	throwMagickException(env, "Cannot obtain image handle");
+    }
+    return image;
+}
+
+/*
+ * Make the pixels of a region of an image transparent.
+ */
+static void clearFrameBounds(Image *image,
+			     const RectangleInfo *bounds,
+			     ExceptionInfo *exception)
+{
+    ssize_t x, y;
+#if MagickLibVersion < 0x700
+    PixelPacket *q;
+
+    if (image->matte == MagickFalse) {
+	SetImageAlphaChannel(image, OpaqueAlphaChannel);
+    }
+#else
+    Quantum *q;
+
+    if (image->alpha_trait == UndefinedPixelTrait) {
+	SetImageAlphaChannel(image, OpaqueAlphaChannel, exception);
+    }
+#endif
+    for (y = 0; y < (ssize_t) bounds->height; y++) {
+	q = GetAuthenticPixels(image, bounds->x, bounds->y + y,
+			       bounds->width, 1, exception);
+	if (q == NULL) {
+	    break;
+	}
+	for (x = 0; x < (ssize_t) bounds->width; x++) {
+#if MagickLibVersion < 0x700
+	    q->opacity = (Quantum) TransparentOpacity;
+	    q++;
+#else
+	    SetPixelAlpha(image, TransparentAlpha, q);
+	    q += GetPixelChannels(image);
+#endif
+	}
+	if (!SyncAuthenticPixels(image, exception)) {
+	    break;
+	}
+    }
+}
+
+
+
+/*
+ * Class:     magick_FrameIterator
+ * Method:    countFrames
+ * Signature: (Lmagick/ImageInfo;)I
+ */
+JNIEXPORT jint JNICALL Java_magick_FrameIterator_countFrames
+  (JNIEnv *env, jclass iteratorClass, jobject imageInfoObj)
+{
+    ImageInfo *imageInfo, *pingInfo;
+    Image *image;
+    ExceptionInfo *exception;
+    jint count;
+
+    imageInfo = (ImageInfo *) getHandle(env, imageInfoObj,
+					"imageInfoHandle",
+					&jmagickCache.imageInfoHandle);
+    if (imageInfo == NULL) {
+	throwMagickException(env, "Cannot obtain ImageInfo object");
+	return 0;
+    }
+
+    pingInfo = CloneImageInfo(imageInfo);
+    exception = AcquireExceptionInfo();
+    image = PingImage(pingInfo, exception);
+    DestroyImageInfo(pingInfo);
+    if (image == NULL) {
+	throwMagickApiException(env, "Unable to ping image", exception);
+	DestroyExceptionInfo(exception);
+	return 0;
+    }
+    DestroyExceptionInfo(exception);
+
+    count = (jint) GetImageListLength(image);
+    DestroyImageList(image);
+    return count;
+}
+
+/*
+ * Class:     magick_FrameIterator
+ * Method:    readFrame
+ * Signature: (Lmagick/ImageInfo;I)Lmagick/MagickImage;
+ */
+JNIEXPORT jobject JNICALL Java_magick_FrameIterator_readFrame
+  (JNIEnv *env, jclass iteratorClass, jobject imageInfoObj, jint scene)
+{
+    ImageInfo *imageInfo, *readInfo;
+    Image *images, *frame, *p;
+    ExceptionInfo *exception;
+
+    imageInfo = (ImageInfo *) getHandle(env, imageInfoObj,
+					"imageInfoHandle",
+					&jmagickCache.imageInfoHandle);
+    if (imageInfo == NULL) {
+	throwMagickException(env, "Cannot obtain ImageInfo object");
+	return NULL;
+    }
+
+    readInfo = CloneImageInfo(imageInfo);
+    readInfo->scene = (size_t) scene;
+    readInfo->number_scenes = 1;
+    exception = AcquireExceptionInfo();
+    images = ReadImage(readInfo, exception);
+    DestroyImageInfo(readInfo);
+    if (images == NULL) {
+	throwMagickApiException(env, "Unable to read frame", exception);
+	DestroyExceptionInfo(exception);
+	return NULL;
+    }
+    DestroyExceptionInfo(exception);
+
+    /*
+     * Coders that ignore the scene range return every frame: drop the
+     * frames before the one asked for, and return it together with
+     * the frames after it for the iterator to hand out.
+     */
+    frame = NULL;
+    for (p = images; p != NULL; p = GetNextImageInList(p)) {
+	if (p->scene == (size_t) scene) {
+	    frame = p;
+	    break;
+	}
+    }
+    if (frame == NULL) {
+	frame = GetImageListLength(images) > (size_t) scene
+	    ? GetImageFromList(images, (ssize_t) scene)
+	    : GetLastImageInList(images);
+    }
+    if (frame->previous != NULL) {
+	frame->previous->next = NULL;
+	frame->previous = NULL;
+	DestroyImageList(images);
+    }
+
+    return wrapFrame(env, frame);
+}
+
+/*
+ * Class:     magick_FrameIterator
+ * Method:    newCanvas
+ * Signature: (Lmagick/MagickImage;)Lmagick/MagickImage;
+ */
+JNIEXPORT jobject JNICALL Java_magick_FrameIterator_newCanvas
+  (JNIEnv *env, jclass iteratorClass, jobject frameObj)
+{
+    Image *frame, *canvas;
+    RectangleInfo bounds;
+    ExceptionInfo *exception;
+#if MagickLibVersion < 0x700
+    PixelPacket background;
+#else
+    PixelInfo background;
+#endif
+
+    frame = getFrameHandle(env, frameObj);
+    if (frame == NULL) {
+	return NULL;
+    }
+
+    bounds = frame->page;
+    if (bounds.width == 0) {
+	bounds.width = frame->columns + (bounds.x > 0 ? bounds.x : 0);
+    }
+    if (bounds.height == 0) {
+	bounds.height = frame->rows + (bounds.y > 0 ? bounds.y : 0);
+    }
+    bounds.x = 0;
+    bounds.y = 0;
+
+    exception = AcquireExceptionInfo();
+    canvas = CloneImage(frame, bounds.width, bounds.height, MagickTrue,
+			exception);
+    if (canvas == NULL) {
+	throwMagickApiException(env, "Unable to create canvas", exception);
+	DestroyExceptionInfo(exception);
+	return NULL;
+    }
+    canvas->page = bounds;
+    canvas->dispose = NoneDispose;
+
+    /* Start from a transparent canvas */
+    background = canvas->background_color;
+#if MagickLibVersion < 0x700
+    canvas->background_color.opacity = (Quantum) TransparentOpacity;
+    canvas->matte = MagickTrue;
+    SetImageBackgroundColor(canvas);
+#else
+    canvas->background_color.alpha = (double) TransparentAlpha;
+    canvas->background_color.alpha_trait = BlendPixelTrait;
+    canvas->alpha_trait = BlendPixelTrait;
+    SetImageBackgroundColor(canvas, exception);
+#endif
+    canvas->background_color = background;
+    DestroyExceptionInfo(exception);
+
+    return wrapFrame(env, canvas);
+}
+
+/*
+ * Class:     magick_FrameIterator
+ * Method:    composeFrame
+ * Signature: (Lmagick/MagickImage;Lmagick/MagickImage;Z)Lmagick/MagickImage;
+ */
+JNIEXPORT jobject JNICALL Java_magick_FrameIterator_composeFrame
+  (JNIEnv *env, jclass iteratorClass, jobject canvasObj, jobject frameObj,
+   jboolean first)
+{
+    Image *canvas, *frame, *coalesced;
+    CompositeOperator compose;
+    ExceptionInfo *exception;
+
+    canvas = getFrameHandle(env, canvasObj);
+    frame = canvas == NULL ? NULL : getFrameHandle(env, frameObj);
+    if (frame == NULL) {
+	return NULL;
+    }
+
+    exception = AcquireExceptionInfo();
+    coalesced = CloneImage(canvas, 0, 0, MagickTrue, exception);
+    if (coalesced == NULL) {
+	throwMagickApiException(env, "Unable to clone canvas", exception);
+	DestroyExceptionInfo(exception);
+	return NULL;
+    }
+    compose = first ? CopyCompositeOp : frame->compose;
+#if MagickLibVersion < 0x700
+    CompositeImage(coalesced, compose, frame, frame->page.x, frame->page.y);
+#else
+    CompositeImage(coalesced, frame, compose, MagickTrue,
+		   frame->page.x, frame->page.y, exception);
+#endif
+
+    /* Take the metadata of the frame, but keep the canvas geometry */
+    CloneImageProfiles(coalesced, frame);
+    CloneImageProperties(coalesced, frame);
+    CloneImageArtifacts(coalesced, frame);
+    coalesced->page = canvas->page;
+    coalesced->dispose = NoneDispose;
+    coalesced->delay = frame->delay;
+    coalesced->ticks_per_second = frame->ticks_per_second;
+    coalesced->iterations = frame->iterations;
+    coalesced->scene = frame->scene;
+    DestroyExceptionInfo(exception);
+
+    return wrapFrame(env, coalesced);
+}
+
+/*
+ * Class:     magick_FrameIterator
+ * Method:    disposeFrame
+ * Signature: (Lmagick/MagickImage;Lmagick/MagickImage;)Lmagick/MagickImage;
+ */
+JNIEXPORT jobject JNICALL Java_magick_FrameIterator_disposeFrame
+  (JNIEnv *env, jclass iteratorClass, jobject coalescedObj, jobject frameObj)
+{
+    Image *coalesced, *frame, *canvas;
+    RectangleInfo bounds;
+    ExceptionInfo *exception;
+
+    coalesced = getFrameHandle(env, coalescedObj);
+    frame = coalesced == NULL ? NULL : getFrameHandle(env, frameObj);
+    if (frame == NULL) {
+	return NULL;
+    }
+
+    /* The next frame goes over the canvas from before this one */
+    if (frame->dispose == PreviousDispose) {
+	return NULL;
+    }
+
+    exception = AcquireExceptionInfo();
+    canvas = CloneImage(coalesced, 0, 0, MagickTrue, exception);
+    if (canvas == NULL) {
+	throwMagickApiException(env, "Unable to clone canvas", exception);
+	DestroyExceptionInfo(exception);
+	return NULL;
+    }
+
+    /* Clear the area of the frame, clipped to the canvas */
+    if (frame->dispose == BackgroundDispose) {
+	bounds.x = frame->page.x;
+	bounds.y = frame->page.y;
+	bounds.width = frame->columns;
+	bounds.height = frame->rows;
+	if (bounds.x < 0) {
+	    bounds.width = (ssize_t) bounds.width + bounds.x > 0
+		? bounds.width + bounds.x : 0;
+	    bounds.x = 0;
+	}
+	if (bounds.y < 0) {
+	    bounds.height = (ssize_t) bounds.height + bounds.y > 0
+		? bounds.height + bounds.y : 0;
+	    bounds.y = 0;
+	}
+	if (bounds.x >= (ssize_t) canvas->columns) {
+	    bounds.width = 0;
+	}
+	else if (bounds.x + (ssize_t) bounds.width > (ssize_t) canvas->columns) {
+	    bounds.width = canvas->columns - bounds.x;
+	}
+	if (bounds.y >= (ssize_t) canvas->rows) {
+	    bounds.height = 0;
+	}
+	else if (bounds.y + (ssize_t) bounds.height > (ssize_t) canvas->rows) {
+	    bounds.height = canvas->rows - bounds.y;
+	}
+	if (bounds.width > 0 && bounds.height > 0) {
+	    clearFrameBounds(canvas, &bounds, exception);
+	}
+    }
+    DestroyExceptionInfo(exception);
+
+    return wrapFrame(env, canvas);
+}
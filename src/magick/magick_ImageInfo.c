@@ -783,6 +783,47 @@ JNIEXPORT void JNICALL Java_magick_ImageInfo_destroyImageInfo
 	setHandle(env, obj, "imageInfoHandle", NULL, &handleFid);
 	DestroyImageInfo(imageInfo);
     }
+
+    destroyProgressMonitor(env, (JMagickProgress *)
+	getHandle(env, obj, "progressMonitorHandle",
+		  &jmagickCache.imageInfoProgress));
+    setHandle(env, obj, "progressMonitorHandle", NULL,
+	      &jmagickCache.imageInfoProgress);
+}
+
+
+/*
+ * Class:     magick_ImageInfo
+ * Method:    setProgressMonitor
+ * Signature: (Lmagick/ProgressMonitor;Lmagick/CancelToken;)V
+ */
+JNIEXPORT void JNICALL Java_magick_ImageInfo_setProgressMonitor
+    (JNIEnv *env, jobject obj, jobject monitor, jobject token)
+{
+    ImageInfo *imageInfo = NULL;
+    JMagickProgress *progress, *oldProgress;
+
+    imageInfo = (ImageInfo*) getHandle(env, obj, "imageInfoHandle", NULL);
+    if (imageInfo == NULL) {
+	throwMagickException(env, "Unable to retrieve handle");
+	return;
+    }
+
+    progress = newProgressMonitor(env, monitor, token);
+    if (progress == NULL && (monitor != NULL || token != NULL)) {
+	throwMagickException(env, "Unable to allocate memory");
+	return;
+    }
+    SetImageInfoProgressMonitor(imageInfo, progress != NULL ?
+				monitorProgress : (MagickProgressMonitor) NULL,
+				progress);
+
+    oldProgress = (JMagickProgress *)
+	getHandle(env, obj, "progressMonitorHandle",
+		  &jmagickCache.imageInfoProgress);
+    setHandle(env, obj, "progressMonitorHandle", (void *) progress,
+	      &jmagickCache.imageInfoProgress);
+    destroyProgressMonitor(env, oldProgress);
 }
 
 
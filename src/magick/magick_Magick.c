@@ -34,10 +34,14 @@ JNIEXPORT jint JNICALL Java_magick_Magick_parseImageGeometry
     jint flags;
     const char *cstr;
 
-    if (!getIntFieldValue(env, rect, "width", NULL, (jint *) &width) ||
-	!getIntFieldValue(env, rect, "height", NULL, (jint *) &height) ||
-	!getIntFieldValue(env, rect, "x", NULL, (jint *) &x) ||
-	!getIntFieldValue(env, rect, "y", NULL, (jint *) &y)) {
+    if (!getIntFieldValue(env, rect, "width",
+			  &jmagickCache.rectangleWidth, (jint *) &width) ||
+	!getIntFieldValue(env, rect, "height",
+			  &jmagickCache.rectangleHeight, (jint *) &height) ||
+	!getIntFieldValue(env, rect, "x",
+			  &jmagickCache.rectangleX, (jint *) &x) ||
+	!getIntFieldValue(env, rect, "y",
+			  &jmagickCache.rectangleY, (jint *) &y)) {
         throwMagickException(env, "Unable to obtain Rectangle values");
         return 0;
     }
@@ -50,10 +54,12 @@ JNIEXPORT jint JNICALL Java_magick_Magick_parseImageGeometry
 #endif
     (*env)->ReleaseStringUTFChars(env, geometry, cstr);
 
-    if (!setIntFieldValue(env, rect, "width", NULL, width) ||
-	!setIntFieldValue(env, rect, "height", NULL, height) ||
-	!setIntFieldValue(env, rect, "x", NULL, x) ||
-	!setIntFieldValue(env, rect, "y", NULL, y)) {
+    if (!setIntFieldValue(env, rect, "width",
+			  &jmagickCache.rectangleWidth, width) ||
+	!setIntFieldValue(env, rect, "height",
+			  &jmagickCache.rectangleHeight, height) ||
+	!setIntFieldValue(env, rect, "x", &jmagickCache.rectangleX, x) ||
+	!setIntFieldValue(env, rect, "y", &jmagickCache.rectangleY, y)) {
         throwMagickException(env, "Unable to set Rectangle values");
         return 0;
     }
@@ -77,9 +83,364 @@ JNIEXPORT jobjectArray JNICALL Java_magick_Magick_queryFonts
 	exception = AcquireExceptionInfo();
 	fonts = GetTypeList((*env)->GetStringUTFChars(env, pattern, 0), &number_fonts, exception);
 	DestroyExceptionInfo(exception);
-	fontArray = (*env)->NewObjectArray(env, number_fonts, (*env)->FindClass(env, "java/lang/String"), (*env)->NewStringUTF(env, ""));
+	fontArray = (*env)->NewObjectArray(env, number_fonts, jmagickCache.stringClass, (*env)->NewStringUTF(env, ""));
 	for(i = 0; i < number_fonts; i++) {
 		(*env)->SetObjectArrayElement(env, fontArray, i, (*env)->NewStringUTF(env, fonts[i]));
 	}
 	return fontArray;
 }
+
+/*
+ * Class:     magick_Magick
+ * Method:    probeImages
+ * Signature: ([Ljava/lang/Object;ZII[I[I[I[I[I[I[Z[Ljava/lang/String;[Ljava/lang/String;)V
+ */
+JNIEXPORT void JNICALL Java_magick_Magick_probeImages
+  (JNIEnv *env, jclass magickClass, jobjectArray sources, jboolean isBlob,
+   jint offset, jint count, jintArray width, jintArray height,
+   jintArray frames, jintArray orientation, jintArray colorspace,
+   jintArray depth, jbooleanArray alpha, jobjectArray format,
+   jobjectArray error)
+{
+	ImageInfo *imageInfo;
+	Image *image;
+	ExceptionInfo *exception;
+	jint *values;
+	jboolean *hasAlpha;
+	jobject source;
+	jstring str;
+	const char *path, *reason;
+	void *blob;
+	jlong blobSiz;
+	int i;
+
+	if (count <= 0) {
+		return;
+	}
+
+	/* Collect the values natively and copy each array out once. */
+	values = (jint *) AcquireQuantumMemory(6 * (size_t) count,
+					       sizeof(*values));
+	hasAlpha = (jboolean *) AcquireQuantumMemory((size_t) count,
+						     sizeof(*hasAlpha));
+	if (values == NULL || hasAlpha == NULL) {
+		if (values != NULL) RelinquishMagickMemory(values);
+		if (hasAlpha != NULL) RelinquishMagickMemory(hasAlpha);
+		throwMagickException(env, "Unable to allocate memory");
+		return;
+	}
+	memset(values, 0, 6 * (size_t) count * sizeof(*values));
+	memset(hasAlpha, 0, (size_t) count * sizeof(*hasAlpha));
+
+	imageInfo = AcquireImageInfo();
+	exception = AcquireExceptionInfo();
+	for (i = 0; i < count; i++) {
+		image = NULL;
+		source = (*env)->GetObjectArrayElement(env, sources, offset + i);
+		if (source == NULL) {
+			(*env)->SetObjectArrayElement(env, error, offset + i,
+				(*env)->NewStringUTF(env, "No image source"));
+			continue;
+		}
+		if (isBlob) {
+			blob = (*env)->GetDirectBufferAddress(env, source);
+			blobSiz = (*env)->GetDirectBufferCapacity(env, source);
+			if (blob != NULL && blobSiz > 0) {
+				*imageInfo->magick = '\0';
+				*imageInfo->filename = '\0';
+				image = PingBlob(imageInfo, blob, (size_t) blobSiz,
+						 exception);
+			}
+		}
+		else {
+			path = (*env)->GetStringUTFChars(env, (jstring) source, 0);
+			if (path != NULL) {
+				CopyMagickString(imageInfo->filename, path,
+						 sizeof(imageInfo->filename));
+				(*env)->ReleaseStringUTFChars(env, (jstring) source,
+							      path);
+				image = PingImage(imageInfo, exception);
+			}
+		}
+		(*env)->DeleteLocalRef(env, source);
+
+		if (image == NULL) {
+			reason = exception->reason != NULL ?
+				exception->reason : "Unable to ping image";
+			str = (*env)->NewStringUTF(env, reason);
+			(*env)->SetObjectArrayElement(env, error, offset + i, str);
+			(*env)->DeleteLocalRef(env, str);
+			ClearMagickException(exception);
+			continue;
+		}
+
+		values[i] = (jint) image->columns;
+		values[count + i] = (jint) image->rows;
+		values[2 * count + i] = (jint) GetImageListLength(image);
+		values[3 * count + i] = (jint) image->orientation;
+		values[4 * count + i] = (jint) image->colorspace;
+		values[5 * count + i] = (jint) image->depth;
+#if MagickLibVersion < 0x700
+		hasAlpha[i] = image->matte ? JNI_TRUE : JNI_FALSE;
+#else
+		hasAlpha[i] = image->alpha_trait != UndefinedPixelTrait ?
+			JNI_TRUE : JNI_FALSE;
+#endif
+		str = (*env)->NewStringUTF(env, image->magick);
+		(*env)->SetObjectArrayElement(env, format, offset + i, str);
+		(*env)->DeleteLocalRef(env, str);
+#if MagickLibVersion < 0x700
+		DestroyImages(image);
+#else
+		DestroyImageList(image);
+#endif
+		ClearMagickException(exception);
+	}
+	DestroyExceptionInfo(exception);
+	DestroyImageInfo(imageInfo);
+
+	(*env)->SetIntArrayRegion(env, width, offset, count, values);
+	(*env)->SetIntArrayRegion(env, height, offset, count, values + count);
+	(*env)->SetIntArrayRegion(env, frames, offset, count, values + 2 * count);
+	(*env)->SetIntArrayRegion(env, orientation, offset, count,
+				  values + 3 * count);
+	(*env)->SetIntArrayRegion(env, colorspace, offset, count,
+				  values + 4 * count);
+	(*env)->SetIntArrayRegion(env, depth, offset, count, values + 5 * count);
+	(*env)->SetBooleanArrayRegion(env, alpha, offset, count, hasAlpha);
+	RelinquishMagickMemory(values);
+	RelinquishMagickMemory(hasAlpha);
+}
+
+/*
+ * Class:     magick_Magick
+ * Method:    getQuantumDepth
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_magick_Magick_getQuantumDepth
+  (JNIEnv *env, jclass magickClass)
+{
+	return MAGICKCORE_QUANTUM_DEPTH;
+}
+
+/*
+ * Class:     magick_Magick
+ * Method:    isHDRI
+ * Signature: ()Z
+ */
+JNIEXPORT jboolean JNICALL Java_magick_Magick_isHDRI
+  (JNIEnv *env, jclass magickClass)
+{
+#if defined(MAGICKCORE_HDRI_SUPPORT)
+	return JNI_TRUE;
+#else
+	return JNI_FALSE;
+#endif
+}
+
+/*
+ * Class:     magick_Magick
+ * Method:    getQuantumSize
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_magick_Magick_getQuantumSize
+  (JNIEnv *env, jclass magickClass)
+{
+	return (jint) sizeof(Quantum);
+}
+
+/*
+ * Class:     magick_Magick
+ * Method:    destroyHandles
+ * Signature: (IJJJ)V
+ */
+JNIEXPORT void JNICALL Java_magick_Magick_destroyHandles
+  (JNIEnv *env, jclass magickClass, jint kind, jlong handle, jlong progress,
+   jlong bytes)
+{
+    void *p = (void *) handle;
+
+    if (p != NULL) {
+	releaseAccountedHandle(env, kind, bytes);
+	switch (kind) {
+	case JMAGICK_HANDLE_IMAGE:
+#if MagickLibVersion < 0x700
+	    DestroyImages((Image *) p);
+#else
+	    DestroyImageList((Image *) p);
+#endif
+	    break;
+	case JMAGICK_HANDLE_IMAGE_INFO:
+	    DestroyImageInfo((ImageInfo *) p);
+	    break;
+	case JMAGICK_HANDLE_DRAW_INFO:
+	    DestroyDrawInfo((DrawInfo *) p);
+	    break;
+	case JMAGICK_HANDLE_MONTAGE_INFO:
+	    DestroyMontageInfo((MontageInfo *) p);
+	    break;
+	case JMAGICK_HANDLE_QUANTIZE_INFO:
+	    DestroyQuantizeInfo((QuantizeInfo *) p);
+	    break;
+	case JMAGICK_HANDLE_CANCEL_TOKEN:
+	    RelinquishMagickMemory(p);
+	    break;
+	}
+    }
+
+    destroyProgressMonitor(env, (JMagickProgress *) progress);
+}
+
+/*
+ * Class:     magick_Magick
+ * Method:    nativeStats
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL Java_magick_Magick_nativeStats
+  (JNIEnv *env, jclass magickClass)
+{
+    jlong stats[JMAGICK_STAT_COUNT];
+    jlongArray array;
+
+    getAccountedHandles(env, stats);
+    stats[JMAGICK_STAT_MEMORY] = (jlong) GetMagickResource(MemoryResource);
+    stats[JMAGICK_STAT_MAP] = (jlong) GetMagickResource(MapResource);
+    stats[JMAGICK_STAT_DISK] = (jlong) GetMagickResource(DiskResource);
+    stats[JMAGICK_STAT_AREA] = (jlong) GetMagickResource(AreaResource);
+    stats[JMAGICK_STAT_THREADS] = (jlong) GetMagickResource(ThreadResource);
+    stats[JMAGICK_STAT_FILES] = (jlong) GetMagickResource(FileResource);
+
+    array = (*env)->NewLongArray(env, JMAGICK_STAT_COUNT);
+    if (array == NULL) {
+	return NULL;
+    }
+    (*env)->SetLongArrayRegion(env, array, 0, JMAGICK_STAT_COUNT, stats);
+    return array;
+}
+
+/*
+ * The values of magick.ResourceType, which are mapped to the
+ * ResourceType of the ImageMagick version built against.
+ */
+#define JMAGICK_AREA_RESOURCE      1
+#define JMAGICK_DISK_RESOURCE      2
+#define JMAGICK_FILE_RESOURCE      3
+#define JMAGICK_MAP_RESOURCE       4
+#define JMAGICK_MEMORY_RESOURCE    5
+#define JMAGICK_THREAD_RESOURCE    6
+#define JMAGICK_TIME_RESOURCE      7
+#define JMAGICK_THROTTLE_RESOURCE  8
+#define JMAGICK_WIDTH_RESOURCE     9
+#define JMAGICK_HEIGHT_RESOURCE   10
+
+/*
+ * Map a magick.ResourceType value to an ImageMagick resource.
+ * Throws a MagickException and returns zero if it has none.
+ */
+static int getResourceType(JNIEnv *env, jint type, ResourceType *resource)
+{
+    switch (type) {
+    case JMAGICK_AREA_RESOURCE:
+	*resource = AreaResource;
+	return 1;
+    case JMAGICK_DISK_RESOURCE:
+	*resource = DiskResource;
+	return 1;
+    case JMAGICK_FILE_RESOURCE:
+	*resource = FileResource;
+	return 1;
+    case JMAGICK_MAP_RESOURCE:
+	*resource = MapResource;
+	return 1;
+    case JMAGICK_MEMORY_RESOURCE:
+	*resource = MemoryResource;
+	return 1;
+    case JMAGICK_THREAD_RESOURCE:
+	*resource = ThreadResource;
+	return 1;
+    case JMAGICK_TIME_RESOURCE:
+	*resource = TimeResource;
+	return 1;
+    case JMAGICK_THROTTLE_RESOURCE:
+	*resource = ThrottleResource;
+	return 1;
+#if MagickLibVersion >= 0x690
+    case JMAGICK_WIDTH_RESOURCE:
+	*resource = WidthResource;
+	return 1;
+    case JMAGICK_HEIGHT_RESOURCE:
+	*resource = HeightResource;
+	return 1;
+#endif
+    }
+    throwMagickException(env, "Unsupported resource type");
+    return 0;
+}
+
+/*
+ * Convert a resource amount to Java, where no limit is Long.MAX_VALUE.
+ */
+static jlong resourceToJava(MagickSizeType amount)
+{
+    if (amount > (MagickSizeType) 0x7fffffffffffffffLL) {
+	return (jlong) 0x7fffffffffffffffLL;
+    }
+    return (jlong) amount;
+}
+
+/*
+ * Class:     magick_Magick
+ * Method:    setResourceLimit
+ * Signature: (IJ)V
+ */
+JNIEXPORT void JNICALL Java_magick_Magick_setResourceLimit
+  (JNIEnv *env, jclass magickClass, jint type, jlong limit)
+{
+    ResourceType resource;
+    MagickSizeType amount;
+
+    if (!getResourceType(env, type, &resource)) {
+	return;
+    }
+    if (limit < 0) {
+	throwMagickException(env, "Resource limit must not be negative");
+	return;
+    }
+    amount = limit == (jlong) 0x7fffffffffffffffLL
+	? ~((MagickSizeType) 0) : (MagickSizeType) limit;
+    if (!SetMagickResourceLimit(resource, amount)) {
+	throwMagickException(env, "Unable to set resource limit");
+    }
+}
+
+/*
+ * Class:     magick_Magick
+ * Method:    getResourceLimit
+ * Signature: (I)J
+ */
+JNIEXPORT jlong JNICALL Java_magick_Magick_getResourceLimit
+  (JNIEnv *env, jclass magickClass, jint type)
+{
+    ResourceType resource;
+
+    if (!getResourceType(env, type, &resource)) {
+	return 0;
+    }
+    return resourceToJava(GetMagickResourceLimit(resource));
+}
+
+/*
+ * Class:     magick_Magick
+ * Method:    getResource
+ * Signature: (I)J
+ */
+JNIEXPORT jlong JNICALL Java_magick_Magick_getResource
+  (JNIEnv *env, jclass magickClass, jint type)
+{
+    ResourceType resource;
+
+    if (!getResourceType(env, type, &resource)) {
+	return 0;
+    }
+    return resourceToJava(GetMagickResource(resource));
+}
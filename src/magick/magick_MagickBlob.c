@@ -0,0 +1,42 @@
+#include <jni.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+#if defined (IMAGEMAGICK_HEADER_STYLE_7)
+#    include <MagickCore/MagickCore.h>
+#else
+#    include <magick/api.h>
+#endif
+#include "magick_MagickBlob.h"
+#include "jmagick.h"
+
+/*
+ * Class:     magick_MagickBlob
+ * Method:    getBlobAddress
+ * Signature: (Ljava/nio/ByteBuffer;)J
+ */
+JNIEXPORT jlong JNICALL Java_magick_MagickBlob_getBlobAddress
+  (JNIEnv *env, jclass magickBlobClass, jobject buffer)
+{
+    if (buffer == NULL) {
+        return 0;
+    }
+    return (jlong) (*env)->GetDirectBufferAddress(env, buffer);
+}
+
+/*
+ * Class:     magick_MagickBlob
+ * Method:    relinquishBlob
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_magick_MagickBlob_relinquishBlob
+  (JNIEnv *env, jclass magickBlobClass, jlong address)
+{
+    void *blobMem = (void *) address;
+
+    if (blobMem != NULL) {
+        RelinquishMagickMemory(blobMem);
+    }
+}
@@ -11,6 +11,10 @@
 #endif
 #include "magick_MagickImage.h"
 #include "jmagick.h"
+#if defined(MAGICKCORE_HAVE_PTHREAD) && !defined(_WIN32)
+#    include <pthread.h>
+#    define JMAGICK_PTHREADS 1
+#endif
 
 
 
@@ -225,6 +229,673 @@ JNIEXPORT void JNICALL Java_magick_MagickImage_readImage
 }
 
 
+/*
+ * Class:     magick_MagickImage
+ * Method:    decodeThumbnail
+ * Signature: (Lmagick/ImageInfo;II)V
+ */
+JNIEXPORT void JNICALL Java_magick_MagickImage_decodeThumbnail
+    (JNIEnv *env, jobject self, jobject imageInfoObj,
+     jint maxWidth, jint maxHeight)
+{
+    ImageInfo *imageInfo = NULL, *readInfo = NULL;
+    Image *image = NULL, *oldImage = NULL, *resizedImage = NULL, *frame;
+    jfieldID fieldID = 0;
+    ExceptionInfo *exception;
+    char sizeHint[64];
+    double scale;
+    size_t columns, rows;
+
+    /* Obtain the ImageInfo pointer */
+    imageInfo = (ImageInfo*) getHandle(env, imageInfoObj,
+				       "imageInfoHandle", NULL);
+    if (imageInfo == NULL) {
+	throwMagickException(env, "Cannot obtain ImageInfo object");
+	return;
+    }
+
+    /*
+     * Let the decoder reduce the image while decoding, the JPEG coder
+     * to the smallest DCT scale that is still at least this large.
+     */
+    readInfo = CloneImageInfo(imageInfo);
+    snprintf(sizeHint, sizeof(sizeHint), "%dx%d",
+	     (int) maxWidth, (int) maxHeight);
+    SetImageOption(readInfo, "jpeg:size", sizeHint);
+    if (readInfo->number_scenes == 0) {
+	readInfo->scene = 0;
+	readInfo->number_scenes = 1;
+    }
+
+    exception=AcquireExceptionInfo();
+    image = ReadImage(readInfo, exception);
+    DestroyImageInfo(readInfo);
+    if (image == NULL) {
+        throwMagickApiException(env, "Unable to read image", exception);
+	DestroyExceptionInfo(exception);
+	return;
+    }
+
+    /*
+     * Finish each frame with an exact resize to fit, never enlarging,
+     * replacing it in the list.
+     */
+    for (frame = image; frame != NULL; frame = GetNextImageInList(frame)) {
+	scale = (double) maxWidth / frame->columns;
+	if ((double) maxHeight / frame->rows < scale) {
+	    scale = (double) maxHeight / frame->rows;
+	}
+	if (scale >= 1.0) {
+	    continue;
+	}
+	columns = (size_t) (frame->columns * scale + 0.5);
+	rows = (size_t) (frame->rows * scale + 0.5);
+	resizedImage = ResizeImage(frame,
+				   columns > 0 ? columns : 1,
+				   rows > 0 ? rows : 1,
+				   frame->filter,
+#if MagickLibVersion < 0x700
+				   1.0,
+#endif
+				   exception);
+	if (resizedImage == NULL) {
+#if MagickLibVersion < 0x700
+	    DestroyImages(image);
+#else
+	    DestroyImageList(image);
+#endif
+	    throwMagickApiException(env, "Unable to resize image", exception);
+	    DestroyExceptionInfo(exception);
+	    return;
+	}
+	ReplaceImageInList(&frame, resizedImage);
+	if (GetPreviousImageInList(frame) == NULL) {
+	    image = frame;
+	}
+    }
+    DestroyExceptionInfo(exception);
+
+    /* Get the old image handle and deallocate it (if required). */
+    oldImage = (Image*) getHandle(env, self, "magickImageHandle", &fieldID);
+    if (oldImage != NULL) {
+#if MagickLibVersion < 0x700
+        DestroyImages(oldImage);
+#else
+	DestroyImageList(oldImage);
+#endif
+    }
+
+    /* Store the image into the handle. */
+    setHandle(env, self, "magickImageHandle", (void*) image, &fieldID);
+}
+
+
+/*
+ * Size of the Java byte array used to move stream data into native
+ * memory, and of the header peeked to detect the image format.
+ */
+#define STREAM_CHUNK_SIZE   65536
+#define STREAM_HEADER_SIZE  8192
+
+/*
+ * State of a java.io.InputStream being read by ImageMagick.
+ */
+typedef struct {
+    JNIEnv *env;
+    jobject stream;
+    jbyteArray chunk;
+    unsigned char header[STREAM_HEADER_SIZE];
+    size_t headerLength;
+    size_t headerOffset;
+    int failed;
+} JavaInputStream;
+
+/*
+ * Read up to count bytes from the Java stream, first serving the
+ * bytes already peeked into the header.
+ *
+ * Return:
+ *   the number of bytes read, 0 at end of stream, -1 if the Java
+ *   stream threw an exception (which is left pending).
+ */
+static ssize_t readJavaInputStream(unsigned char *data,
+                                   const size_t count,
+                                   void *userData)
+{
+    JavaInputStream *in = (JavaInputStream *) userData;
+    JNIEnv *env = in->env;
+    jint n, len;
+
+    if (in->failed) {
+        return -1;
+    }
+
+    if (in->headerOffset < in->headerLength) {
+        n = (jint) (in->headerLength - in->headerOffset);
+        if ((size_t) n > count) {
+            n = (jint) count;
+        }
+        memcpy(data, in->header + in->headerOffset, n);
+        in->headerOffset += n;
+        return n;
+    }
+
+    len = count < STREAM_CHUNK_SIZE ? (jint) count : STREAM_CHUNK_SIZE;
+    n = (*env)->CallIntMethod(env, in->stream, jmagickCache.inputStreamRead,
+                              in->chunk, 0, len);
+    if ((*env)->ExceptionCheck(env)) {
+        in->failed = 1;
+        return -1;
+    }
+    if (n <= 0) {
+        return 0;
+    }
+    (*env)->GetByteArrayRegion(env, in->chunk, 0, n, (jbyte *) data);
+    return n;
+}
+
+/*
+ * Fill the header of the stream so the image format can be detected
+ * from its magic bytes.
+ *
+ * Return:
+ *   non-zero   if successful
+ *   zero       if the Java stream threw an exception
+ */
+static int peekJavaInputStream(JavaInputStream *in)
+{
+    ssize_t n;
+
+    in->headerLength = 0;
+    in->headerOffset = 0;
+    while (in->headerLength < STREAM_HEADER_SIZE) {
+        /* Skip the header while filling it. */
+        in->headerOffset = in->headerLength;
+        n = readJavaInputStream(in->header + in->headerLength,
+                                STREAM_HEADER_SIZE - in->headerLength, in);
+        if (n < 0) {
+            return 0;
+        }
+        if (n == 0) {
+            break;
+        }
+        in->headerLength += n;
+    }
+    in->headerOffset = 0;
+    return 1;
+}
+
+/*
+ * Unless the file name of the ImageInfo already names a format,
+ * detect the format from the magic bytes in the header and prefix
+ * the file name with it, so ImageMagick does not have to seek back
+ * in the stream to detect it.
+ */
+static void setStreamFormat(ImageInfo *readInfo, JavaInputStream *in)
+{
+    const MagicInfo *magicInfo;
+    ExceptionInfo *exception;
+    char format[sizeof(readInfo->magick)];
+    char *colon;
+
+    colon = strchr(readInfo->filename, ':');
+    if (colon != NULL && colon != readInfo->filename) {
+        return;
+    }
+
+    *format = '\0';
+    exception = AcquireExceptionInfo();
+    magicInfo = GetMagicInfo(in->header, in->headerLength, exception);
+    if (magicInfo != NULL && GetMagicName(magicInfo) != NULL) {
+        CopyMagickString(format, GetMagicName(magicInfo), sizeof(format));
+    }
+    else {
+        GetImageMagick(in->header, in->headerLength, format);
+    }
+    DestroyExceptionInfo(exception);
+
+    if (*format != '\0') {
+        CopyMagickString(readInfo->filename, format,
+                         sizeof(readInfo->filename));
+        ConcatenateMagickString(readInfo->filename, ":",
+                                sizeof(readInfo->filename));
+    }
+}
+
+/*
+ * Decode an image from the Java stream.
+ *
+ * Return:
+ *   the image, or NULL. If the Java stream threw an exception, it is
+ *   left pending and in->failed is set.
+ */
+static Image *readJavaInputStreamImage(ImageInfo *readInfo,
+                                       JavaInputStream *in,
+                                       ExceptionInfo *exception)
+{
+    Image *image = NULL;
+#if MagickLibVersion >= 0x700
+    CustomStreamInfo *customStream;
+
+    /* Let the decoder pull the bytes as it needs them. */
+    customStream = AcquireCustomStreamInfo(exception);
+    if (customStream == NULL) {
+        return NULL;
+    }
+    SetCustomStreamData(customStream, in);
+    SetCustomStreamReader(customStream, readJavaInputStream);
+    SetImageInfoCustomStream(readInfo, customStream);
+    image = ReadImage(readInfo, exception);
+    SetImageInfoCustomStream(readInfo, (CustomStreamInfo *) NULL);
+    DestroyCustomStreamInfo(customStream);
+#else
+    unsigned char *blob = NULL, *p;
+    size_t blobSiz = 0, extent = STREAM_CHUNK_SIZE;
+    ssize_t n;
+
+    /*
+     * No custom stream support: collect the stream into ImageMagick
+     * memory in chunks, so it is never held on the Java heap.
+     */
+    blob = (unsigned char *) AcquireQuantumMemory(extent, sizeof(*blob));
+    while (blob != NULL) {
+        if (blobSiz == extent) {
+            extent <<= 1;
+            p = (unsigned char *) ResizeQuantumMemory(blob, extent,
+                                                      sizeof(*blob));
+            if (p == NULL) {
+                RelinquishMagickMemory(blob);
+                blob = NULL;
+                break;
+            }
+            blob = p;
+        }
+        n = readJavaInputStream(blob + blobSiz, extent - blobSiz, in);
+        if (n <= 0) {
+            break;
+        }
+        blobSiz += n;
+    }
+    if (blob == NULL) {
+        ThrowMagickException(exception, GetMagickModule(),
+                             ResourceLimitError, "MemoryAllocationFailed",
+                             "`%s'", readInfo->filename);
+        return NULL;
+    }
+    if (!in->failed) {
+        image = BlobToImage(readInfo, blob, blobSiz, exception);
+    }
+    RelinquishMagickMemory(blob);
+#endif
+    return image;
+}
+
+/*
+ * Class:     magick_MagickImage
+ * Method:    streamToImage
+ * Signature: (Lmagick/ImageInfo;Ljava/io/InputStream;)V
+ */
+JNIEXPORT void JNICALL Java_magick_MagickImage_streamToImage
+    (JNIEnv *env, jobject self, jobject imageInfoObj, jobject stream)
+{
+    ImageInfo *imageInfo = NULL, *readInfo = NULL;
+    Image *image = NULL, *oldImage = NULL;
+    jfieldID fieldID = 0;
+    ExceptionInfo *exception;
+    JavaInputStream *in;
+
+    /* Obtain the ImageInfo pointer */
+    imageInfo = (ImageInfo*) getHandle(env, imageInfoObj,
+				       "imageInfoHandle", NULL);
+    if (imageInfo == NULL) {
+	throwMagickException(env, "Cannot obtain ImageInfo object");
+	return;
+    }
+
+    in = (JavaInputStream *) AcquireMagickMemory(sizeof(JavaInputStream));
+    if (in == NULL) {
+	throwMagickException(env, "Unable to allocate memory");
+	return;
+    }
+    memset(in, 0, sizeof(JavaInputStream));
+    in->env = env;
+    in->stream = stream;
+    in->chunk = (*env)->NewByteArray(env, STREAM_CHUNK_SIZE);
+    if (in->chunk == NULL) {
+	RelinquishMagickMemory(in);
+	throwMagickException(env, "Unable to allocate array");
+	return;
+    }
+
+    /* Peek at the header; an IOException is left to propagate. */
+    if (!peekJavaInputStream(in)) {
+	RelinquishMagickMemory(in);
+	return;
+    }
+
+    readInfo = CloneImageInfo(imageInfo);
+    setStreamFormat(readInfo, in);
+
+    /* Read the image. */
+    exception=AcquireExceptionInfo();
+    image = readJavaInputStreamImage(readInfo, in, exception);
+    DestroyImageInfo(readInfo);
+    if (in->failed) {
+	if (image != NULL) {
+	    DestroyImageList(image);
+	}
+	DestroyExceptionInfo(exception);
+	RelinquishMagickMemory(in);
+	return;
+    }
+    (*env)->DeleteLocalRef(env, in->chunk);
+    RelinquishMagickMemory(in);
+    if (image == NULL) {
+        throwMagickApiException(env, "Unable to read image from stream",
+                                exception);
+	DestroyExceptionInfo(exception);
+	return;
+    }
+    DestroyExceptionInfo(exception);
+
+    /* Get the old image handle and deallocate it (if required). */
+    oldImage = (Image*) getHandle(env, self, "magickImageHandle", &fieldID);
+    if (oldImage != NULL) {
+#if MagickLibVersion < 0x700
+        DestroyImages(oldImage);
+#else
+	DestroyImageList(oldImage);
+#endif
+    }
+
+    /* Store the image into the handle. */
+    setHandle(env, self, "magickImageHandle", (void*) image, &fieldID);
+}
+
+
+/*
+ * State of a decode in stream mode, collecting rows into a band that
+ * is handed to a magick.PixelStreamHandler when full.
+ */
+typedef struct {
+    JNIEnv *env;
+    jobject handler;
+    char map[8];
+    size_t channels;
+    size_t bandRows;
+    unsigned char *band;
+    size_t bandExtent;
+    const Image *image;
+    jint frame;
+    size_t columns;
+    size_t rows;
+    size_t y;
+    size_t bandY;
+    size_t bandCount;
+    int stopped;
+    int failed;
+    int partialRows;
+    int cancelled;
+    MagickProgressMonitor monitor;
+    void *monitorData;
+} PixelStream;
+
+/*
+ * Progress monitor installed for a decode in stream mode. The client
+ * data of the read is the PixelStream, so the monitor of the caller's
+ * ImageInfo cannot be installed as is; it is called from here with
+ * its own client data.
+ */
+static MagickBooleanType monitorPixelStream(const char *tag,
+                                            const MagickOffsetType offset,
+                                            const MagickSizeType extent,
+                                            void *clientData)
+{
+    PixelStream *stream = (PixelStream *) clientData;
+
+    if (stream->monitor == NULL) {
+        return MagickTrue;
+    }
+    if (!stream->monitor(tag, offset, extent, stream->monitorData)) {
+        stream->cancelled = 1;
+        return MagickFalse;
+    }
+    return MagickTrue;
+}
+
+/*
+ * Hand the rows collected in the band to the Java handler.
+ *
+ * Return:
+ *   non-zero   if decoding should continue
+ *   zero       if the handler asked to stop or threw an exception
+ */
+static int flushPixelStream(PixelStream *stream)
+{
+    JNIEnv *env = stream->env;
+    jobject buffer;
+    jboolean more;
+
+    if (stream->bandCount == 0) {
+        return 1;
+    }
+    buffer = (*env)->NewDirectByteBuffer(env, stream->band,
+        (jlong) (stream->bandCount * stream->columns * stream->channels));
+    if (buffer == NULL) {
+        stream->failed = 1;
+        return 0;
+    }
+    more = (*env)->CallBooleanMethod(env, stream->handler,
+                                     jmagickCache.pixelStreamHandlerRows,
+                                     stream->frame,
+                                     (jint) stream->columns,
+                                     (jint) stream->rows,
+                                     (jint) stream->bandY,
+                                     (jint) stream->bandCount,
+                                     buffer);
+    (*env)->DeleteLocalRef(env, buffer);
+    stream->bandY += stream->bandCount;
+    stream->bandCount = 0;
+    if ((*env)->ExceptionCheck(env)) {
+        stream->failed = 1;
+        return 0;
+    }
+    if (!more) {
+        stream->stopped = 1;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Stream handler called by ImageMagick for each decoded row. The row
+ * is converted to the requested map, one byte per component.
+ *
+ * Return:
+ *   columns to continue decoding, 0 to abort it
+ */
+static size_t readPixelStream(const Image *image, const void *pixels,
+                              const size_t columns)
+{
+    PixelStream *stream = (PixelStream *) image->client_data;
+    unsigned char *q;
+    size_t extent, x, i;
+#if MagickLibVersion < 0x700
+    const PixelPacket *p = (const PixelPacket *) pixels;
+#else
+    const Quantum *p = (const Quantum *) pixels;
+#endif
+
+    if (stream->stopped || stream->failed || stream->cancelled) {
+        return 0;
+    }
+
+    /* A new frame: deliver what is left of the previous one. */
+    if (image != stream->image) {
+        if (stream->image != NULL) {
+            if (!flushPixelStream(stream)) {
+                return 0;
+            }
+            stream->frame++;
+        }
+        stream->image = image;
+        stream->columns = image->columns;
+        stream->rows = image->rows;
+        stream->y = 0;
+        stream->bandY = 0;
+        extent = stream->columns * stream->channels * stream->bandRows;
+        if (extent > stream->bandExtent) {
+            q = (unsigned char *) ResizeQuantumMemory(stream->band, extent,
+                                                      sizeof(*q));
+            if (q == NULL) {
+                stream->failed = 1;
+                return 0;
+            }
+            stream->band = q;
+            stream->bandExtent = extent;
+        }
+    }
+
+    /* Rows are counted, so coders must deliver whole rows in order. */
+    if (columns != stream->columns || stream->y >= stream->rows) {
+        stream->partialRows = 1;
+        return 0;
+    }
+
+    q = stream->band + stream->bandCount * stream->columns * stream->channels;
+    for (x = 0; x < columns; x++) {
+        for (i = 0; i < stream->channels; i++) {
+            switch (stream->map[i]) {
+#if MagickLibVersion < 0x700
+            case 'R': *q++ = ScaleQuantumToChar(GetPixelRed(p)); break;
+            case 'G': *q++ = ScaleQuantumToChar(GetPixelGreen(p)); break;
+            case 'B': *q++ = ScaleQuantumToChar(GetPixelBlue(p)); break;
+            case 'A': *q++ = ScaleQuantumToChar(GetPixelAlpha(p)); break;
+#else
+            case 'R': *q++ = ScaleQuantumToChar(GetPixelRed(image, p)); break;
+            case 'G': *q++ = ScaleQuantumToChar(GetPixelGreen(image, p)); break;
+            case 'B': *q++ = ScaleQuantumToChar(GetPixelBlue(image, p)); break;
+            case 'A': *q++ = ScaleQuantumToChar(GetPixelAlpha(image, p)); break;
+#endif
+            default:
+                *q++ = ScaleQuantumToChar(ClampToQuantum(
+                    GetPixelIntensity(image, p)));
+                break;
+            }
+        }
+#if MagickLibVersion < 0x700
+        p++;
+#else
+        p += GetPixelChannels(image);
+#endif
+    }
+    stream->y++;
+    stream->bandCount++;
+
+    if (stream->bandCount == stream->bandRows || stream->y == stream->rows) {
+        if (!flushPixelStream(stream)) {
+            return 0;
+        }
+    }
+    return columns;
+}
+
+/*
+ * Class:     magick_MagickImage
+ * Method:    readStream
+ * Signature: (Lmagick/ImageInfo;Ljava/lang/String;ILmagick/PixelStreamHandler;)V
+ */
+JNIEXPORT void JNICALL Java_magick_MagickImage_readStream
+    (JNIEnv *env, jclass magickImageClass, jobject imageInfoObj,
+     jstring map, jint bandRows, jobject handler)
+{
+    ImageInfo *imageInfo = NULL, *readInfo = NULL;
+    Image *image = NULL;
+    ExceptionInfo *exception;
+    PixelStream stream;
+    const char *cstr;
+    size_t i;
+
+    /* Obtain the ImageInfo pointer */
+    imageInfo = (ImageInfo*) getHandle(env, imageInfoObj,
+				       "imageInfoHandle", NULL);
+    if (imageInfo == NULL) {
+	throwMagickException(env, "Cannot obtain ImageInfo object");
+	return;
+    }
+
+    memset(&stream, 0, sizeof(stream));
+    stream.env = env;
+    stream.handler = handler;
+    stream.bandRows = bandRows;
+
+    cstr = (*env)->GetStringUTFChars(env, map, 0);
+    if (cstr == NULL) {
+	throwMagickException(env, "Unable to retrieve Java string chars");
+	return;
+    }
+    stream.channels = strlen(cstr);
+    if (stream.channels == 0 || stream.channels >= sizeof(stream.map)) {
+	stream.channels = 0;
+    }
+    for (i = 0; i < stream.channels; i++) {
+	if (strchr("RGBAI", cstr[i]) == NULL) {
+	    stream.channels = 0;
+	    break;
+	}
+	stream.map[i] = cstr[i];
+    }
+    (*env)->ReleaseStringUTFChars(env, map, cstr);
+    if (stream.channels == 0) {
+	throwMagickException(env, "Unsupported pixel map");
+	return;
+    }
+
+    exception=AcquireExceptionInfo();
+    readInfo = CloneImageInfo(imageInfo);
+    stream.monitor = imageInfo->progress_monitor;
+    stream.monitorData = imageInfo->client_data;
+    readInfo->progress_monitor = stream.monitor != NULL ?
+	monitorPixelStream : (MagickProgressMonitor) NULL;
+    readInfo->client_data = (void *) &stream;
+    image = ReadStream(readInfo, readPixelStream, exception);
+    DestroyImageInfo(readInfo);
+    if (image != NULL) {
+#if MagickLibVersion < 0x700
+	DestroyImages(image);
+#else
+	DestroyImageList(image);
+#endif
+    }
+
+    /* Deliver the rows of a final frame shorter than the band. */
+    if (!stream.stopped && !stream.failed && !stream.partialRows
+	&& !stream.cancelled) {
+	flushPixelStream(&stream);
+    }
+    if (stream.band != NULL) {
+	RelinquishMagickMemory(stream.band);
+    }
+
+    /* An exception thrown by the handler is left to propagate. */
+    if (stream.failed) {
+	if (!(*env)->ExceptionCheck(env)) {
+	    throwMagickException(env, "Unable to allocate memory");
+	}
+    }
+    else if (stream.partialRows) {
+	throwMagickException(env, "Coder does not stream whole rows");
+    }
+    else if (stream.cancelled) {
+	throwMagickException(env, "Stream was cancelled");
+    }
+    else if (!stream.stopped && exception->severity >= ErrorException) {
+	throwMagickApiException(env, "Unable to stream image", exception);
+    }
+    DestroyExceptionInfo(exception);
+}
+
+
 /*
  * Class:     magick_MagickImage
  * Method:    pingImage
@@ -323,6 +994,173 @@ JNIEXPORT jboolean JNICALL Java_magick_MagickImage_writeImage
 
 
 
+/*
+ * State of a java.io.OutputStream or java.nio.channels.WritableByteChannel
+ * being written by ImageMagick.
+ */
+typedef struct {
+    JNIEnv *env;
+    jobject sink;
+    jboolean isChannel;
+    jbyteArray chunk;
+    int failed;
+} JavaOutputStream;
+
+/*
+ * Push count bytes of encoder output to the Java sink. A channel is
+ * handed a direct buffer over the encoder memory; a stream is fed
+ * through a Java byte array in chunks.
+ *
+ * Return:
+ *   the number of bytes written, or -1 if the Java sink threw an
+ *   exception (which is left pending). A channel that accepts no
+ *   bytes, as a non-blocking one may, fails with an IOException
+ *   rather than being retried.
+ */
+static ssize_t writeJavaOutputStream(const unsigned char *data,
+                                     const size_t count,
+                                     void *userData)
+{
+    JavaOutputStream *out = (JavaOutputStream *) userData;
+    JNIEnv *env = out->env;
+    jobject buffer;
+    jclass ioExceptionClass;
+    size_t done = 0;
+    jint n;
+
+    if (out->failed) {
+        return -1;
+    }
+
+    if (out->isChannel) {
+        buffer = (*env)->NewDirectByteBuffer(env, (void *) data,
+                                             (jlong) count);
+        if (buffer == NULL) {
+            out->failed = 1;
+            return -1;
+        }
+        while (done < count) {
+            n = (*env)->CallIntMethod(env, out->sink,
+                                      jmagickCache.byteChannelWrite, buffer);
+            if (!(*env)->ExceptionCheck(env) && n <= 0) {
+                ioExceptionClass = (*env)->FindClass(env,
+                                                     "java/io/IOException");
+                if (ioExceptionClass != NULL) {
+                    (*env)->ThrowNew(env, ioExceptionClass,
+                                     "Channel accepted no bytes");
+                }
+            }
+            if ((*env)->ExceptionCheck(env)) {
+                (*env)->DeleteLocalRef(env, buffer);
+                out->failed = 1;
+                return -1;
+            }
+            done += n;
+        }
+        (*env)->DeleteLocalRef(env, buffer);
+        return (ssize_t) count;
+    }
+
+    while (done < count) {
+        n = count - done < STREAM_CHUNK_SIZE ?
+            (jint) (count - done) : STREAM_CHUNK_SIZE;
+        (*env)->SetByteArrayRegion(env, out->chunk, 0, n,
+                                   (const jbyte *) data + done);
+        (*env)->CallVoidMethod(env, out->sink, jmagickCache.outputStreamWrite,
+                               out->chunk, 0, n);
+        if ((*env)->ExceptionCheck(env)) {
+            out->failed = 1;
+            return -1;
+        }
+        done += n;
+    }
+    return (ssize_t) count;
+}
+
+/*
+ * Class:     magick_MagickImage
+ * Method:    imageToStream
+ * Signature: (Lmagick/ImageInfo;Ljava/lang/Object;Z)V
+ */
+JNIEXPORT void JNICALL Java_magick_MagickImage_imageToStream
+    (JNIEnv *env, jobject self, jobject imageInfoObj, jobject sink,
+     jboolean isChannel)
+{
+    ImageInfo *imageInfo = NULL, *writeInfo = NULL;
+    Image *image = NULL;
+    ExceptionInfo *exception;
+    JavaOutputStream out;
+#if MagickLibVersion >= 0x700
+    CustomStreamInfo *customStream;
+#else
+    void *blobMem;
+    size_t blobSiz = 0;
+#endif
+
+    /* Obtain the ImageInfo pointer. */
+    imageInfo = (ImageInfo*) getHandle(env, imageInfoObj,
+				       "imageInfoHandle", NULL);
+    if (imageInfo == NULL) {
+	throwMagickException(env, "Cannot obtain ImageInfo object");
+	return;
+    }
+
+    image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
+    if (image == NULL) {
+	throwMagickException(env, "No image to write");
+	return;
+    }
+
+    out.env = env;
+    out.sink = sink;
+    out.isChannel = isChannel;
+    out.failed = 0;
+    out.chunk = NULL;
+    if (!isChannel) {
+	out.chunk = (*env)->NewByteArray(env, STREAM_CHUNK_SIZE);
+	if (out.chunk == NULL) {
+	    throwMagickException(env, "Unable to allocate array");
+	    return;
+	}
+    }
+
+    exception=AcquireExceptionInfo();
+    writeInfo = CloneImageInfo(imageInfo);
+#if MagickLibVersion >= 0x700
+    /* Push the encoder output to the sink as it is produced. */
+    customStream = AcquireCustomStreamInfo(exception);
+    if (customStream == NULL) {
+	DestroyImageInfo(writeInfo);
+	throwMagickApiException(env, "Unable to write image to stream",
+				exception);
+	DestroyExceptionInfo(exception);
+	return;
+    }
+    SetCustomStreamData(customStream, &out);
+    SetCustomStreamWriter(customStream, writeJavaOutputStream);
+    SetImageInfoCustomStream(writeInfo, customStream);
+    ImagesToCustomStream(writeInfo, image, exception);
+    SetImageInfoCustomStream(writeInfo, (CustomStreamInfo *) NULL);
+    DestroyCustomStreamInfo(customStream);
+#else
+    /* No custom stream support: encode to a blob and push that. */
+    blobMem = ImagesToBlob(writeInfo, image, &blobSiz, exception);
+    if (blobMem != NULL) {
+	writeJavaOutputStream(blobMem, blobSiz, &out);
+	RelinquishMagickMemory(blobMem);
+    }
+#endif
+    DestroyImageInfo(writeInfo);
+
+    /* An IOException thrown by the sink is left to propagate. */
+    if (!out.failed && exception->severity >= ErrorException) {
+	throwMagickApiException(env, "Unable to write image to stream",
+				exception);
+    }
+    DestroyExceptionInfo(exception);
+}
+
+
 /*
  * Class:     magick_MagickImage
  * Method:    getFileName
@@ -421,8 +1259,6 @@ JNIEXPORT jobject JNICALL Java_magick_MagickImage_getDimension
     (JNIEnv *env, jobject self)
 {
     Image *image = NULL;
-    jclass dimensionClass;
-    jmethodID consMethodID;
     jobject dimension;
 
     image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
@@ -430,18 +1266,8 @@ JNIEXPORT jobject JNICALL Java_magick_MagickImage_getDimension
 	throwMagickException(env, "Unable to retrieve handle");
 	return NULL;
     }
-    dimensionClass = (*env)->FindClass(env, "java/awt/Dimension");
-    if (dimensionClass == 0) {
-	throwMagickException(env, "Unable to locate class java.awt.Dimension");
-	return NULL;
-    }
-    consMethodID = (*env)->GetMethodID(env, dimensionClass,
-				       "<init>", "(II)V");
-    if (consMethodID == 0) {
-	throwMagickException(env, "Unable to construct java.awt.Dimension");
-	return NULL;
-    }
-    dimension = (*env)->NewObject(env, dimensionClass, consMethodID,
+    dimension = (*env)->NewObject(env, jmagickCache.dimensionClass,
+				  jmagickCache.dimensionCons,
 				  image->columns, image->rows);
     if (dimension == NULL) {
 	throwMagickException(env, "Unable to construct java.awt.Dimension");
@@ -1195,11 +2021,7 @@ JNIEXPORT void JNICALL
     Image *image = NULL, *oldImage = NULL;
     jfieldID fieldID = 0;
     jint arraySize;
-#if MagickLibVersion < 0x700
     jint *pixelArray;
-#else
-    jlong *pixelArray;
-#endif
     const char *mapStr;
     ExceptionInfo *exception;
 
@@ -1218,11 +2040,8 @@ JNIEXPORT void JNICALL
 	return;
     }
 
-#if MagickLibVersion < 0x700
+    /* IntegerPixel and LongPixel of ImageMagick 7 are both 32-bit. */
     pixelArray = (*env)->GetIntArrayElements(env, pixels, 0);
-#else
-    pixelArray = (*env)->GetLongArrayElements(env, pixels, 0);
-#endif
 
     /* Create that image. */
     exception=AcquireExceptionInfo();
@@ -1235,11 +2054,7 @@ JNIEXPORT void JNICALL
     if (image == NULL) {
 	throwMagickApiException(env, "Unable to create image", exception);
 	(*env)->ReleaseStringUTFChars(env, map, mapStr);
-#if MagickLibVersion < 0x700
 	(*env)->ReleaseIntArrayElements(env, pixels, pixelArray, 0);
-#else
-	(*env)->ReleaseLongArrayElements(env, pixels, pixelArray, 0);
-#endif
 	DestroyExceptionInfo(exception);
 	return;
     }
@@ -1260,11 +2075,7 @@ JNIEXPORT void JNICALL
 
     (*env)->ReleaseStringUTFChars(env, map, mapStr);
 
-#if MagickLibVersion < 0x700
     (*env)->ReleaseIntArrayElements(env, pixels, pixelArray, 0);
-#else
-    (*env)->ReleaseLongArrayElements(env, pixels, pixelArray, 0);
-#endif
 }
 
 /*
@@ -1561,6 +2372,48 @@ JNIEXPORT void JNICALL Java_magick_MagickImage_destroyImages
 #endif
     }
     setHandle(env, self, "magickImageHandle", NULL, &handleFid);
+
+    destroyProgressMonitor(env, (JMagickProgress *)
+	getHandle(env, self, "progressMonitorHandle",
+		  &jmagickCache.magickImageProgress));
+    setHandle(env, self, "progressMonitorHandle", NULL,
+	      &jmagickCache.magickImageProgress);
+}
+
+
+/*
+ * Class:     magick_MagickImage
+ * Method:    setProgressMonitor
+ * Signature: (Lmagick/ProgressMonitor;Lmagick/CancelToken;)V
+ */
+JNIEXPORT void JNICALL Java_magick_MagickImage_setProgressMonitor
+    (JNIEnv *env, jobject self, jobject monitor, jobject token)
+{
+    Image *image = NULL, *p;
+    JMagickProgress *progress, *oldProgress;
+
+    image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
+    if (image == NULL) {
+	throwMagickException(env, "No image to monitor");
+	return;
+    }
+
+    progress = newProgressMonitor(env, monitor, token);
+    if (progress == NULL && (monitor != NULL || token != NULL)) {
+	throwMagickException(env, "Unable to allocate memory");
+	return;
+    }
+    for (p = image; p != NULL; p = GetNextImageInList(p)) {
+	SetImageProgressMonitor(p, progress != NULL ? monitorProgress :
+				(MagickProgressMonitor) NULL, progress);
+    }
+
+    oldProgress = (JMagickProgress *)
+	getHandle(env, self, "progressMonitorHandle",
+		  &jmagickCache.magickImageProgress);
+    setHandle(env, self, "progressMonitorHandle", (void *) progress,
+	      &jmagickCache.magickImageProgress);
+    destroyProgressMonitor(env, oldProgress);
 }
 
 
@@ -1617,8 +2470,6 @@ JNIEXPORT jobject JNICALL Java_magick_MagickImage_getTypeMetrics
     (JNIEnv *env, jobject self, jobject drawInfoObj)
 {
     TypeMetric typeMetric;
-    jclass typeMetricClass;
-    jmethodID consMethodID;
     jobject typeMetricObject;
 
     DrawInfo *drawInfo;
@@ -1658,18 +2509,8 @@ JNIEXPORT jobject JNICALL Java_magick_MagickImage_getTypeMetrics
 #endif
 
 
-    typeMetricClass = (*env)->FindClass(env, "magick/TypeMetric");
-    if (typeMetricClass == 0) {
-        throwMagickException(env, "Unable to locate class magick/TypeMetric");
-        return NULL;
-    }
-    consMethodID = (*env)->GetMethodID(env, typeMetricClass,
-				       "<init>", "(DD" "DDDDDDD" "DDDD" "DD)V");
-    if (consMethodID == 0) {
-        throwMagickException(env, "Unable to construct magick/TypeMetric");
-        return NULL;
-    }
-    typeMetricObject = (*env)->NewObject(env, typeMetricClass, consMethodID,
+    typeMetricObject = (*env)->NewObject(env, jmagickCache.typeMetricClass,
+        jmagickCache.typeMetricCons,
     	typeMetric.pixels_per_em.x, typeMetric.pixels_per_em.y,
         typeMetric.ascent, typeMetric.descent,
         typeMetric.width, typeMetric.height, typeMetric.max_advance,
@@ -2683,8 +3524,6 @@ JNIEXPORT jobject JNICALL Java_magick_MagickImage_getBoundingBox
 {
     ExceptionInfo *exception;
     Image *image = NULL;
-    jclass rectangleClass;
-    jmethodID consMethodID;
     jobject rectangle;
 
     image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
@@ -2693,21 +3532,10 @@ JNIEXPORT jobject JNICALL Java_magick_MagickImage_getBoundingBox
     return NULL;
     }
 
-    rectangleClass = (*env)->FindClass(env, "java/awt/Rectangle");
-    if (rectangleClass == 0) {
-    throwMagickException(env, "Unable to locate class java.awt.Rectangle");
-    return NULL;
-    }
-    consMethodID = (*env)->GetMethodID(env, rectangleClass,
-                       "<init>", "(IIII)V");
-    if (consMethodID == 0) {
-    throwMagickException(env, "Unable to construct java.awt.Rectangle");
-    return NULL;
-    }
-
     exception=AcquireExceptionInfo();
     RectangleInfo info = GetImageBoundingBox(image, exception);
-    rectangle = (*env)->NewObject(env, rectangleClass, consMethodID,
+    rectangle = (*env)->NewObject(env, jmagickCache.rectangleClass,
+                  jmagickCache.rectangleCons,
                   info.x, info.y, info.width, info.height);
     if (rectangle == NULL) {
     throwMagickException(env, "Unable to construct java.awt.Rectangle");
@@ -3546,11 +4374,7 @@ JNIEXPORT jboolean JNICALL
     Image *image = NULL;
     jint arraySize;
     const char *mapStr;
-#if MagickLibVersion < 0x700
     jint *pixelArray;
-#else
-    jlong *pixelArray;
-#endif
     int result;
     ExceptionInfo *exception;
 
@@ -3576,11 +4400,8 @@ JNIEXPORT jboolean JNICALL
     }
 
     /* Get the pixel storage array and store the pixels. */
-#if MagickLibVersion < 0x700
+    /* IntegerPixel and LongPixel of ImageMagick 7 are both 32-bit. */
     pixelArray = (*env)->GetIntArrayElements(env, pixels, 0);
-#else
-    pixelArray = (*env)->GetLongArrayElements(env, pixels, 0);
-#endif
     exception=AcquireExceptionInfo();
 #if MagickLibVersion < 0x700
     result = DispatchImage(image, x, y, width, height,
@@ -3592,11 +4413,7 @@ JNIEXPORT jboolean JNICALL
 
     /* Cleanup. */
     (*env)->ReleaseStringUTFChars(env, map, mapStr);
-#if MagickLibVersion < 0x700
     (*env)->ReleaseIntArrayElements(env, pixels, pixelArray, 0);
-#else
-    (*env)->ReleaseLongArrayElements(env, pixels, pixelArray, 0);
-#endif
     if (result == JNI_FALSE) {
         throwMagickApiException(env, "Error dispatching image", exception);
     }
@@ -3631,42 +4448,297 @@ JNIEXPORT jboolean JNICALL
 	throwMagickException(env, "Unable to get component map");
 	return JNI_FALSE;
     }
-    arraySize = width * height * strlen(mapStr);
-    if ((*env)->GetArrayLength(env, pixels) < arraySize) {
+    arraySize = width * height * strlen(mapStr);
+    if ((*env)->GetArrayLength(env, pixels) < arraySize) {
+	throwMagickException(env, "Pixels size too small");
+	(*env)->ReleaseStringUTFChars(env, map, mapStr);
+	return JNI_FALSE;
+    }
+
+    /* Get the image object. */
+    image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
+    if (image == NULL) {
+	throwMagickException(env, "Cannot obtain image handle");
+	(*env)->ReleaseStringUTFChars(env, map, mapStr);
+	return JNI_FALSE;
+    }
+
+    /* Get the pixel storage array and store the pixels. */
+    pixelArray = (*env)->GetFloatArrayElements(env, pixels, 0);
+    exception=AcquireExceptionInfo();
+#if MagickLibVersion < 0x700
+    result = DispatchImage(image, x, y, width, height,
+			   mapStr, FloatPixel, pixelArray, exception);
+#else
+    result = ExportImagePixels(image, x, y, width, height,
+			   mapStr, FloatPixel, pixelArray, exception);
+#endif
+
+    /* Cleanup. */
+    (*env)->ReleaseStringUTFChars(env, map, mapStr);
+    (*env)->ReleaseFloatArrayElements(env, pixels, pixelArray, 0);
+
+    if (result == JNI_FALSE) {
+        throwMagickApiException(env, "Error dispatching image", exception);
+    }
+
+    DestroyExceptionInfo(exception);
+    return result;
+}
+
+
+/*
+ * Class:     magick_MagickImage
+ * Method:    transferPixels
+ * Signature: (IIIILjava/lang/String;ILjava/lang/Object;IIZZ)Z
+ */
+JNIEXPORT jboolean JNICALL Java_magick_MagickImage_transferPixels
+    (JNIEnv *env, jobject self,
+     jint x, jint y, jint width, jint height,
+     jstring map, jint storageType, jobject pixels,
+     jint offset, jint length, jboolean isDirect, jboolean isImport)
+{
+    Image *image = NULL;
+    const char *mapStr;
+    unsigned char *pixelArray;
+    size_t componentSize, required;
+    MagickBooleanType result;
+    ExceptionInfo *exception;
+
+    /* Get the image object. */
+    image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
+    if (image == NULL) {
+	throwMagickException(env, "Cannot obtain image handle");
+	return JNI_FALSE;
+    }
+
+    componentSize = getStorageTypeSize(storageType);
+    if (componentSize == 0) {
+	throwMagickException(env, "Unknown storage type");
+	return JNI_FALSE;
+    }
+
+    /* Obtain the minimum pixel buffer size required and check correctness. */
+    mapStr = (*env)->GetStringUTFChars(env, map, 0);
+    if (mapStr == NULL) {
+	throwMagickException(env, "Unable to get component map");
+	return JNI_FALSE;
+    }
+    required = (size_t) width * height * strlen(mapStr) * componentSize;
+    if ((size_t) length < required) {
+	throwMagickException(env, "Pixels size too small");
+	(*env)->ReleaseStringUTFChars(env, map, mapStr);
+	return JNI_FALSE;
+    }
+
+    /*
+     * A direct buffer is handed to ImageMagick in place. A heap array
+     * is pinned for the duration of the transfer, during which no
+     * other JNI call may be made.
+     */
+    exception=AcquireExceptionInfo();
+    if (isDirect) {
+	pixelArray = (unsigned char *) (*env)->GetDirectBufferAddress(env,
+								      pixels);
+    }
+    else {
+	pixelArray = (unsigned char *)
+	    (*env)->GetPrimitiveArrayCritical(env, pixels, NULL);
+    }
+    if (pixelArray == NULL) {
+	(*env)->ReleaseStringUTFChars(env, map, mapStr);
+	DestroyExceptionInfo(exception);
+	throwMagickException(env, "Unable to access pixel buffer");
+	return JNI_FALSE;
+    }
+
+    if (isImport) {
+#if MagickLibVersion < 0x700
+	result = ImportImagePixels(image, x, y, width, height, mapStr,
+				   (StorageType) storageType,
+				   pixelArray + offset);
+	if (result == MagickFalse) {
+	    InheritException(exception, &image->exception);
+	}
+#else
+	result = ImportImagePixels(image, x, y, width, height, mapStr,
+				   (StorageType) storageType,
+				   pixelArray + offset, exception);
+#endif
+    }
+    else {
+	result = ExportImagePixels(image, x, y, width, height, mapStr,
+				   (StorageType) storageType,
+				   pixelArray + offset, exception);
+    }
+
+    /* Cleanup. */
+    if (!isDirect) {
+	(*env)->ReleasePrimitiveArrayCritical(env, pixels, pixelArray,
+					      isImport ? JNI_ABORT : 0);
+    }
+    (*env)->ReleaseStringUTFChars(env, map, mapStr);
+
+    if (result == MagickFalse) {
+	throwMagickApiException(env, isImport ? "Error importing pixels" :
+				"Error exporting pixels", exception);
+    }
+
+    DestroyExceptionInfo(exception);
+    return result == MagickFalse ? JNI_FALSE : JNI_TRUE;
+}
+
+
+/*
+ * Check whether pixels with the given map can be imported into an
+ * existing image so that it ends up as ConstituteImage would create
+ * it: an sRGB image with an alpha channel only if the map has one.
+ * Maps with gray or CMYK components make ConstituteImage change the
+ * colorspace, so they are never imported in place.
+ */
+static int canImportInPlace(const Image *image, const char *map)
+{
+    int mapAlpha = 0, imageAlpha;
+    const char *p;
+
+    if (image->colorspace != sRGBColorspace) {
+	return 0;
+    }
+    for (p = map; *p != '\0'; p++) {
+	switch (*p) {
+	case 'A': case 'a': case 'O': case 'o':
+	    mapAlpha = 1;
+	    break;
+	case 'R': case 'r': case 'G': case 'g': case 'B': case 'b':
+	case 'P': case 'p':
+	    break;
+	default:
+	    return 0;
+	}
+    }
+#if MagickLibVersion < 0x700
+    imageAlpha = image->matte != MagickFalse;
+#else
+    imageAlpha = image->alpha_trait != UndefinedPixelTrait;
+#endif
+    return mapAlpha == imageAlpha;
+}
+
+
+/*
+ * Class:     magick_MagickImage
+ * Method:    constitutePixels
+ * Signature: (IILjava/lang/String;ILjava/lang/Object;IIZ)V
+ */
+JNIEXPORT void JNICALL Java_magick_MagickImage_constitutePixels
+    (JNIEnv *env, jobject self,
+     jint width, jint height,
+     jstring map, jint storageType, jobject pixels,
+     jint offset, jint length, jboolean reuse)
+{
+    Image *image = NULL, *oldImage = NULL;
+    jfieldID fieldID = 0;
+    const char *mapStr;
+    unsigned char *pixelArray;
+    size_t componentSize, required;
+    MagickBooleanType result = MagickTrue;
+    ExceptionInfo *exception;
+
+    /* Check that we really have the pixels. */
+    if (pixels == NULL) {
+	throwMagickException(env, "Pixels not allocated");
+	return;
+    }
+
+    componentSize = getStorageTypeSize(storageType);
+    if (componentSize == 0) {
+	throwMagickException(env, "Unknown storage type");
+	return;
+    }
+
+    /* Check the array size. */
+    mapStr = (*env)->GetStringUTFChars(env, map, 0);
+    if (mapStr == NULL) {
+	throwMagickException(env, "Unable to get component map");
+	return;
+    }
+    required = (size_t) width * height * strlen(mapStr) * componentSize;
+    if ((size_t) length < required) {
 	throwMagickException(env, "Pixels size too small");
 	(*env)->ReleaseStringUTFChars(env, map, mapStr);
-	return JNI_FALSE;
+	return;
     }
 
-    /* Get the image object. */
-    image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
-    if (image == NULL) {
-	throwMagickException(env, "Cannot obtain image handle");
-	(*env)->ReleaseStringUTFChars(env, map, mapStr);
-	return JNI_FALSE;
+    /*
+     * A single-frame image of the same size, colorspace and alpha
+     * state is overwritten in place, keeping its pixel cache and
+     * attributes.
+     */
+    oldImage = (Image*) getHandle(env, self, "magickImageHandle", &fieldID);
+    if (!reuse || oldImage == NULL || oldImage->next != NULL ||
+	oldImage->columns != (size_t) width ||
+	oldImage->rows != (size_t) height ||
+	!canImportInPlace(oldImage, mapStr)) {
+	oldImage = NULL;
     }
 
-    /* Get the pixel storage array and store the pixels. */
-    pixelArray = (*env)->GetFloatArrayElements(env, pixels, 0);
+    /* Create that image straight from the pinned array. */
     exception=AcquireExceptionInfo();
+    pixelArray = (unsigned char *)
+	(*env)->GetPrimitiveArrayCritical(env, pixels, NULL);
+    if (pixelArray == NULL) {
+	(*env)->ReleaseStringUTFChars(env, map, mapStr);
+	DestroyExceptionInfo(exception);
+	throwMagickException(env, "Unable to access pixel array");
+	return;
+    }
+    if (oldImage != NULL) {
 #if MagickLibVersion < 0x700
-    result = DispatchImage(image, x, y, width, height,
-			   mapStr, FloatPixel, pixelArray, exception);
+	result = ImportImagePixels(oldImage, 0, 0, width, height, mapStr,
+				   (StorageType) storageType,
+				   pixelArray + offset);
+	if (result == MagickFalse) {
+	    InheritException(exception, &oldImage->exception);
+	}
 #else
-    result = ExportImagePixels(image, x, y, width, height,
-			   mapStr, FloatPixel, pixelArray, exception);
+	result = ImportImagePixels(oldImage, 0, 0, width, height, mapStr,
+				   (StorageType) storageType,
+				   pixelArray + offset, exception);
 #endif
-
-    /* Cleanup. */
+    }
+    else {
+	image = ConstituteImage(width, height, mapStr,
+				(StorageType) storageType,
+				pixelArray + offset, exception);
+    }
+    (*env)->ReleasePrimitiveArrayCritical(env, pixels, pixelArray, JNI_ABORT);
     (*env)->ReleaseStringUTFChars(env, map, mapStr);
-    (*env)->ReleaseFloatArrayElements(env, pixels, pixelArray, 0);
+    if (oldImage != NULL) {
+	if (result == MagickFalse) {
+	    throwMagickApiException(env, "Unable to import pixels", exception);
+	}
+	DestroyExceptionInfo(exception);
+	return;
+    }
+    if (image == NULL) {
+	throwMagickApiException(env, "Unable to create image", exception);
+	DestroyExceptionInfo(exception);
+	return;
+    }
+    DestroyExceptionInfo(exception);
 
-    if (result == JNI_FALSE) {
-        throwMagickApiException(env, "Error dispatching image", exception);
+    /* Get the old image handle and deallocate it (if required). */
+    oldImage = (Image*) getHandle(env, self, "magickImageHandle", &fieldID);
+    if (oldImage != NULL) {
+#if MagickLibVersion < 0x700
+        DestroyImages(oldImage);
+#else
+	DestroyImageList(oldImage);
+#endif
     }
 
-    DestroyExceptionInfo(exception);
-    return result;
+    /* Store the image into the handle. */
+    setHandle(env, self, "magickImageHandle", (void*) image, &fieldID);
 }
 
 
@@ -4225,6 +5297,70 @@ JNIEXPORT void JNICALL Java_magick_MagickImage_blobToImage
 
 
 
+/*
+ * Class:     magick_MagickImage
+ * Method:    directBlobToImage
+ * Signature: (Lmagick/ImageInfo;Ljava/nio/ByteBuffer;II)V
+ */
+JNIEXPORT void JNICALL Java_magick_MagickImage_directBlobToImage
+    (JNIEnv *env, jobject self, jobject imageInfoObj, jobject blob,
+     jint offset, jint length)
+{
+    jbyte *blobMem;
+    jlong blobCap;
+    ExceptionInfo *exception;
+    Image *image, *oldImage;
+    jfieldID fieldID = 0;
+    ImageInfo *imageInfo;
+
+    /* Obtain the ImageInfo pointer */
+    imageInfo = (ImageInfo*) getHandle(env, imageInfoObj,
+                                       "imageInfoHandle", NULL);
+    if (imageInfo == NULL) {
+        throwMagickException(env, "Cannot obtain ImageInfo object");
+        return;
+    }
+
+    /* Get the address of the buffer memory. No copy is made. */
+    blobMem = (jbyte *) (*env)->GetDirectBufferAddress(env, blob);
+    blobCap = (*env)->GetDirectBufferCapacity(env, blob);
+    if (blobMem == NULL || blobCap < 0) {
+        throwMagickException(env, "Blob is not a direct buffer");
+        return;
+    }
+    if (offset < 0 || length < 0 || (jlong) offset + length > blobCap) {
+        throwMagickException(env, "Blob offset or length out of range");
+        return;
+    }
+
+    /* Create that image. */
+    exception=AcquireExceptionInfo();
+    image = BlobToImage(imageInfo, blobMem + offset, (size_t) length,
+                        exception);
+    if (image == NULL) {
+        throwMagickApiException(env, "Unable to convert blob to image",
+                                exception);
+        DestroyExceptionInfo(exception);
+        return;
+    }
+    DestroyExceptionInfo(exception);
+
+    /* Get the old image handle and deallocate it (if required). */
+    oldImage = (Image*) getHandle(env, self, "magickImageHandle", &fieldID);
+    if (oldImage != NULL) {
+#if MagickLibVersion < 0x700
+        DestroyImages(oldImage);
+#else
+        DestroyImageList(oldImage);
+#endif
+    }
+
+    /* Store the image into the handle. */
+    setHandle(env, self, "magickImageHandle", (void*) image, &fieldID);
+}
+
+
+
 /*
  * Class:     magick_MagickImage
  * Method:    imageToBlob
@@ -4345,6 +5481,149 @@ JNIEXPORT jbyteArray JNICALL Java_magick_MagickImage_imagesToBlob
   return blob;
 }
 
+/*
+ * Encode the image, or the whole image sequence, into memory
+ * allocated by ImageMagick.
+ *
+ * Input:
+ *   env           Java VM environment
+ *   self          the MagickImage object
+ *   imageInfoObj  ImageInfo object determining the output format, or null
+ *   allImages     non-zero to encode the whole image sequence
+ *
+ * Output:
+ *   blobSiz       size of the encoded image
+ *
+ * Return:
+ *   The blob, to be released with RelinquishMagickMemory, or NULL
+ *   with a Java exception pending.
+ */
+static void *encodeBlob(JNIEnv *env,
+                        jobject self,
+                        jobject imageInfoObj,
+                        jboolean allImages,
+                        size_t *blobSiz)
+{
+  ImageInfo *imageInfo;
+  Image *image;
+  ExceptionInfo *exception;
+  void *blobMem = NULL;
+
+  /* Obtain the ImageInfo pointer */
+  if (imageInfoObj != NULL) {
+    imageInfo = (ImageInfo*) getHandle(env, imageInfoObj,
+                                       "imageInfoHandle", NULL);
+    if (imageInfo == NULL) {
+      throwMagickException(env, "Cannot obtain ImageInfo object");
+      return NULL;
+    }
+  }
+  else {
+    imageInfo = NULL;
+  }
+
+  /* Get the Image pointer */
+  image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
+  if (image == NULL) {
+    throwMagickException(env, "No image to convert to blob");
+    return NULL;
+  }
+
+  /* Do the conversion */
+  *blobSiz = 0;
+  exception=AcquireExceptionInfo();
+  if (allImages) {
+    blobMem = ImagesToBlob(imageInfo, image, blobSiz, exception);
+  }
+  else {
+    blobMem = ImageToBlob(imageInfo, image, blobSiz, exception);
+  }
+  if (blobMem == NULL) {
+    throwMagickApiException(env, "Unable to convert image to blob", exception);
+    DestroyExceptionInfo(exception);
+    return NULL;
+  }
+  DestroyExceptionInfo(exception);
+
+  return blobMem;
+}
+
+/*
+ * Class:     magick_MagickImage
+ * Method:    directImageToBlob
+ * Signature: (Lmagick/ImageInfo;Ljava/nio/ByteBuffer;IIZ)I
+ */
+JNIEXPORT jint JNICALL Java_magick_MagickImage_directImageToBlob
+ (JNIEnv *env, jobject self, jobject imageInfoObj, jobject buffer,
+  jint offset, jint length, jboolean allImages)
+{
+  size_t blobSiz = 0;
+  void *blobMem = NULL;
+  jbyte *bufferMem;
+  jlong bufferCap;
+
+  /* Get the address of the buffer memory. */
+  bufferMem = (jbyte *) (*env)->GetDirectBufferAddress(env, buffer);
+  bufferCap = (*env)->GetDirectBufferCapacity(env, buffer);
+  if (bufferMem == NULL || bufferCap < 0) {
+    throwMagickException(env, "Buffer is not a direct buffer");
+    return 0;
+  }
+  if (offset < 0 || length < 0 || (jlong) offset + length > bufferCap) {
+    throwMagickException(env, "Buffer offset or length out of range");
+    return 0;
+  }
+
+  blobMem = encodeBlob(env, self, imageInfoObj, allImages, &blobSiz);
+  if (blobMem == NULL) {
+    return 0;
+  }
+  if (blobSiz > 0x7fffffff) {
+    RelinquishMagickMemory(blobMem);
+    throwMagickException(env, "Blob too large for a buffer");
+    return 0;
+  }
+
+  /* Too small: report the size required. */
+  if (blobSiz > (size_t) length) {
+    RelinquishMagickMemory(blobMem);
+    return -((jint) blobSiz);
+  }
+
+  memcpy(bufferMem + offset, blobMem, blobSiz);
+  RelinquishMagickMemory(blobMem);
+
+  return (jint) blobSiz;
+}
+
+/*
+ * Class:     magick_MagickImage
+ * Method:    nativeImageToBlob
+ * Signature: (Lmagick/ImageInfo;Z)Ljava/nio/ByteBuffer;
+ */
+JNIEXPORT jobject JNICALL Java_magick_MagickImage_nativeImageToBlob
+ (JNIEnv *env, jobject self, jobject imageInfoObj, jboolean allImages)
+{
+  size_t blobSiz = 0;
+  void *blobMem = NULL;
+  jobject buffer;
+
+  blobMem = encodeBlob(env, self, imageInfoObj, allImages, &blobSiz);
+  if (blobMem == NULL) {
+    return NULL;
+  }
+
+  /* The buffer owns the blob memory until MagickBlob.release(). */
+  buffer = (*env)->NewDirectByteBuffer(env, blobMem, (jlong) blobSiz);
+  if (buffer == NULL) {
+    RelinquishMagickMemory(blobMem);
+    throwMagickException(env, "Unable to allocate direct buffer");
+    return NULL;
+  }
+
+  return buffer;
+}
+
 /*
  * Class:     magick_MagickImage
  * Method:    coalesceImages
@@ -4453,13 +5732,98 @@ JNIEXPORT jobject JNICALL Java_magick_MagickImage_nextImage
         return NULL;
     }
 
-    nextImage = image->next;
-    /* unlink image from sequence */
-    image->next = NULL;
-    nextImage->previous = NULL;
-
-    newObj = newImageObject(env, nextImage);
+    nextImage = image->next;
+    /* unlink image from sequence */
+    image->next = NULL;
+    nextImage->previous = NULL;
+
+    /* Account for this image without the frames it gave away */
+    setHandle(env, self, "magickImageHandle", (void *) image,
+	      &jmagickCache.magickImageHandle);
+
+    newObj = newImageObject(env, nextImage);
+    if (newObj == NULL) {
+       throwMagickException(env, "Unable to create a new MagickImage object");
+       return NULL;
+    }
+
+    return newObj;
+}
+
+JNIEXPORT jboolean JNICALL Java_magick_MagickImage_hasFrames
+  (JNIEnv *env, jobject self)
+{
+    Image *image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
+    if (image == NULL) {
+       throwMagickException(env, "Cannot obtain image handle");
+       return JNI_FALSE;
+    }
+
+    if (image->next == NULL) {
+        return JNI_FALSE;
+    } else {
+        return JNI_TRUE;
+    }
+}
+
+JNIEXPORT jint JNICALL Java_magick_MagickImage_getNumFrames
+  (JNIEnv *env, jobject self)
+{
+    int count = 0;
+    Image *image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
+    if (image == NULL) {
+       throwMagickException(env, "Cannot obtain image handle");
+       return 0;
+    }
+
+    while (image != NULL) {
+        count++;
+        image = image->next;
+    }
+
+    return count;
+}
+
+/*
+ * Class:     magick_MagickImage
+ * Method:    getFrame
+ * Signature: (I)Lmagick/MagickImage;
+ */
+JNIEXPORT jobject JNICALL Java_magick_MagickImage_getFrame
+  (JNIEnv *env, jobject self, jint index)
+{
+    jobject newObj;
+    Image *frame, *clone;
+    ExceptionInfo *exception;
+    Image *image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
+    if (image == NULL) {
+       throwMagickException(env, "Cannot obtain image handle");
+       return NULL;
+    }
+
+    frame = GetImageFromList(image, index);
+    if (index < 0 || frame == NULL) {
+       throwMagickException(env, "No such frame");
+       return NULL;
+    }
+
+    /* A clone of the same size shares the pixel cache until written. */
+    exception = AcquireExceptionInfo();
+    clone = CloneImage(frame, 0, 0, MagickTrue, exception);
+    if (clone == NULL) {
+       throwMagickApiException(env, "Unable to clone frame", exception);
+       DestroyExceptionInfo(exception);
+       return NULL;
+    }
+    DestroyExceptionInfo(exception);
+
+    newObj = newImageObject(env, clone);
     if (newObj == NULL) {
+#if MagickLibVersion < 0x700
+       DestroyImages(clone);
+#else
+       DestroyImageList(clone);
+#endif
        throwMagickException(env, "Unable to create a new MagickImage object");
        return NULL;
     }
@@ -4467,38 +5831,45 @@ JNIEXPORT jobject JNICALL Java_magick_MagickImage_nextImage
     return newObj;
 }
 
-JNIEXPORT jboolean JNICALL Java_magick_MagickImage_hasFrames
+/*
+ * Class:     magick_MagickImage
+ * Method:    cloneImageList
+ * Signature: ()Lmagick/MagickImage;
+ */
+JNIEXPORT jobject JNICALL Java_magick_MagickImage_cloneImageList
   (JNIEnv *env, jobject self)
 {
+    jobject newObj;
+    Image *clone;
+    ExceptionInfo *exception;
     Image *image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
     if (image == NULL) {
        throwMagickException(env, "Cannot obtain image handle");
-       return JNI_FALSE;
-    }
-
-    if (image->next == NULL) {
-        return JNI_FALSE;
-    } else {
-        return JNI_TRUE;
+       return NULL;
     }
-}
 
-JNIEXPORT jint JNICALL Java_magick_MagickImage_getNumFrames
-  (JNIEnv *env, jobject self)
-{
-    int count = 0;
-    Image *image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
-    if (image == NULL) {
-       throwMagickException(env, "Cannot obtain image handle");
-       return 0;
+    /* Each clone shares the pixel cache of its frame until written. */
+    exception = AcquireExceptionInfo();
+    clone = CloneImageList(image, exception);
+    if (clone == NULL) {
+       throwMagickApiException(env, "Unable to clone image", exception);
+       DestroyExceptionInfo(exception);
+       return NULL;
     }
+    DestroyExceptionInfo(exception);
 
-    while (image != NULL) {
-        count++;
-        image = image->next;
+    newObj = newImageObject(env, clone);
+    if (newObj == NULL) {
+#if MagickLibVersion < 0x700
+       DestroyImages(clone);
+#else
+       DestroyImageList(clone);
+#endif
+       throwMagickException(env, "Unable to create a new MagickImage object");
+       return NULL;
     }
 
-    return count;
+    return newObj;
 }
 
 /*
@@ -4622,7 +5993,8 @@ JNIEXPORT void JNICALL Java_magick_MagickImage_setColorProfile
        return;
     }
 
-    info = getByteArrayFieldValue(env, profileObj, "info", NULL, &infoSize);
+    info = getByteArrayFieldValue(env, profileObj, "info",
+                                  &jmagickCache.profileInfoInfo, &infoSize);
 
 #ifdef DIAGNOSTIC
     fprintf(stderr, "setColorProfile infoSize = %d  info = %p\n\n", infoSize, info);
@@ -4695,7 +6067,8 @@ JNIEXPORT void JNICALL Java_magick_MagickImage_setIptcProfile
     }
 
     //name = getStringFieldValue(env, profileObj, "name", NULL);
-    info = getByteArrayFieldValue(env, profileObj, "info", NULL, &infoSize);
+    info = getByteArrayFieldValue(env, profileObj, "info",
+                                  &jmagickCache.profileInfoInfo, &infoSize);
 
 #ifdef DIAGNOSTIC
     fprintf(stderr, "setIptcProfile 8BIM infoSize = %d  info = %p\n\n", infoSize, info);
@@ -5104,60 +6477,19 @@ JNIEXPORT jobject JNICALL Java_magick_MagickImage_autoOrientImage
     }
 
     exception=AcquireExceptionInfo();
-    orient_image=NewImageList();
-    switch (image->orientation)
-     {
-       case TopRightOrientation:
-        {
-          orient_image=FlopImage(image,exception);
-          break;
-        }
-       case BottomRightOrientation:
-        {
-          orient_image=RotateImage(image,180.0,exception);
-          break;
-        }
-       case BottomLeftOrientation:
-        {
-          orient_image=FlipImage(image,exception);
-          break;
-        }
-       case LeftTopOrientation:
-        {
-          orient_image=TransposeImage(image,exception);
-          break;
-        }
-       case RightTopOrientation:
-        {
-          orient_image=RotateImage(image,90.0,exception);
-          break;
-        }
-       case RightBottomOrientation:
-        {
-          orient_image=TransverseImage(image,exception);
-          break;
-        }
-       case LeftBottomOrientation:
-        {
-          orient_image=RotateImage(image,270.0,exception);
-          break;
-        }
-       default:
-          orient_image=CloneImage(image,0,0,MagickTrue,exception);
-          image=orient_image;
-          break;
-     }
-    if (orient_image == (Image *) NULL) {
+    orient_image = getOrientedImage(image, exception);
+    if (orient_image == NULL && exception->severity < ErrorException) {
+        /* Already upright */
+        orient_image = CloneImage(image, 0, 0, MagickTrue, exception);
+    }
+    if (orient_image == NULL) {
         throwMagickApiException(env, "Failed to auto-orient image",
                                 exception);
         DestroyExceptionInfo(exception);
         return NULL;
     }
-    if ( orient_image != image ) {
-        orient_image->orientation=TopLeftOrientation;
-        image=orient_image;
-     }
     DestroyExceptionInfo(exception);
+    image = orient_image;
 
     newObj = newImageObject(env, image);
     if (newObj == NULL) {
@@ -5344,8 +6676,6 @@ JNIEXPORT jobject JNICALL Java_magick_MagickImage_getOnePixel
 #else
     PixelInfo pixel;
 #endif
-    jclass pixelPacketClass;
-    jmethodID consMethodID;
 
     image = (Image *) getHandle(env, self, "magickImageHandle", NULL);
     if (image == NULL) {
@@ -5369,21 +6699,8 @@ JNIEXPORT jobject JNICALL Java_magick_MagickImage_getOnePixel
     DestroyExceptionInfo(exception);
 #endif
 
-    pixelPacketClass = (*env)->FindClass(env, "magick/PixelPacket");
-    if (pixelPacketClass == 0) {
-        throwMagickException(env,
-                             "Unable to locate class magick.PixelPacket");
-        return NULL;
-    }
-
-    consMethodID = (*env)->GetMethodID(env, pixelPacketClass,
-                                       "<init>", "(IIII)V");
-    if (consMethodID == 0) {
-        throwMagickException(env, "Unable to construct magick.PixelPacket");
-        return NULL;
-    }
-
-    jPixelPacket = (*env)->NewObject(env, pixelPacketClass, consMethodID,
+    jPixelPacket = (*env)->NewObject(env, jmagickCache.pixelPacketClass,
+                                     jmagickCache.pixelPacketCons,
                                      (jint) pixel.red,
                                      (jint) pixel.green,
                                      (jint) pixel.blue,
@@ -5550,8 +6867,6 @@ JNIEXPORT jobject JNICALL Java_magick_MagickImage_getColormap__I
 {
     Image *image;
     jobject jPixelPacket = NULL;
-    jclass pixelPacketClass;
-    jmethodID consMethodID;
 
     image = (Image*) getHandle(env, self, "magickImageHandle", NULL);
     if (image == NULL) {
@@ -5564,21 +6879,8 @@ JNIEXPORT jobject JNICALL Java_magick_MagickImage_getColormap__I
         return NULL;
     }
 
-    pixelPacketClass = (*env)->FindClass(env, "magick/PixelPacket");
-    if (pixelPacketClass == 0) {
-	throwMagickException(env,
-			     "Unable to locate class magick.PixelPacket");
-	return NULL;
-    }
-
-    consMethodID = (*env)->GetMethodID(env, pixelPacketClass,
-				       "<init>", "(IIII)V");
-    if (consMethodID == 0) {
-	throwMagickException(env, "Unable to construct magick.PixelPacket");
-	return NULL;
-    }
-
-    jPixelPacket = (*env)->NewObject(env, pixelPacketClass, consMethodID,
+    jPixelPacket = (*env)->NewObject(env, jmagickCache.pixelPacketClass,
+                                     jmagickCache.pixelPacketCons,
 		                     (jint) image->colormap[index].red,
 		                     (jint) image->colormap[index].green,
 		                     (jint) image->colormap[index].blue,
@@ -5607,8 +6909,6 @@ JNIEXPORT jobjectArray JNICALL Java_magick_MagickImage_getColormap__
 {
     Image *image;
     jobject jPixelPacket = NULL;
-    jclass pixelPacketClass;
-    jmethodID consMethodID;
     jobjectArray jPPArray;
     int i;
 
@@ -5625,25 +6925,10 @@ JNIEXPORT jobjectArray JNICALL Java_magick_MagickImage_getColormap__
         return NULL;
     }
 
-    /* Get the PixelPacket object class */
-    pixelPacketClass = (*env)->FindClass(env, "magick/PixelPacket");
-    if (pixelPacketClass == 0) {
-	throwMagickException(env,
-			     "Unable to locate class magick.PixelPacket");
-	return NULL;
-    }
-
-    /* Get the constructor ID for PixelPacket */
-    consMethodID = (*env)->GetMethodID(env, pixelPacketClass,
-				       "<init>", "(IIII)V");
-    if (consMethodID == 0) {
-	throwMagickException(env, "Unable to construct magick.PixelPacket");
-	return NULL;
-    }
-
     /* Create the PixelPacket array */
     jPPArray =
-        (*env)->NewObjectArray(env, image->colors, pixelPacketClass, NULL);
+        (*env)->NewObjectArray(env, image->colors,
+                               jmagickCache.pixelPacketClass, NULL);
     if (jPPArray == NULL) {
         throwMagickException(env, "Unable to construct PixelPacket[]");
         return NULL;
@@ -5654,7 +6939,8 @@ JNIEXPORT jobjectArray JNICALL Java_magick_MagickImage_getColormap__
 
         /* Create the PixelPacket */
         jPixelPacket =
-            (*env)->NewObject(env, pixelPacketClass, consMethodID,
+            (*env)->NewObject(env, jmagickCache.pixelPacketClass,
+                              jmagickCache.pixelPacketCons,
                               (jint) image->colormap[i].red,
                               (jint) image->colormap[i].green,
                               (jint) image->colormap[i].blue,
@@ -6209,3 +7495,481 @@ JNIEXPORT jboolean JNICALL Java_magick_MagickImage_setImageProperty
     (*env)->ReleaseStringUTFChars(env, value, valueStr);
     return result;
 }
+
+/*
+ * Class:     magick_MagickImage
+ * Method:    replaceImage
+ * Signature: (Lmagick/MagickImage;)V
+ */
+JNIEXPORT void JNICALL Java_magick_MagickImage_replaceImage
+    (JNIEnv *env, jobject self, jobject resultObj)
+{
+    Image *image, *oldImage, *p;
+    JMagickProgress *progress;
+
+    if (resultObj != NULL && (*env)->IsSameObject(env, self, resultObj)) {
+	throwMagickException(env, "Cannot replace an image with itself");
+	return;
+    }
+    image = resultObj == NULL ? NULL : (Image *)
+	getHandle(env, resultObj, "magickImageHandle",
+		  &jmagickCache.magickImageHandle);
+    if (image == NULL) {
+	throwMagickException(env, "No image to replace with");
+	return;
+    }
+    oldImage = (Image *) getHandle(env, self, "magickImageHandle",
+				   &jmagickCache.magickImageHandle);
+
+    /* Move the frames, then give them the monitor of this image */
+    setHandle(env, resultObj, "magickImageHandle", NULL,
+	      &jmagickCache.magickImageHandle);
+    setHandle(env, self, "magickImageHandle", (void *) image,
+	      &jmagickCache.magickImageHandle);
+    progress = (JMagickProgress *)
+	getHandle(env, self, "progressMonitorHandle",
+		  &jmagickCache.magickImageProgress);
+    for (p = image; p != NULL; p = GetNextImageInList(p)) {
+	SetImageProgressMonitor(p, progress != NULL ? monitorProgress :
+				(MagickProgressMonitor) NULL, progress);
+    }
+
+    if (oldImage != NULL && oldImage != image) {
+#if MagickLibVersion < 0x700
+	DestroyImages(oldImage);
+#else
+	DestroyImageList(oldImage);
+#endif
+    }
+}
+
+/*
+ * Class:     magick_MagickImage
+ * Method:    adoptImages
+ * Signature: ([Lmagick/MagickImage;)V
+ */
+JNIEXPORT void JNICALL Java_magick_MagickImage_adoptImages
+    (JNIEnv *env, jobject self, jobjectArray images)
+{
+    Image **lists, *list = NULL, *oldImage;
+    jobject obj;
+    jsize arrayLen;
+    int i, j;
+
+    arrayLen = images == NULL ? 0 : (*env)->GetArrayLength(env, images);
+    if (arrayLen < 1) {
+	throwMagickException(env, "No images specified");
+	return;
+    }
+    lists = (Image **) AcquireQuantumMemory(arrayLen, sizeof(*lists));
+    if (lists == NULL) {
+	throwMagickException(env, "Unable to allocate memory");
+	return;
+    }
+
+    /* Check every image before moving anything */
+    for (i = 0; i < arrayLen; i++) {
+	obj = (*env)->GetObjectArrayElement(env, images, i);
+	if (obj == NULL) {
+	    throwMagickException(env, "Image in array index null");
+	    RelinquishMagickMemory(lists);
+	    return;
+	}
+	if ((*env)->IsSameObject(env, self, obj)) {
+	    throwMagickException(env, "Cannot adopt an image into itself");
+	    RelinquishMagickMemory(lists);
+	    return;
+	}
+	lists[i] = (Image *) getHandle(env, obj, "magickImageHandle",
+				       &jmagickCache.magickImageHandle);
+	(*env)->DeleteLocalRef(env, obj);
+	if (lists[i] == NULL) {
+	    throwMagickException(env, "Unable to obtain image handle");
+	    RelinquishMagickMemory(lists);
+	    return;
+	}
+	for (j = 0; j < i; j++) {
+	    if (lists[j] == lists[i]) {
+		throwMagickException(env, "Image appears twice in array");
+		RelinquishMagickMemory(lists);
+		return;
+	    }
+	}
+    }
+
+    /* Move the frames, leaving the sources empty */
+    for (i = 0; i < arrayLen; i++) {
+	obj = (*env)->GetObjectArrayElement(env, images, i);
+	setHandle(env, obj, "magickImageHandle", NULL,
+		  &jmagickCache.magickImageHandle);
+	(*env)->DeleteLocalRef(env, obj);
+	AppendImageToList(&list, lists[i]);
+    }
+    RelinquishMagickMemory(lists);
+
+    oldImage = (Image *) getHandle(env, self, "magickImageHandle",
+				   &jmagickCache.magickImageHandle);
+    setHandle(env, self, "magickImageHandle", (void *) list,
+	      &jmagickCache.magickImageHandle);
+    if (oldImage != NULL) {
+#if MagickLibVersion < 0x700
+	DestroyImages(oldImage);
+#else
+	DestroyImageList(oldImage);
+#endif
+    }
+}
+
+/*
+ * Class:     magick_MagickImage
+ * Method:    splitFrames
+ * Signature: ()[Lmagick/MagickImage;
+ */
+JNIEXPORT jobjectArray JNICALL Java_magick_MagickImage_splitFrames
+    (JNIEnv *env, jobject self)
+{
+    Image *image, *frame, *rest;
+    jobjectArray frames;
+    jobject obj;
+    jsize i, count;
+
+    image = (Image *) getHandle(env, self, "magickImageHandle",
+				&jmagickCache.magickImageHandle);
+    if (image == NULL) {
+	throwMagickException(env, "Cannot obtain image handle");
+	return NULL;
+    }
+    count = (jsize) GetImageListLength(image);
+    frames = (*env)->NewObjectArray(env, count,
+				    jmagickCache.magickImageClass, NULL);
+    if (frames == NULL) {
+	return NULL;
+    }
+    (*env)->SetObjectArrayElement(env, frames, 0, self);
+
+    /* Detach each frame before wrapping it, so each image accounts
+       for its own frame only */
+    rest = image->next;
+    image->next = NULL;
+    for (i = 1; rest != NULL; i++) {
+	frame = rest;
+	rest = frame->next;
+	frame->previous = NULL;
+	frame->next = NULL;
+	if (rest != NULL) {
+	    rest->previous = NULL;
+	}
+	obj = newImageObject(env, frame);
+	if (obj == NULL) {
+	    /* Give the frames left back to this image */
+	    frame->next = rest;
+	    if (rest != NULL) {
+		rest->previous = frame;
+	    }
+	    AppendImageToList(&image, frame);
+	    setHandle(env, self, "magickImageHandle", (void *) image,
+		      &jmagickCache.magickImageHandle);
+	    throwMagickException(env, "Unable to create a new MagickImage object");
+	    return NULL;
+	}
+	(*env)->SetObjectArrayElement(env, frames, i, obj);
+	(*env)->DeleteLocalRef(env, obj);
+    }
+    setHandle(env, self, "magickImageHandle", (void *) image,
+	      &jmagickCache.magickImageHandle);
+
+    return frames;
+}
+
+
+
+/*
+ * One rendition made by createRenditions.
+ */
+typedef struct {
+    jint size;			/* the requested size */
+    int same;			/* index of an identical rendition, or -1 */
+    const ImageInfo *imageInfo;
+    Image *image;
+    void *blob;
+    size_t length;
+    ExceptionInfo *exception;
+} Rendition;
+
+/*
+ * The renditions left to encode, shared by the encoding threads.
+ */
+typedef struct {
+    Rendition *renditions;
+    int count;
+    int next;			/* index of the next rendition to encode */
+#ifdef JMAGICK_PTHREADS
+    pthread_mutex_t lock;
+#endif
+} RenditionQueue;
+
+/*
+ * Encode renditions until none is left; the start routine of the
+ * encoding threads, also run by the calling thread.
+ */
+static void *encodeRenditions(void *arg)
+{
+    RenditionQueue *queue = (RenditionQueue *) arg;
+    Rendition *r;
+    int i;
+
+    for (;;) {
+#ifdef JMAGICK_PTHREADS
+	pthread_mutex_lock(&queue->lock);
+#endif
+	i = queue->next++;
+#ifdef JMAGICK_PTHREADS
+	pthread_mutex_unlock(&queue->lock);
+#endif
+	if (i >= queue->count) {
+	    return NULL;
+	}
+	r = &queue->renditions[i];
+	if (r->same < 0) {
+	    r->blob = ImageToBlob(r->imageInfo, r->image, &r->length,
+				  r->exception);
+	}
+    }
+}
+
+/*
+ * Class:     magick_MagickImage
+ * Method:    createRenditions
+ * Signature: ([IILmagick/ImageInfo;)[[B
+ */
+JNIEXPORT jobjectArray JNICALL Java_magick_MagickImage_createRenditions
+  (JNIEnv *env, jobject self, jintArray sizesArray, jint filter,
+   jobject imageInfoObj)
+{
+    ImageInfo *imageInfo;
+    Image *image, *previous;
+    ExceptionInfo *exception;
+    Rendition *renditions, **order, *r, *last = NULL;
+    jint *sizes;
+    jsize count;
+    jclass byteArrayClass;
+    jobjectArray result = NULL;
+    jbyteArray blob;
+    double scale;
+    size_t columns, rows;
+    int i, j;
+    RenditionQueue queue;
+#ifdef JMAGICK_PTHREADS
+    pthread_t *threads;
+    MagickSizeType threadLimit;
+    int threadCount, started;
+#endif
+
+    imageInfo = (ImageInfo *) getHandle(env, imageInfoObj, "imageInfoHandle",
+					&jmagickCache.imageInfoHandle);
+    if (imageInfo == NULL) {
+	throwMagickException(env, "Cannot obtain ImageInfo object");
+	return NULL;
+    }
+    image = (Image *) getHandle(env, self, "magickImageHandle",
+				&jmagickCache.magickImageHandle);
+    if (image == NULL) {
+	throwMagickException(env, "No image to make renditions of");
+	return NULL;
+    }
+
+    count = (*env)->GetArrayLength(env, sizesArray);
+    renditions = (Rendition *) AcquireQuantumMemory((size_t) count + 1,
+						    sizeof(*renditions));
+    order = (Rendition **) AcquireQuantumMemory((size_t) count + 1,
+						sizeof(*order));
+    if (renditions == NULL || order == NULL) {
+	if (renditions != NULL) {
+	    RelinquishMagickMemory(renditions);
+	}
+	if (order != NULL) {
+	    RelinquishMagickMemory(order);
+	}
+	throwMagickException(env, "Unable to allocate renditions");
+	return NULL;
+    }
+    memset(renditions, 0, ((size_t) count + 1) * sizeof(*renditions));
+
+    sizes = (*env)->GetIntArrayElements(env, sizesArray, NULL);
+    if (sizes == NULL) {
+	RelinquishMagickMemory(order);
+	RelinquishMagickMemory(renditions);
+	return NULL;
+    }
+    for (i = 0; i < count; i++) {
+	renditions[i].size = sizes[i];
+	renditions[i].same = -1;
+	renditions[i].imageInfo = imageInfo;
+	renditions[i].exception = AcquireExceptionInfo();
+    }
+    (*env)->ReleaseIntArrayElements(env, sizesArray, sizes, JNI_ABORT);
+
+    /* Largest first, so that each rendition is made from the previous */
+    for (i = 0; i < count; i++) {
+	r = &renditions[i];
+	for (j = i; j > 0 && order[j - 1]->size < r->size; j--) {
+	    order[j] = order[j - 1];
+	}
+	order[j] = r;
+    }
+
+    /*
+     * The sizes are computed from the image, so that rounding does not
+     * build up along the cascade. A rendition the size of the previous
+     * one is encoded only once; one the size of the image is a clone
+     * sharing its pixels.
+     */
+    exception = AcquireExceptionInfo();
+    for (i = 0; i < count; i++) {
+	r = order[i];
+	previous = last != NULL ? last->image : image;
+	scale = (double) r->size / image->columns;
+	if ((double) r->size / image->rows < scale) {
+	    scale = (double) r->size / image->rows;
+	}
+	if (scale < 1.0) {
+	    columns = (size_t) (image->columns * scale + 0.5);
+	    rows = (size_t) (image->rows * scale + 0.5);
+	    columns = columns > 0 ? columns : 1;
+	    rows = rows > 0 ? rows : 1;
+	}
+	else {
+	    columns = image->columns;
+	    rows = image->rows;
+	}
+	if (columns == previous->columns && rows == previous->rows) {
+	    if (last != NULL) {
+		r->same = (int) (last - renditions);
+		continue;
+	    }
+	    r->image = CloneImage(image, 0, 0, MagickTrue, exception);
+	}
+	else {
+	    r->image = ResizeImage(previous, columns, rows,
+				   filter > 0 ? (FilterTypes) filter
+					      : image->filter,
+#if MagickLibVersion < 0x700
+				   1.0,
+#endif
+				   exception);
+	}
+	if (r->image == NULL) {
+	    throwMagickApiException(env, "Unable to resize image", exception);
+	    goto failure;
+	}
+	last = r;
+    }
+
+    /*
+     * The renditions inherit the progress monitor of the image, which
+     * must not be called from the encoding threads: they are not
+     * attached to the Java virtual machine.
+     */
+    for (i = 0; i < count; i++) {
+	if (renditions[i].image != NULL) {
+	    SetImageProgressMonitor(renditions[i].image,
+				    (MagickProgressMonitor) NULL,
+				    (void *) NULL);
+	}
+    }
+
+    /*
+     * Encode the distinct renditions in parallel, on at most as many
+     * threads as ImageMagick may use, this one included.
+     */
+    queue.renditions = renditions;
+    queue.count = count;
+    queue.next = 0;
+#ifdef JMAGICK_PTHREADS
+    threadCount = -1;
+    for (i = 0; i < count; i++) {
+	if (renditions[i].same < 0) {
+	    threadCount++;
+	}
+    }
+    threadLimit = GetMagickResourceLimit(ThreadResource);
+    if (threadLimit < 1) {
+	threadLimit = 1;
+    }
+    if (threadCount > 0
+	&& (MagickSizeType) threadCount > threadLimit - 1) {
+	threadCount = (int) (threadLimit - 1);
+    }
+    threads = NULL;
+    if (threadCount > 0) {
+	threads = (pthread_t *) AcquireQuantumMemory((size_t) threadCount,
+						     sizeof(*threads));
+    }
+    pthread_mutex_init(&queue.lock, NULL);
+    started = 0;
+    while (threads != NULL && started < threadCount
+	   && pthread_create(&threads[started], NULL, encodeRenditions,
+			     &queue) == 0) {
+	started++;
+    }
+    encodeRenditions(&queue);
+    for (i = 0; i < started; i++) {
+	pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+    if (threads != NULL) {
+	RelinquishMagickMemory(threads);
+    }
+#else
+    encodeRenditions(&queue);
+#endif
+
+    byteArrayClass = (*env)->FindClass(env, "[B");
+    if (byteArrayClass == NULL) {
+	goto failure;
+    }
+    result = (*env)->NewObjectArray(env, count, byteArrayClass, NULL);
+    if (result == NULL) {
+	goto failure;
+    }
+    for (i = 0; i < count; i++) {
+	r = renditions[i].same >= 0 ? &renditions[renditions[i].same]
+				    : &renditions[i];
+	if (r->blob == NULL) {
+	    throwMagickApiException(env, "Unable to convert image to blob",
+				    r->exception);
+	    result = NULL;
+	    goto failure;
+	}
+	if (r->length > 0x7fffffff) {
+	    throwMagickException(env, "Blob is too large for a Java array");
+	    result = NULL;
+	    goto failure;
+	}
+	blob = (*env)->NewByteArray(env, (jsize) r->length);
+	if (blob == NULL) {
+	    result = NULL;
+	    goto failure;
+	}
+	(*env)->SetByteArrayRegion(env, blob, 0, (jsize) r->length,
+				   (jbyte *) r->blob);
+	(*env)->SetObjectArrayElement(env, result, i, blob);
+	(*env)->DeleteLocalRef(env, blob);
+    }
+
+failure:
+    for (i = 0; i < count; i++) {
+	r = &renditions[i];
+	if (r->image != NULL) {
+	    DestroyImage(r->image);
+	}
+	if (r->blob != NULL) {
+	    RelinquishMagickMemory(r->blob);
+	}
+	DestroyExceptionInfo(r->exception);
+    }
+    DestroyExceptionInfo(exception);
+    RelinquishMagickMemory(order);
+    RelinquishMagickMemory(renditions);
+    return result;
+}
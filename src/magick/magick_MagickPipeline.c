@@ -0,0 +1,325 @@
+#include <jni.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+#if defined (IMAGEMAGICK_HEADER_STYLE_7)
+#    include <MagickCore/MagickCore.h>
+#else
+#    include <magick/api.h>
+#endif
+#include "magick_MagickPipeline.h"
+#include "jmagick.h"
+
+/*
+ * Operation codes of magick.MagickPipeline.
+ */
+#define PIPELINE_AUTO_ORIENT     1
+#define PIPELINE_CROP            2
+#define PIPELINE_RESIZE          3
+#define PIPELINE_SCALE           4
+#define PIPELINE_SAMPLE          5
+#define PIPELINE_THUMBNAIL       6
+#define PIPELINE_FIT             7
+#define PIPELINE_UNSHARP_MASK    8
+#define PIPELINE_SHARPEN         9
+#define PIPELINE_BLUR           10
+#define PIPELINE_GAUSSIAN_BLUR  11
+#define PIPELINE_ROTATE         12
+#define PIPELINE_FLIP           13
+#define PIPELINE_FLOP           14
+#define PIPELINE_STRIP          15
+
+
+
+/*
+ * Number of arguments taken by an operation, or -1 if unknown.
+ */
+static int getPipelineArgCount(int op)
+{
+    switch (op) {
+    case PIPELINE_AUTO_ORIENT:
+    case PIPELINE_FLIP:
+    case PIPELINE_FLOP:
+    case PIPELINE_STRIP:
+	return 0;
+    case PIPELINE_ROTATE:
+	return 1;
+    case PIPELINE_SCALE:
+    case PIPELINE_SAMPLE:
+    case PIPELINE_THUMBNAIL:
+    case PIPELINE_FIT:
+    case PIPELINE_SHARPEN:
+    case PIPELINE_BLUR:
+    case PIPELINE_GAUSSIAN_BLUR:
+	return 2;
+    case PIPELINE_CROP:
+    case PIPELINE_RESIZE:
+    case PIPELINE_UNSHARP_MASK:
+	return 4;
+    }
+    return -1;
+}
+
+
+
+/*
+ * Apply one step of a pipeline to an image.
+ *
+ * Input:
+ *   image      the current image
+ *   op         the operation code
+ *   args       the arguments of the operation
+ *   exception  receives the error of a failed step
+ *
+ * Output:
+ *   failed     set to non-zero if the step failed
+ *
+ * Return:
+ *   the new image, or NULL if the step changed the image in place,
+ *   left it unchanged or failed
+ */
+static Image *applyPipelineStep(Image *image,
+				int op,
+				const jdouble *args,
+				ExceptionInfo *exception,
+				int *failed)
+{
+    Image *result = NULL;
+    RectangleInfo rect;
+    FilterTypes filter;
+    double scale;
+    size_t columns, rows;
+
+    *failed = 0;
+    switch (op) {
+    case PIPELINE_AUTO_ORIENT:
+	result = getOrientedImage(image, exception);
+	if (result == NULL
+	    && exception->severity >= ErrorException) {
+	    *failed = 1;
+	}
+	return result;
+    case PIPELINE_CROP:
+	rect.x = (ssize_t) args[0];
+	rect.y = (ssize_t) args[1];
+	rect.width = (size_t) args[2];
+	rect.height = (size_t) args[3];
+	result = CropImage(image, &rect, exception);
+	break;
+    case PIPELINE_RESIZE:
+	filter = args[2] < 0 ? image->filter : (FilterTypes) args[2];
+	result = ResizeImage(image, (size_t) args[0], (size_t) args[1],
+			     filter,
+#if MagickLibVersion < 0x700
+			     args[3],
+#endif
+			     exception);
+	break;
+    case PIPELINE_FIT:
+	scale = args[0] / image->columns;
+	if (args[1] / image->rows < scale) {
+	    scale = args[1] / image->rows;
+	}
+	if (scale >= 1.0) {
+	    return NULL;
+	}
+	columns = (size_t) (image->columns * scale + 0.5);
+	rows = (size_t) (image->rows * scale + 0.5);
+	result = ResizeImage(image,
+			     columns > 0 ? columns : 1,
+			     rows > 0 ? rows : 1,
+			     image->filter,
+#if MagickLibVersion < 0x700
+			     1.0,
+#endif
+			     exception);
+	break;
+    case PIPELINE_SCALE:
+	result = ScaleImage(image, (size_t) args[0], (size_t) args[1],
+			    exception);
+	break;
+    case PIPELINE_SAMPLE:
+	result = SampleImage(image, (size_t) args[0], (size_t) args[1],
+			     exception);
+	break;
+    case PIPELINE_THUMBNAIL:
+	result = ThumbnailImage(image, (size_t) args[0], (size_t) args[1],
+				exception);
+	break;
+    case PIPELINE_UNSHARP_MASK:
+	result = UnsharpMaskImage(image, args[0], args[1], args[2], args[3],
+				  exception);
+	break;
+    case PIPELINE_SHARPEN:
+	result = SharpenImage(image, args[0], args[1], exception);
+	break;
+    case PIPELINE_BLUR:
+	result = BlurImage(image, args[0], args[1], exception);
+	break;
+    case PIPELINE_GAUSSIAN_BLUR:
+	result = GaussianBlurImage(image, args[0], args[1], exception);
+	break;
+    case PIPELINE_ROTATE:
+	result = RotateImage(image, args[0], exception);
+	break;
+    case PIPELINE_FLIP:
+	result = FlipImage(image, exception);
+	break;
+    case PIPELINE_FLOP:
+	result = FlopImage(image, exception);
+	break;
+    case PIPELINE_STRIP:
+#if MagickLibVersion < 0x700
+	if (!StripImage(image)) {
+	    InheritException(exception, &image->exception);
+	    *failed = 1;
+	}
+#else
+	if (!StripImage(image, exception)) {
+	    *failed = 1;
+	}
+#endif
+	return NULL;
+    }
+    if (result == NULL) {
+	*failed = 1;
+    }
+    return result;
+}
+
+
+
+/*
+ * Class:     magick_MagickPipeline
+ * Method:    execute
+ * Signature: (Lmagick/MagickImage;[II[DLmagick/ImageInfo;)Ljava/lang/Object;
+ */
+JNIEXPORT jobject JNICALL Java_magick_MagickPipeline_execute
+  (JNIEnv *env, jclass pipelineClass, jobject imageObj, jintArray opsArray,
+   jint opCount, jdoubleArray argsArray, jobject imageInfoObj)
+{
+    Image *source, *current, *next;
+    ImageInfo *imageInfo = NULL;
+    ExceptionInfo *exception;
+    jint *ops;
+    jdouble *args;
+    jsize argLength;
+    jobject result = NULL;
+    void *blobMem;
+    size_t blobSize = 0;
+    int i, argIndex = 0, argCount, failed;
+
+    if (imageObj == NULL) {
+	throwMagickException(env, "No image to run the pipeline on");
+	return NULL;
+    }
+    source = (Image *) getHandle(env, imageObj, "magickImageHandle",
+				 &jmagickCache.magickImageHandle);
+    if (source == NULL) {
+	throwMagickException(env, "Cannot retrieve image handle");
+	return NULL;
+    }
+    if (imageInfoObj != NULL) {
+	imageInfo = (ImageInfo *) getHandle(env, imageInfoObj,
+					    "imageInfoHandle",
+					    &jmagickCache.imageInfoHandle);
+	if (imageInfo == NULL) {
+	    throwMagickException(env, "Cannot obtain ImageInfo object");
+	    return NULL;
+	}
+    }
+
+    ops = (*env)->GetIntArrayElements(env, opsArray, NULL);
+    if (ops == NULL) {
+	return NULL;
+    }
+    args = (*env)->GetDoubleArrayElements(env, argsArray, NULL);
+    if (args == NULL) {
+	(*env)->ReleaseIntArrayElements(env, opsArray, ops, JNI_ABORT);
+	return NULL;
+    }
+    argLength = (*env)->GetArrayLength(env, argsArray);
+
+    /*
+     * The source belongs to its Java object: it is cloned before a
+     * step changes it in place, and every later image is destroyed as
+     * soon as its successor exists.
+     */
+    exception = AcquireExceptionInfo();
+    current = source;
+    for (i = 0; i < opCount; i++) {
+	argCount = getPipelineArgCount(ops[i]);
+	if (argCount < 0 || argIndex + argCount > argLength) {
+	    throwMagickException(env, "Invalid pipeline step");
+	    goto failure;
+	}
+	if (ops[i] == PIPELINE_STRIP && current == source) {
+	    current = CloneImage(source, 0, 0, MagickTrue, exception);
+	    if (current == NULL) {
+		throwMagickApiException(env, "Unable to clone image",
+					exception);
+		goto failure;
+	    }
+	}
+	next = applyPipelineStep(current, ops[i], args + argIndex,
+				 exception, &failed);
+	argIndex += argCount;
+	if (failed) {
+	    throwMagickApiException(env, "Pipeline step failed", exception);
+	    goto failure;
+	}
+	if (next != NULL) {
+	    if (current != source) {
+		DestroyImage(current);
+	    }
+	    current = next;
+	}
+    }
+
+    if (current == source) {
+	current = CloneImage(source, 0, 0, MagickTrue, exception);
+	if (current == NULL) {
+	    throwMagickApiException(env, "Unable to clone image", exception);
+	    goto failure;
+	}
+    }
+
+    if (imageInfo == NULL) {
+	result = newImageObject(env, current);
+	if (result == NULL) {
+	    throwMagickException(env, "Unable to construct magick.MagickImage");
+	    goto failure;
+	}
+	current = NULL;
+    }
+    else {
+	blobMem = ImageToBlob(imageInfo, current, &blobSize, exception);
+	if (blobMem == NULL) {
+	    throwMagickApiException(env, "Unable to convert image to blob",
+				    exception);
+	    goto failure;
+	}
+	if (blobSize > 0x7fffffff) {
+	    RelinquishMagickMemory(blobMem);
+	    throwMagickException(env, "Blob is too large for a Java array");
+	    goto failure;
+	}
+	result = (*env)->NewByteArray(env, (jsize) blobSize);
+	if (result != NULL) {
+	    (*env)->SetByteArrayRegion(env, (jbyteArray) result, 0,
+				       (jsize) blobSize, (jbyte *) blobMem);
+	}
+	RelinquishMagickMemory(blobMem);
+    }
+
+failure:
+    if (current != NULL && current != source) {
+	DestroyImage(current);
+    }
+    DestroyExceptionInfo(exception);
+    (*env)->ReleaseDoubleArrayElements(env, argsArray, args, JNI_ABORT);
+    (*env)->ReleaseIntArrayElements(env, opsArray, ops, JNI_ABORT);
+    return result;
+}
@@ -29,7 +29,6 @@ JNIEXPORT jobject JNICALL Java_magick_PixelPacket_queryColorDatabase
 #endif
     const char *cstr;
     unsigned int result;
-    jmethodID consMethodID;
     jobject jPixelPacket;
     ExceptionInfo *exception;
 
@@ -49,12 +48,6 @@ JNIEXPORT jobject JNICALL Java_magick_PixelPacket_queryColorDatabase
     }
     DestroyExceptionInfo(exception);
 
-    consMethodID = (*env)->GetMethodID(env, class, "<init>", "(IIII)V");
-    if (consMethodID == 0) {
-	throwMagickException(env, "Unable to construct magick.PixelPacket");
-	return NULL;
-    }
-
 #ifdef DIAGNOSTIC
     fprintf(stderr, "Query colour %d, %d, %d, %d\n",
             pixel.red,
@@ -67,7 +60,7 @@ JNIEXPORT jobject JNICALL Java_magick_PixelPacket_queryColorDatabase
 #    endif
 #endif
 
-    jPixelPacket = (*env)->NewObject(env, class, consMethodID,
+    jPixelPacket = (*env)->NewObject(env, class, jmagickCache.pixelPacketCons,
 				     (jint) pixel.red,
 				     (jint) pixel.green,
 				     (jint) pixel.blue,
@@ -98,7 +91,6 @@ JNIEXPORT jobject JNICALL Java_magick_PixelPacket_getColor
     PixelInfo pixel;
 #endif
     const char *cstr;
-    jmethodID consMethodID;
     jobject jPixelPacket;
 
     cstr = (*env)->GetStringUTFChars(env, target, 0);
@@ -124,12 +116,6 @@ JNIEXPORT jobject JNICALL Java_magick_PixelPacket_getColor
 	PixelGetQuantumPacket(pixelWand, &pixel);
 #endif
 
-    consMethodID = (*env)->GetMethodID(env, class, "<init>", "(IIII)V");
-    if (consMethodID == 0) {
-		throwMagickException(env, "Unable to construct magick.PixelPacket");
-		return NULL;
-    }
-
 #ifdef DIAGNOSTIC
     fprintf(stderr, "Colour %d, %d, %d, %d\n",
             pixel.red,
@@ -142,7 +128,7 @@ JNIEXPORT jobject JNICALL Java_magick_PixelPacket_getColor
 #    endif
 #endif
 
-    jPixelPacket = (*env)->NewObject(env, class, consMethodID,
+    jPixelPacket = (*env)->NewObject(env, class, jmagickCache.pixelPacketCons,
 				     (jint) pixel.red,
 				     (jint) pixel.green,
 				     (jint) pixel.blue,
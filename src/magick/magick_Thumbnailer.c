@@ -0,0 +1,262 @@
+#include <jni.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+#if defined (IMAGEMAGICK_HEADER_STYLE_7)
+#    include <MagickCore/MagickCore.h>
+#else
+#    include <magick/api.h>
+#endif
+#include "magick_Thumbnailer.h"
+#include "jmagick.h"
+
+/*
+ * Images more than this many times larger than the thumbnail are first
+ * sampled down to this many times its size, as ThumbnailImage does.
+ */
+#define THUMBNAIL_SAMPLE_FACTOR  5.0
+
+
+
+/*
+ * Replace an image by its successor, destroying it. A NULL successor
+ * leaves the image in place.
+ */
+static Image *replaceThumbnailImage(Image *image, Image *next)
+{
+    if (next == NULL) {
+	return image;
+    }
+#if MagickLibVersion < 0x700
+    DestroyImages(image);
+#else
+    DestroyImageList(image);
+#endif
+    return next;
+}
+
+/*
+ * Flatten an image onto a background color.
+ *
+ * Return:
+ *   the flattened image, or NULL if the operation failed
+ */
+static Image *flattenThumbnailImage(Image *image, const char *background,
+				    ExceptionInfo *exception)
+{
+#if MagickLibVersion < 0x700
+    if (!QueryColorDatabase(background, &image->background_color,
+			    exception)) {
+	return NULL;
+    }
+#else
+    if (!QueryColorCompliance(background, AllCompliance,
+			      &image->background_color, exception)) {
+	return NULL;
+    }
+#endif
+    return MergeImageLayers(image, FlattenLayer, exception);
+}
+
+
+
+/*
+ * Class:     magick_Thumbnailer
+ * Method:    createThumbnail
+ * Signature: ([BLjava/lang/String;IIIILjava/lang/String;DDDLjava/lang/String;)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_magick_Thumbnailer_createThumbnail
+  (JNIEnv *env, jclass thumbnailerClass, jbyteArray blob, jstring fileName,
+   jint width, jint height, jint filter, jint quality, jstring format,
+   jdouble sigma, jdouble amount, jdouble threshold, jstring background)
+{
+    ImageInfo *info;
+    Image *image = NULL, *rest;
+    ExceptionInfo *exception;
+    jbyte *blobMem;
+    jsize blobSiz;
+    const char *cstr;
+    char sizeHint[64];
+    double scale;
+    size_t columns, rows;
+    void *thumbMem;
+    size_t thumbSiz = 0;
+    jbyteArray result = NULL;
+
+    if (width <= 0 || height <= 0) {
+	throwMagickException(env, "Invalid thumbnail size");
+	return NULL;
+    }
+
+    /*
+     * Decode only the first frame, and let the JPEG coder reduce it
+     * to the smallest DCT scale that is still at least as large as
+     * the thumbnail.
+     */
+    info = AcquireImageInfo();
+    snprintf(sizeHint, sizeof(sizeHint), "%dx%d", (int) width, (int) height);
+    SetImageOption(info, "jpeg:size", sizeHint);
+    info->scene = 0;
+    info->number_scenes = 1;
+
+    exception = AcquireExceptionInfo();
+    if (blob != NULL) {
+	blobSiz = (*env)->GetArrayLength(env, blob);
+	blobMem = (*env)->GetByteArrayElements(env, blob, NULL);
+	if (blobMem == NULL) {
+	    goto failure;
+	}
+	image = BlobToImage(info, blobMem, (size_t) blobSiz, exception);
+	(*env)->ReleaseByteArrayElements(env, blob, blobMem, JNI_ABORT);
+    }
+    else {
+	cstr = (*env)->GetStringUTFChars(env, fileName, NULL);
+	if (cstr == NULL) {
+	    goto failure;
+	}
+	strncpy(info->filename, cstr, sizeof(info->filename) - 1);
+	(*env)->ReleaseStringUTFChars(env, fileName, cstr);
+	image = ReadImage(info, exception);
+    }
+    if (image == NULL) {
+	throwMagickApiException(env, "Unable to read image", exception);
+	goto failure;
+    }
+    /* A readable image may come with a recoverable error. */
+    ClearMagickException(exception);
+    rest = SplitImageList(image);
+    if (rest != NULL) {
+#if MagickLibVersion < 0x700
+	DestroyImages(rest);
+#else
+	DestroyImageList(rest);
+#endif
+    }
+
+    image = replaceThumbnailImage(image, getOrientedImage(image, exception));
+    if (exception->severity >= ErrorException) {
+	throwMagickApiException(env, "Unable to orient image", exception);
+	goto failure;
+    }
+
+    /* Resize to fit the box, never enlarging. */
+    scale = (double) width / image->columns;
+    if ((double) height / image->rows < scale) {
+	scale = (double) height / image->rows;
+    }
+    if (scale < 1.0) {
+	if (scale * THUMBNAIL_SAMPLE_FACTOR < 1.0) {
+	    columns = (size_t) (image->columns * scale
+				* THUMBNAIL_SAMPLE_FACTOR + 0.5);
+	    rows = (size_t) (image->rows * scale
+			     * THUMBNAIL_SAMPLE_FACTOR + 0.5);
+	    image = replaceThumbnailImage(image,
+		SampleImage(image, columns > 0 ? columns : 1,
+			    rows > 0 ? rows : 1, exception));
+	    if (exception->severity >= ErrorException) {
+		throwMagickApiException(env, "Unable to sample image",
+					exception);
+		goto failure;
+	    }
+	}
+	scale = (double) width / image->columns;
+	if ((double) height / image->rows < scale) {
+	    scale = (double) height / image->rows;
+	}
+	columns = (size_t) (image->columns * scale + 0.5);
+	rows = (size_t) (image->rows * scale + 0.5);
+	image = replaceThumbnailImage(image,
+	    ResizeImage(image, columns > 0 ? columns : 1, rows > 0 ? rows : 1,
+			filter > 0 ? (FilterTypes) filter : image->filter,
+#if MagickLibVersion < 0x700
+			1.0,
+#endif
+			exception));
+	if (exception->severity >= ErrorException) {
+	    throwMagickApiException(env, "Unable to resize image", exception);
+	    goto failure;
+	}
+    }
+
+    if (sigma > 0.0) {
+	image = replaceThumbnailImage(image,
+	    UnsharpMaskImage(image, 0.0, sigma, amount, threshold, exception));
+	if (exception->severity >= ErrorException) {
+	    throwMagickApiException(env, "Unable to sharpen image", exception);
+	    goto failure;
+	}
+    }
+
+#if MagickLibVersion < 0x700
+    if (!StripImage(image)) {
+	InheritException(exception, &image->exception);
+	throwMagickApiException(env, "Unable to strip image", exception);
+	goto failure;
+    }
+#else
+    if (!StripImage(image, exception)) {
+	throwMagickApiException(env, "Unable to strip image", exception);
+	goto failure;
+    }
+#endif
+
+    if (background != NULL) {
+	cstr = (*env)->GetStringUTFChars(env, background, NULL);
+	if (cstr == NULL) {
+	    goto failure;
+	}
+	image = replaceThumbnailImage(image,
+	    flattenThumbnailImage(image, cstr, exception));
+	(*env)->ReleaseStringUTFChars(env, background, cstr);
+	if (exception->severity >= ErrorException) {
+	    throwMagickApiException(env, "Unable to flatten image", exception);
+	    goto failure;
+	}
+    }
+
+    if (quality > 0) {
+	info->quality = (size_t) quality;
+	image->quality = (size_t) quality;
+    }
+    if (format != NULL) {
+	cstr = (*env)->GetStringUTFChars(env, format, NULL);
+	if (cstr == NULL) {
+	    goto failure;
+	}
+	strncpy(info->magick, cstr, sizeof(info->magick) - 1);
+	strncpy(image->magick, cstr, sizeof(image->magick) - 1);
+	(*env)->ReleaseStringUTFChars(env, format, cstr);
+    }
+
+    thumbMem = ImageToBlob(info, image, &thumbSiz, exception);
+    if (thumbMem == NULL) {
+	throwMagickApiException(env, "Unable to convert image to blob",
+				exception);
+	goto failure;
+    }
+    if (thumbSiz > 0x7fffffff) {
+	RelinquishMagickMemory(thumbMem);
+	throwMagickException(env, "Blob is too large for a Java array");
+	goto failure;
+    }
+    result = (*env)->NewByteArray(env, (jsize) thumbSiz);
+    if (result != NULL) {
+	(*env)->SetByteArrayRegion(env, result, 0, (jsize) thumbSiz,
+				   (jbyte *) thumbMem);
+    }
+    RelinquishMagickMemory(thumbMem);
+
+failure:
+    if (image != NULL) {
+#if MagickLibVersion < 0x700
+	DestroyImages(image);
+#else
+	DestroyImageList(image);
+#endif
+    }
+    DestroyExceptionInfo(exception);
+    DestroyImageInfo(info);
+    return result;
+}
@@ -1,8 +1,11 @@
 package magicktest;
 
 import java.io.*;
+import java.nio.ByteBuffer;
 
 import java.awt.*;
+import java.awt.image.BufferedImage;
+import java.awt.image.WritableRaster;
 
 import junit.framework.*;
 import junit.extensions.RepeatedTest;
@@ -337,6 +340,114 @@ public class TestJMagick extends TestCase {
 																 MagickTesttools.path_correct_output + "blob.gif", 1500000);
 	}
 
+	public void testBlobFromByteBuffer() throws Exception {
+		ImageInfo png = new ImageInfo();
+		png.setMagick("PNG");
+		byte[] blob = image.imageToBlob(png);
+		int pad = 17;
+
+		ByteBuffer[] buffers = {
+			ByteBuffer.allocateDirect(pad + blob.length + pad),
+			ByteBuffer.allocate(pad + blob.length + pad)
+		};
+		for (int i = 0; i < buffers.length; i++) {
+			ByteBuffer buffer = buffers[i];
+			String kind = buffer.isDirect() ? "direct" : "heap";
+			buffer.position(pad);
+			buffer.put(blob);
+			buffer.position(pad);
+			buffer.limit(pad + blob.length);
+
+			// The bytes between position and limit are decoded
+			MagickImage decoded = new MagickImage(new ImageInfo(), buffer);
+			assertEquals(kind, image.getDimension(), decoded.getDimension());
+			assertEquals(kind, pad, buffer.position());
+			decoded.close();
+
+			// An explicit range ignores position and limit
+			buffer.clear();
+			decoded = new MagickImage();
+			decoded.blobToImage(new ImageInfo(), buffer, pad, blob.length);
+			assertEquals(kind, image.getDimension(), decoded.getDimension());
+			assertEquals(kind, 0, buffer.position());
+			decoded.close();
+		}
+
+		// A heap buffer over part of a larger array
+		byte[] padded = new byte[pad + blob.length];
+		System.arraycopy(blob, 0, padded, pad, blob.length);
+		MagickImage decoded = new MagickImage(new ImageInfo(),
+			ByteBuffer.wrap(padded, pad, blob.length).slice());
+		assertEquals(image.getDimension(), decoded.getDimension());
+		decoded.close();
+
+		try {
+			new MagickImage().blobToImage(new ImageInfo(), buffers[0], pad, buffers[0].capacity());
+			fail("MagickException expected");
+		} catch (MagickException e) {
+		}
+	}
+
+	public void testReadImageFromStream() throws Exception {
+		String[] formats = { "PNG", "GIF", "JPEG" };
+		for (int i = 0; i < formats.length; i++) {
+			ImageInfo encode = new ImageInfo();
+			encode.setMagick(formats[i]);
+			byte[] blob = image.imageToBlob(encode);
+
+			// No format given: it is detected from the stream header
+			MagickImage decoded = new MagickImage();
+			decoded.readImage(new ImageInfo(), new ByteArrayInputStream(blob));
+			assertEquals(formats[i], image.getDimension(), decoded.getDimension());
+			assertEquals(formats[i], decoded.getMagick());
+			decoded.close();
+
+			// The header is peeked across short reads
+			InputStream trickle = new FilterInputStream(new ByteArrayInputStream(blob)) {
+				public int read(byte[] b, int off, int len) throws IOException {
+					return super.read(b, off, Math.min(len, 1));
+				}
+			};
+			decoded = new MagickImage();
+			decoded.readImage(new ImageInfo(), trickle);
+			assertEquals(formats[i], image.getDimension(), decoded.getDimension());
+			decoded.close();
+		}
+
+		// An IOException of the stream reaches the caller
+		InputStream broken = new InputStream() {
+			public int read() throws IOException {
+				throw new IOException("broken");
+			}
+		};
+		try {
+			new MagickImage().readImage(new ImageInfo(), broken);
+			fail("IOException expected");
+		} catch (IOException e) {
+			assertEquals("broken", e.getMessage());
+		}
+	}
+
+	public void testWriteImageToStream() throws Exception {
+		ImageInfo png = new ImageInfo();
+		png.setMagick("PNG");
+		image.setMagick("PNG");
+
+		ByteArrayOutputStream out = new ByteArrayOutputStream();
+		image.writeImage(png, out);
+		MagickImage decoded = new MagickImage(new ImageInfo(), out.toByteArray());
+		assertEquals(image.getDimension(), decoded.getDimension());
+		assertEquals("PNG", decoded.getMagick());
+		decoded.close();
+
+		ByteArrayOutputStream sink = new ByteArrayOutputStream();
+		image.writeImage(png, java.nio.channels.Channels.newChannel(sink));
+		decoded = new MagickImage(new ImageInfo(), sink.toByteArray());
+		assertEquals(image.getDimension(), decoded.getDimension());
+		assertEquals("PNG", decoded.getMagick());
+		decoded.close();
+	}
+
 	/**
 	 * Test of diverse operations on a small is processed  correctly
 	 */
@@ -409,6 +520,905 @@ public class TestJMagick extends TestCase {
 		MagickTesttools.writeAndCompare(blankImage, info, "transparent.jpg");
 	}
 
+	public void testImportPixelsInPlace() throws Exception {
+		byte[] pixels = new byte[64 * 32 * 3];
+		MagickImage image = new MagickImage();
+		image.importPixels(64, 32, "RGB", pixels);
+		image.setImageAttribute("comment", "frame");
+
+		// Same geometry: the pixels are imported into the same image
+		java.util.Arrays.fill(pixels, (byte) 255);
+		image.importPixels(64, 32, "RGB", pixels);
+		assertEquals("frame", image.getImageAttribute("comment"));
+		byte[] out = new byte[3];
+		image.dispatchImage(10, 10, 1, 1, "RGB", out);
+		assertEquals((byte) 255, out[0]);
+
+		// Other geometry: a new image is created
+		image.importPixels(32, 16, "RGB", new byte[32 * 16 * 3]);
+		assertEquals(new Dimension(32, 16), image.getDimension());
+
+		// RGBA then RGB: the alpha channel is not kept
+		byte[] rgba = new byte[32 * 16 * 4];
+		image.importPixels(32, 16, "RGBA", rgba);
+		assertTrue(image.getMatte());
+		image.importPixels(32, 16, "RGB", new byte[32 * 16 * 3]);
+		assertFalse(image.getMatte());
+		image.dispatchImage(3, 3, 1, 1, "RGBA", out = new byte[4]);
+		assertEquals((byte) 255, out[3]);
+
+		// Gray then RGB: the image is color again
+		byte[] gray = new byte[32 * 16];
+		java.util.Arrays.fill(gray, (byte) 128);
+		image.importPixels(32, 16, "I", gray);
+		assertTrue(image.isGrayImage());
+		byte[] red = new byte[32 * 16 * 3];
+		for (int i = 0; i < red.length; i += 3) {
+			red[i] = (byte) 255;
+		}
+		image.importPixels(32, 16, "RGB", red);
+		assertFalse(image.isGrayImage());
+		image.dispatchImage(3, 3, 1, 1, "RGB", out = new byte[3]);
+		assertEquals((byte) 255, out[0]);
+		assertEquals((byte) 0, out[1]);
+		assertEquals((byte) 0, out[2]);
+	}
+
+	public void testBlobIntoDirectBuffer() throws Exception {
+		ImageInfo ppm = new ImageInfo();
+		ppm.setMagick("PPM");
+		image.setMagick("PPM");
+		int size = image.imageToBlob(ppm).length;
+
+		// Too small: nothing is written and the required size is returned
+		ByteBuffer small = ByteBuffer.allocateDirect(size - 1);
+		assertEquals(-size, image.imageToBlob(ppm, small));
+		assertEquals(0, small.position());
+
+		// Large enough: written at the position, which is advanced
+		ByteBuffer buffer = ByteBuffer.allocateDirect(8 + size);
+		buffer.position(8);
+		assertEquals(size, image.imageToBlob(ppm, buffer));
+		assertEquals(8 + size, buffer.position());
+		buffer.flip();
+		buffer.position(8);
+		MagickImage decoded = new MagickImage(new ImageInfo(), buffer);
+		assertEquals(image.getDimension(), decoded.getDimension());
+		decoded.close();
+
+		// Encoded into ImageMagick memory
+		MagickBlob blob = image.imageToNativeBlob(ppm);
+		assertEquals(size, blob.getLength());
+		ByteBuffer nativeBuffer = blob.getBuffer();
+		assertTrue(nativeBuffer.isDirect());
+		assertEquals(size, nativeBuffer.remaining());
+		decoded = new MagickImage(new ImageInfo(), nativeBuffer);
+		assertEquals(image.getDimension(), decoded.getDimension());
+		decoded.close();
+		blob.release();
+		assertEquals(0, blob.getLength());
+		try {
+			blob.getBuffer();
+			fail("MagickException expected");
+		} catch (MagickException e) {
+		}
+		// Releasing twice is allowed
+		blob.release();
+	}
+
+	public void testPixelsThroughByteBuffer() throws Exception {
+		int count = 4 * 3 * 3;
+		byte[] expected = new byte[count];
+		image.dispatchImage(10, 20, 4, 3, "RGB", expected);
+
+		// Direct buffer: written from the position, which is kept
+		ByteBuffer direct = ByteBuffer.allocateDirect(5 + count);
+		direct.position(5);
+		assertTrue(image.exportPixels(10, 20, 4, 3, "RGB", StorageType.CharPixel, direct));
+		assertEquals(5, direct.position());
+		byte[] actual = new byte[count];
+		direct.get(actual);
+		assertTrue(java.util.Arrays.equals(expected, actual));
+
+		// Heap buffer with an array offset and a position
+		byte[] array = new byte[7 + 2 + count];
+		ByteBuffer heap = ByteBuffer.wrap(array, 7, 2 + count).slice();
+		heap.position(2);
+		assertTrue(image.exportPixels(10, 20, 4, 3, "RGB", StorageType.CharPixel, heap));
+		assertEquals(2, heap.position());
+		for (int i = 0; i < count; i++) {
+			assertEquals(expected[i], array[9 + i]);
+		}
+		for (int i = 0; i < 9; i++) {
+			assertEquals(0, array[i]);
+		}
+
+		// Only the bytes up to the limit are used
+		direct.position(5);
+		direct.limit(5 + count - 1);
+		try {
+			image.exportPixels(10, 20, 4, 3, "RGB", StorageType.CharPixel, direct);
+			fail("MagickException expected");
+		} catch (MagickException e) {
+		}
+
+		// Import from a buffer position, then read back
+		MagickImage copy = image.cloneImage(0, 0, false);
+		ByteBuffer white = ByteBuffer.allocateDirect(3 + count);
+		for (int i = 0; i < white.capacity(); i++) {
+			white.put(i, (byte) 255);
+		}
+		white.position(3);
+		assertTrue(copy.importPixels(10, 20, 4, 3, "RGB", StorageType.CharPixel, white));
+		assertEquals(3, white.position());
+		copy.dispatchImage(10, 20, 4, 3, "RGB", actual);
+		for (int i = 0; i < count; i++) {
+			assertEquals((byte) 255, actual[i]);
+		}
+		copy.close();
+
+		// 16-bit components in native byte order
+		ByteBuffer shorts = ByteBuffer.allocateDirect(count * 2)
+			.order(java.nio.ByteOrder.nativeOrder());
+		assertTrue(image.exportPixels(10, 20, 4, 3, "RGB", StorageType.ShortPixel, shorts));
+		for (int i = 0; i < count; i++) {
+			assertEquals((expected[i] & 0xff) * 257, shorts.getShort(i * 2) & 0xffff);
+		}
+
+		try {
+			image.exportPixels(0, 0, 1, 1, "RGB", StorageType.CharPixel,
+					   ByteBuffer.allocate(3).asReadOnlyBuffer());
+			fail("MagickException expected");
+		} catch (MagickException e) {
+		}
+	}
+
+	public void testMagickProducer() throws Exception {
+		final Dimension size = image.getDimension();
+		MagickImage[] frames = {
+			image.cloneImage(0, 0, false),
+			image.rotateImage(180.0),
+			image.scaleImage(40, 30)
+		};
+		int[][] expected = new int[2][size.width * size.height];
+		byte[] rgba = new byte[size.width * size.height * 4];
+		for (int f = 0; f < 2; f++) {
+			frames[f].dispatchImage(0, 0, size.width, size.height, "RGBA", rgba);
+			for (int i = 0; i < expected[f].length; i++) {
+				expected[f][i] = (rgba[4 * i + 3] & 0xff) << 24
+					| (rgba[4 * i] & 0xff) << 16
+					| (rgba[4 * i + 1] & 0xff) << 8
+					| (rgba[4 * i + 2] & 0xff);
+			}
+		}
+		MagickImage animation = MagickImage.adopt(frames);
+
+		final java.util.List<int[]> received = new java.util.ArrayList<int[]>();
+		final java.util.List<Integer> bandStarts = new java.util.ArrayList<Integer>();
+		final java.util.List<Integer> statuses = new java.util.ArrayList<Integer>();
+		received.add(new int[size.width * size.height]);
+		java.awt.image.ImageConsumer consumer = new java.awt.image.ImageConsumer() {
+			public void setDimensions(int width, int height) {
+				assertEquals(size, new Dimension(width, height));
+			}
+			public void setProperties(java.util.Hashtable<?, ?> props) {
+			}
+			public void setColorModel(java.awt.image.ColorModel model) {
+			}
+			public void setHints(int hints) {
+				assertTrue((hints & java.awt.image.ImageConsumer.MULTIPLEFRAMES) != 0);
+			}
+			public void setPixels(int x, int y, int w, int h,
+					      java.awt.image.ColorModel model,
+					      byte[] pixels, int off, int scansize) {
+				fail("Byte pixels are not sent");
+			}
+			public void setPixels(int x, int y, int w, int h,
+					      java.awt.image.ColorModel model,
+					      int[] pixels, int off, int scansize) {
+				int[] frame = received.get(received.size() - 1);
+				for (int row = 0; row < h; row++) {
+					System.arraycopy(pixels, off + row * scansize,
+							 frame, (y + row) * size.width + x, w);
+				}
+				bandStarts.add(y);
+			}
+			public void imageComplete(int status) {
+				statuses.add(status);
+				received.add(new int[size.width * size.height]);
+			}
+		};
+		new MagickProducer(animation, 32).startProduction(consumer);
+		animation.close();
+
+		// Two frames sent in bands of 32 rows; the smaller frame skipped
+		assertEquals(java.util.Arrays.asList(
+			java.awt.image.ImageConsumer.SINGLEFRAMEDONE,
+			java.awt.image.ImageConsumer.SINGLEFRAMEDONE,
+			java.awt.image.ImageConsumer.STATICIMAGEDONE), statuses);
+		assertEquals(java.util.Arrays.asList(0, 32, 64, 96, 128, 0, 32, 64, 96, 128),
+			     bandStarts);
+		for (int f = 0; f < 2; f++) {
+			assertTrue("frame " + f, java.util.Arrays.equals(expected[f], received.get(f)));
+		}
+	}
+
+	public void testWidePixelTransfers() throws Exception {
+		int width = 8, height = 4, count = width * height * 3;
+		boolean deep = Magick.getQuantumDepth() >= 16;
+
+		// 16-bit components, exact with a 16-bit quantum or more
+		short[] shorts = new short[count];
+		for (int i = 0; i < count; i++) {
+			shorts[i] = (short) (i * 2039 % 65536);
+		}
+		MagickImage wide = new MagickImage();
+		wide.constituteImage(width, height, "RGB", shorts);
+		short[] shortsOut = new short[count];
+		assertTrue(wide.dispatchImage(0, 0, width, height, "RGB", shortsOut));
+		for (int i = 0; i < count; i++) {
+			assertEquals("short " + i, shorts[i] & 0xffff, shortsOut[i] & 0xffff,
+				     deep ? 0 : 128);
+		}
+
+		// Double components, between 0 and 1
+		double[] doubles = new double[count];
+		for (int i = 0; i < count; i++) {
+			doubles[i] = (double) i / (count - 1);
+		}
+		wide.importPixels(width, height, "RGB", doubles);
+		double[] doublesOut = new double[count];
+		assertTrue(wide.dispatchImage(0, 0, width, height, "RGB", doublesOut));
+		for (int i = 0; i < count; i++) {
+			assertEquals("double " + i, doubles[i], doublesOut[i],
+				     deep ? 1.0 / 65535 : 1.0 / 255);
+		}
+
+		// Quantum components are transferred without conversion
+		Object quantum = null;
+		int depth = Magick.getQuantumDepth();
+		if (Magick.isHDRI()) {
+			quantum = depth == 64 ? (Object) new double[count] : new float[count];
+		} else if (depth == 8) {
+			quantum = new byte[count];
+		} else if (depth == 16) {
+			quantum = new short[count];
+		} else if (depth == 32) {
+			quantum = new int[count];
+		} else {
+			quantum = new long[count];
+		}
+		for (int i = 0; i < count; i++) {
+			java.lang.reflect.Array.setByte(quantum, i, (byte) i);
+		}
+		wide.constituteQuantumImage(width, height, "RGB", quantum);
+		Object quantumOut = java.lang.reflect.Array.newInstance(
+			quantum.getClass().getComponentType(), count);
+		assertTrue(wide.dispatchQuantumImage(0, 0, width, height, "RGB", quantumOut));
+		for (int i = 0; i < count; i++) {
+			assertEquals("quantum " + i, java.lang.reflect.Array.getDouble(quantum, i),
+				     java.lang.reflect.Array.getDouble(quantumOut, i), 0.0);
+		}
+
+		// An array that does not match the quantum is refused
+		try {
+			wide.dispatchQuantumImage(0, 0, width, height, "RGB", new char[count]);
+			fail("MagickException expected");
+		} catch (MagickException e) {
+		}
+		wide.close();
+	}
+
+	public void testBufferedImageRoundTrip() throws Exception {
+		int[] types = {
+			BufferedImage.TYPE_INT_ARGB,
+			BufferedImage.TYPE_3BYTE_BGR,
+			BufferedImage.TYPE_BYTE_GRAY
+		};
+		String[] maps = { "RGBA", "RGB", "I" };
+		int width = 31, height = 17;
+		for (int t = 0; t < types.length; t++) {
+			BufferedImage source = new BufferedImage(width, height, types[t]);
+			WritableRaster raster = source.getRaster();
+			int bands = raster.getNumBands();
+			int[] sample = new int[bands];
+			for (int y = 0; y < height; y++) {
+				for (int x = 0; x < width; x++) {
+					for (int b = 0; b < bands; b++) {
+						sample[b] = (x * 7 + y * 13 + b * 61) & 0xff;
+					}
+					raster.setPixel(x, y, sample);
+				}
+			}
+
+			MagickImage magick = new MagickImage();
+			magick.fromBufferedImage(source);
+			assertEquals(new Dimension(width, height), magick.getDimension());
+
+			// The raster bands are in the order of the map
+			byte[] pixel = new byte[bands];
+			magick.dispatchImage(5, 3, 1, 1, maps[t], pixel);
+			raster.getPixel(5, 3, sample);
+			for (int b = 0; b < bands; b++) {
+				assertEquals(maps[t] + "[" + b + "]", sample[b], pixel[b] & 0xff);
+			}
+
+			BufferedImage result = magick.toBufferedImage(types[t]);
+			assertEquals(types[t], result.getType());
+			int[] expected = raster.getPixels(0, 0, width, height, (int[]) null);
+			int[] actual = result.getRaster().getPixels(0, 0, width, height, (int[]) null);
+			assertTrue(maps[t], java.util.Arrays.equals(expected, actual));
+			magick.close();
+		}
+	}
+
+	public void testNativeBlobOutlivesOwner() throws Exception {
+		ImageInfo png = new ImageInfo();
+		png.setMagick("PNG");
+		// Keep only the buffer; the blob memory must stay valid
+		ByteBuffer buffer = image.imageToNativeBlob(png).getBuffer();
+		for (int i = 0; i < 5; i++) {
+			System.gc();
+			Thread.sleep(20);
+		}
+		byte[] bytes = new byte[buffer.remaining()];
+		buffer.get(bytes);
+		MagickImage decoded = new MagickImage(new ImageInfo(), bytes);
+		assertEquals(image.getDimension(), decoded.getDimension());
+		decoded.close();
+	}
+
+	public void testNativeStatsCountsLiveImages() throws Exception {
+		MagickImage image = new MagickImage();
+		image.constituteImage(100, 50, "RGB", new byte[100 * 50 * 3]);
+		NativeStats stats = Magick.getNativeStats();
+		assertTrue(stats.getImageCount() >= 1);
+		assertTrue(stats.getPixelBytes() >= 100 * 50 * 3);
+		assertTrue(stats.getPeakPixelBytes() >= stats.getPixelBytes());
+
+		// Closing twice is allowed
+		image.close();
+		image.close();
+	}
+
+	public void testCloseIsIdempotent() throws Exception {
+		MagickImage image = new MagickImage();
+		image.constituteImage(10, 10, "RGB", new byte[10 * 10 * 3]);
+		image.close();
+		image.close();
+		image.destroyImages();
+		try {
+			image.getDimension();
+			fail("MagickException expected");
+		} catch (MagickException e) {
+		}
+
+		// So may the other closeable objects
+		ImageInfo info = new ImageInfo();
+		info.close();
+		info.close();
+		CancelToken token = new CancelToken();
+		token.close();
+		token.close();
+	}
+
+	public void testLeakCount() throws Exception {
+		long leaks = Magick.getLeakCount();
+		allocateUnclosedImage();
+		for (int i = 0; i < 50 && Magick.getLeakCount() == leaks; i++) {
+			System.gc();
+			Thread.sleep(20);
+		}
+		assertTrue(Magick.getLeakCount() > leaks);
+	}
+
+	/** Creates an image and drops it without closing it. */
+	private void allocateUnclosedImage() throws MagickException {
+		MagickImage leaked = new MagickImage();
+		leaked.constituteImage(10, 10, "RGB", new byte[10 * 10 * 3]);
+	}
+
+	public void testPipeline() throws Exception {
+		Dimension size = image.getDimension();
+		MagickPipeline pipeline = new MagickPipeline()
+			.autoOrient()
+			.crop(new Rectangle(0, 0, 100, 80))
+			.resize(50, 40)
+			.unsharpMask(0.0, 1.0, 1.0, 0.05)
+			.strip();
+		MagickImage result = pipeline.run(image);
+		assertEquals(new Dimension(50, 40), result.getDimension());
+		assertEquals(size, image.getDimension());
+		result.close();
+
+		ImageInfo jpeg = new ImageInfo();
+		jpeg.setMagick("JPEG");
+		byte[] blob = pipeline.runToBlob(image, jpeg);
+		MagickImage decoded = new MagickImage(new ImageInfo(), blob);
+		assertEquals(new Dimension(50, 40), decoded.getDimension());
+	}
+
+	public void testPipelineAutoOrientMatchesAutoOrientImage() throws Exception {
+		MagickPipeline pipeline = new MagickPipeline().autoOrient();
+		for (int orientation = 0; orientation <= 8; orientation++) {
+			MagickImage input = new MagickImage(new ImageInfo(MagickTesttools.path_input
+				+ "exif_orientation" + File.separator
+				+ "exif_orientation_" + orientation + ".jpg"));
+			MagickImage expected = input.autoOrientImage();
+			MagickImage actual = pipeline.run(input);
+			assertEquals(expected.getDimension(), actual.getDimension());
+			int[][] corners = { { 0, 0 }, { 0, 49 }, { 49, 0 }, { 49, 49 } };
+			for (int[] c : corners) {
+				assertEquals("orientation[" + orientation + "]",
+					judgeColor(expected.getOnePixel(c[0], c[1])),
+					judgeColor(actual.getOnePixel(c[0], c[1])));
+			}
+			input.close();
+			expected.close();
+			actual.close();
+		}
+	}
+
+	public void testTransformInPlace() throws Exception {
+		MagickImage copy = image.cloneImage(0, 0, false);
+		copy.resizeImageInPlace(60, 40, 1.0);
+		assertEquals(new Dimension(60, 40), copy.getDimension());
+		copy.cropImageInPlace(new Rectangle(10, 10, 20, 20));
+		assertEquals(new Dimension(20, 20), copy.getDimension());
+
+		// The replaced image is left without frames
+		MagickImage flipped = copy.flipImage();
+		copy.replaceImage(flipped);
+		assertEquals(new Dimension(20, 20), copy.getDimension());
+		try {
+			flipped.getDimension();
+			fail("image was not emptied");
+		} catch (MagickException e) {
+		}
+		copy.close();
+
+		// Frames after the first would be lost
+		MagickImage animation = new MagickImage(new MagickImage[] { image, image });
+		try {
+			animation.blurImageInPlace(1.0, 0.5);
+			fail("multi-frame image was accepted");
+		} catch (MagickException e) {
+		}
+		assertEquals(2, animation.getNumFrames());
+		animation.close();
+	}
+
+	public void testAdoptAndSplitFrames() throws Exception {
+		MagickImage[] frames = new MagickImage[3];
+		for (int i = 0; i < frames.length; i++) {
+			frames[i] = image.cloneImage(0, 0, false);
+		}
+		MagickImage animation = MagickImage.adopt(frames);
+		assertEquals(3, animation.getNumFrames());
+		try {
+			frames[0].getDimension();
+			fail("frames were not moved");
+		} catch (MagickException e) {
+		}
+
+		MagickImage[] split = animation.splitFrames();
+		assertEquals(3, split.length);
+		assertSame(animation, split[0]);
+		for (int i = 0; i < split.length; i++) {
+			assertEquals(1, split[i].getNumFrames());
+			assertEquals(image.getDimension(), split[i].getDimension());
+		}
+	}
+
+	public void testFrameIterator() throws Exception {
+		MagickImage[] frames = new MagickImage[4];
+		for (int i = 0; i < frames.length; i++) {
+			frames[i] = image.scaleImage(40, 30);
+		}
+		MagickImage animation = MagickImage.adopt(frames);
+		String fileName = MagickTesttools.path_actual_output + "frames.gif";
+		animation.setFileName(fileName);
+		animation.writeImage(new ImageInfo());
+		animation.close();
+
+		FrameIterator it = MagickImage.frames(new ImageInfo(fileName), true);
+		assertEquals(4, it.getFrameCount());
+		int count = 0;
+		for (MagickImage frame : it) {
+			assertEquals(1, frame.getNumFrames());
+			assertEquals(new Dimension(40, 30), frame.getDimension());
+			count++;
+		}
+		it.close();
+		assertEquals(4, count);
+	}
+
+	public void testReadThumbnail() throws Exception {
+		// Fit inside the bounds with the aspect ratio kept
+		int[][] bounds = { { 50, 50, 50, 34 }, { 100, 20, 30, 20 }, { 99, 67, 99, 67 } };
+		for (int i = 0; i < bounds.length; i++) {
+			MagickImage thumbnail = new MagickImage();
+			thumbnail.readThumbnail(new ImageInfo(MagickTesttools.path_input + "pics.jpg"),
+						bounds[i][0], bounds[i][1]);
+			assertEquals(new Dimension(bounds[i][2], bounds[i][3]),
+				     thumbnail.getDimension());
+			assertEquals(1, thumbnail.getNumFrames());
+			thumbnail.close();
+		}
+
+		// Never enlarged
+		MagickImage thumbnail = new MagickImage();
+		thumbnail.readThumbnail(new ImageInfo(MagickTesttools.path_input + "pics.jpg"),
+					400, 400);
+		assertEquals(image.getDimension(), thumbnail.getDimension());
+		thumbnail.close();
+
+		try {
+			new MagickImage().readThumbnail(new ImageInfo(MagickTesttools.path_input + "pics.jpg"),
+							0, 50);
+			fail("MagickException expected");
+		} catch (MagickException e) {
+		}
+	}
+
+	public void testReadThumbnailScenes() throws Exception {
+		MagickImage[] frames = new MagickImage[4];
+		for (int i = 0; i < frames.length; i++) {
+			frames[i] = image.cloneImage(0, 0, false);
+		}
+		MagickImage animation = MagickImage.adopt(frames);
+		String fileName = MagickTesttools.path_actual_output + "thumbnail_scenes.gif";
+		animation.setFileName(fileName);
+		animation.writeImage(new ImageInfo());
+		animation.close();
+
+		// Every selected scene is resized, none is dropped
+		ImageInfo info = new ImageInfo(fileName + "[1-2]");
+		MagickImage thumbnail = new MagickImage();
+		thumbnail.readThumbnail(info, 50, 50);
+		assertEquals(2, thumbnail.getNumFrames());
+		MagickImage[] scenes = thumbnail.breakFrames();
+		for (int i = 0; i < scenes.length; i++) {
+			assertEquals(new Dimension(50, 34), scenes[i].getDimension());
+		}
+		thumbnail.close();
+	}
+
+	public void testThumbnailer() throws Exception {
+		ImageInfo png = new ImageInfo();
+		png.setMagick("PNG");
+		byte[] source = image.scaleImage(400, 300).imageToBlob(png);
+		Thumbnailer thumbnailer = new Thumbnailer(100, 100)
+			.setFormat("JPEG")
+			.setQuality(80)
+			.setSharpen(0.5, 0.8, 0.05)
+			.setBackground("white");
+		byte[] blob = thumbnailer.thumbnail(source);
+		MagickImage thumbnail = new MagickImage(new ImageInfo(), blob);
+		assertEquals(new Dimension(100, 75), thumbnail.getDimension());
+		assertEquals("JPEG", thumbnail.getMagick());
+		thumbnail.close();
+	}
+
+	public void testRenditions() throws Exception {
+		MagickImage source = image.scaleImage(400, 300);
+		ImageInfo jpeg = new ImageInfo();
+		jpeg.setMagick("JPEG");
+		int[] sizes = { 100, 800, 200, 200 };
+		byte[][] blobs = source.renditions(sizes, jpeg);
+		assertEquals(sizes.length, blobs.length);
+		Dimension[] expected = {
+			new Dimension(100, 75), new Dimension(400, 300),
+			new Dimension(200, 150), new Dimension(200, 150)
+		};
+		for (int i = 0; i < blobs.length; i++) {
+			MagickImage rendition = new MagickImage(new ImageInfo(), blobs[i]);
+			assertEquals(expected[i], rendition.getDimension());
+			rendition.close();
+		}
+		assertEquals(new Dimension(400, 300), source.getDimension());
+		source.close();
+	}
+
+	public void testProgressMonitorAndCancel() throws Exception {
+		final java.util.List<String> tags = new java.util.ArrayList<String>();
+		ProgressMonitor monitor = new ProgressMonitor() {
+			public boolean progress(String tag, long offset, long extent) {
+				tags.add(tag);
+				return true;
+			}
+		};
+		int budget = Magick.getThreadBudget();
+		try {
+			// Keep the progress on the calling thread
+			Magick.setThreadBudget(1);
+
+			image.setProgressMonitor(monitor, null);
+			image.resizeImage(100, 60, 1.0).close();
+			assertFalse(tags.isEmpty());
+			assertTrue(tags.toString(), tags.get(0).startsWith("Resize"));
+
+			// A cancelled token stops the operations
+			CancelToken token = new CancelToken();
+			token.cancel();
+			assertTrue(token.isCancelled());
+			image.setProgressMonitor(monitor, token);
+			try {
+				image.resizeImage(100, 60, 1.0);
+				fail("Cancelled resize must throw");
+			} catch (MagickException e) {
+			}
+			try {
+				image.blurImage(3.0, 1.0);
+				fail("Cancelled blur must throw");
+			} catch (MagickException e) {
+			}
+
+			// So does an expired deadline
+			CancelToken deadline = new CancelToken(1);
+			Thread.sleep(20);
+			assertTrue(deadline.isCancelled());
+			image.setProgressMonitor(null, deadline);
+			try {
+				image.blurImage(3.0, 1.0);
+				fail("Expired blur must throw");
+			} catch (MagickException e) {
+			}
+
+			// And a monitor returning false
+			image.setProgressMonitor(new ProgressMonitor() {
+				public boolean progress(String tag, long offset, long extent) {
+					return false;
+				}
+			}, null);
+			try {
+				image.blurImage(3.0, 1.0);
+				fail("Refused blur must throw");
+			} catch (MagickException e) {
+			}
+
+			// Removing the monitor lets operations run again
+			image.setProgressMonitor(null, null);
+			image.blurImage(3.0, 1.0).close();
+			token.close();
+			deadline.close();
+		}
+		finally {
+			Magick.setThreadBudget(budget);
+		}
+	}
+
+	public void testProbe() throws Exception {
+		String[] paths = {
+			MagickTesttools.path_input + "pics.jpg",
+			MagickTesttools.path_input + "exif_orientation" + File.separator
+				+ "exif_orientation_6.jpg",
+			MagickTesttools.path_input + "does_not_exist.jpg",
+			null
+		};
+		for (int threads = 1; threads <= 3; threads += 2) {
+			ImageProbe probe = Magick.probe(paths, threads);
+			assertEquals(4, probe.size());
+			assertEquals(198, probe.getWidths()[0]);
+			assertEquals(134, probe.getHeights()[0]);
+			assertEquals(1, probe.getFrames()[0]);
+			assertEquals(8, probe.getDepths()[0]);
+			assertEquals("JPEG", probe.getFormats()[0]);
+			assertNull(probe.getErrors()[0]);
+			assertEquals(6, probe.getOrientations()[1]);
+			for (int i = 2; i < 4; i++) {
+				assertEquals(0, probe.getWidths()[i]);
+				assertNull(probe.getFormats()[i]);
+				assertNotNull(probe.getErrors()[i]);
+			}
+		}
+
+		ImageInfo png = new ImageInfo();
+		png.setMagick("PNG");
+		byte[] blob = image.imageToBlob(png);
+		ByteBuffer heap = ByteBuffer.allocate(3 + blob.length);
+		heap.position(3);
+		heap.put(blob);
+		heap.position(3);
+		ByteBuffer direct = ByteBuffer.allocateDirect(blob.length);
+		direct.put(blob);
+		direct.flip();
+		ByteBuffer[] blobs = { heap, direct, ByteBuffer.allocate(0) };
+		for (int threads = 1; threads <= 3; threads += 2) {
+			ImageProbe probe = Magick.probe(blobs, threads);
+			for (int i = 0; i < 2; i++) {
+				assertEquals(198, probe.getWidths()[i]);
+				assertEquals(134, probe.getHeights()[i]);
+				assertEquals("PNG", probe.getFormats()[i]);
+			}
+			assertNotNull(probe.getErrors()[2]);
+			// The buffers are left as they were
+			assertEquals(3, heap.position());
+			assertEquals(0, direct.position());
+		}
+	}
+
+	public void testStreamImage() throws Exception {
+		final Dimension size = image.getDimension();
+		final byte[] expected = new byte[size.width * size.height * 3];
+		image.dispatchImage(0, 0, size.width, size.height, "RGB", expected);
+		final java.util.List<int[]> bands = new java.util.ArrayList<int[]>();
+		final byte[] streamed = new byte[expected.length];
+		MagickImage.streamImage(new ImageInfo(MagickTesttools.path_input + "pics.jpg"),
+			"RGB", 10, new PixelStreamHandler() {
+				public boolean pixelRows(int frame, int width, int height,
+							 int y, int rows, ByteBuffer pixels) {
+					bands.add(new int[] { frame, width, height, y, rows });
+					assertEquals(width * rows * 3, pixels.remaining());
+					pixels.get(streamed, y * width * 3, pixels.remaining());
+					return true;
+				}
+			});
+
+		// Bands of at most 10 rows, in order, the last one shorter
+		assertEquals(14, bands.size());
+		for (int i = 0; i < bands.size(); i++) {
+			int[] band = bands.get(i);
+			assertEquals(0, band[0]);
+			assertEquals(size.width, band[1]);
+			assertEquals(size.height, band[2]);
+			assertEquals(i * 10, band[3]);
+			assertEquals(i < 13 ? 10 : 4, band[4]);
+		}
+		assertTrue(java.util.Arrays.equals(expected, streamed));
+
+		// A handler returning false stops the decode
+		final int[] calls = new int[1];
+		MagickImage.streamImage(new ImageInfo(MagickTesttools.path_input + "pics.jpg"),
+			"I", 16, new PixelStreamHandler() {
+				public boolean pixelRows(int frame, int width, int height,
+							 int y, int rows, ByteBuffer pixels) {
+					assertEquals(width * rows, pixels.remaining());
+					calls[0]++;
+					return false;
+				}
+			});
+		assertEquals(1, calls[0]);
+
+		try {
+			MagickImage.streamImage(new ImageInfo(MagickTesttools.path_input + "pics.jpg"),
+				"RGBX", 16, new PixelStreamHandler() {
+					public boolean pixelRows(int frame, int width, int height,
+								 int y, int rows, ByteBuffer pixels) {
+						return true;
+					}
+				});
+			fail("MagickException expected");
+		} catch (MagickException e) {
+		}
+	}
+
+	public void testStreamImageWithMonitor() throws Exception {
+		final int[] ticks = new int[1];
+		final int[] rows = new int[1];
+		PixelStreamHandler handler = new PixelStreamHandler() {
+			public boolean pixelRows(int frame, int width, int height,
+						 int y, int count, ByteBuffer pixels) {
+				rows[0] += count;
+				return true;
+			}
+		};
+		ImageInfo info = new ImageInfo(MagickTesttools.path_input + "pics.jpg");
+		CancelToken token = new CancelToken();
+		info.setProgressMonitor(new ProgressMonitor() {
+			public boolean progress(String tag, long offset, long extent) {
+				ticks[0]++;
+				return true;
+			}
+		}, token);
+		MagickImage.streamImage(info, "RGB", 16, handler);
+		assertEquals(134, rows[0]);
+		assertTrue(ticks[0] > 0);
+
+		// A cancelled token stops the stream
+		token.cancel();
+		rows[0] = 0;
+		try {
+			MagickImage.streamImage(info, "RGB", 16, handler);
+			fail("Cancelled stream must throw");
+		} catch (MagickException e) {
+		}
+		assertTrue(rows[0] < 134);
+		info.setProgressMonitor(null, null);
+		token.close();
+	}
+
+	public void testAsync() throws Exception {
+		MagickImage read = MagickImage.readAsync(
+			new ImageInfo(MagickTesttools.path_input + "pics.jpg")).get();
+		assertEquals(image.getDimension(), read.getDimension());
+		MagickImage resized = read.resizeAsync(60, 40).get();
+		assertEquals(new Dimension(60, 40), resized.getDimension());
+		ImageInfo png = new ImageInfo();
+		png.setMagick("PNG");
+		byte[] blob = resized.toBlobAsync(png).get();
+		MagickImage decoded = new MagickImage(new ImageInfo(), blob);
+		assertEquals(new Dimension(60, 40), decoded.getDimension());
+		read.close();
+		resized.close();
+		decoded.close();
+
+		// Failures complete the future exceptionally
+		try {
+			MagickImage.readAsync(new ImageInfo(MagickTesttools.path_input
+				+ "does_not_exist.jpg")).get();
+			fail("ExecutionException expected");
+		} catch (java.util.concurrent.ExecutionException e) {
+			assertTrue(e.getCause() instanceof MagickException);
+		}
+
+		// A full queue rejects operations
+		MagickExecutor executor = new MagickExecutor(1, 1);
+		final java.util.concurrent.CountDownLatch release =
+			new java.util.concurrent.CountDownLatch(1);
+		java.util.concurrent.Callable<Object> blocker =
+			new java.util.concurrent.Callable<Object>() {
+				public Object call() throws Exception {
+					release.await();
+					return null;
+				}
+			};
+		java.util.concurrent.CompletableFuture<Object> running = executor.submit(blocker);
+		java.util.concurrent.CompletableFuture<Object> queued = executor.submit(blocker);
+		java.util.concurrent.CompletableFuture<Object> rejected = executor.submit(blocker);
+		try {
+			rejected.get();
+			fail("ExecutionException expected");
+		} catch (java.util.concurrent.ExecutionException e) {
+			assertTrue(e.getCause() instanceof java.util.concurrent.RejectedExecutionException);
+		}
+		release.countDown();
+		running.get();
+		queued.get();
+		executor.shutdown();
+	}
+
+	public void testThreadBudget() throws Exception {
+		int budget = Magick.getThreadBudget();
+		try {
+			Magick.setThreadBudget(1);
+			// ImageMagick sizes its thread teams from this limit
+			assertEquals(1, Magick.getResourceLimit(ResourceType.ThreadResource));
+			new MagickExecutor(2, 4, 2);
+			assertEquals(2, Magick.getThreadBudget());
+
+			// Only the three-argument constructor sets the budget
+			new MagickExecutor(3, 4);
+			MagickExecutor.getDefault();
+			assertEquals(2, Magick.getThreadBudget());
+
+			// Arguments are checked before the budget is changed
+			try {
+				new MagickExecutor(0, 4, 3);
+				fail("IllegalArgumentException expected");
+			} catch (IllegalArgumentException e) {
+			}
+			try {
+				new MagickExecutor(2, 0);
+				fail("IllegalArgumentException expected");
+			} catch (IllegalArgumentException e) {
+			}
+			assertEquals(2, Magick.getThreadBudget());
+		}
+		finally {
+			Magick.setThreadBudget(budget);
+		}
+	}
+
+	public void testResourceLimitOverride() throws Exception {
+		long limit = Magick.getResourceLimit(ResourceType.DiskResource);
+		ResourceLimitOverride o =
+			Magick.overrideResourceLimit(ResourceType.DiskResource, 0);
+		assertEquals(0, Magick.getResourceLimit(ResourceType.DiskResource));
+		o.close();
+		assertEquals(limit, Magick.getResourceLimit(ResourceType.DiskResource));
+	}
+
 				/**
 				 * Test annotate with text.
 				 * Expect this test to fail when the font set change